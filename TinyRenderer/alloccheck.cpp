@@ -0,0 +1,214 @@
+//
+//  alloccheck.cpp
+//  TinyRenderer
+//
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "alloccheck.h"
+#include "model.h"
+#include "output.h"
+#include "postprocess.h"
+#include "progressive.h"
+#include "renderer.h"
+#include "shaders.h"
+#include "shadow.h"
+#include "threadpool.h"
+
+namespace
+{
+std::atomic<unsigned long> allocations(0);
+
+void *counted_alloc(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void *counted_alloc(size_t size, std::align_val_t align)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = nullptr;
+    size_t alignment = std::max(sizeof(void*), (size_t)align);
+    if (posix_memalign(&p, alignment, size ? size : 1) != 0) throw std::bad_alloc();
+    return p;
+}
+}
+
+void *operator new(size_t size) { return counted_alloc(size); }
+void *operator new[](size_t size) { return counted_alloc(size); }
+void *operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    try { return counted_alloc(size); } catch (...) { return nullptr; }
+}
+void *operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    try { return counted_alloc(size); } catch (...) { return nullptr; }
+}
+void *operator new(size_t size, std::align_val_t align) { return counted_alloc(size, align); }
+void *operator new[](size_t size, std::align_val_t align) { return counted_alloc(size, align); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { free(p); }
+
+unsigned long allocation_count()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+namespace
+{
+const int kWarmupFrames = 2;
+const int kCheckedFrames = 5;
+const int kSize = 256;
+const int kMinThreads = 4;
+
+struct Config
+{
+    const char *name;
+    bool lit;
+    int samples;
+    int shadowSize;
+    int ssaoScale;
+    bool stream;
+    bool incremental; // incremental frames where only the first model changes
+    int lights;       // point and spot lights culled per tile after a depth prepass, 0 for none
+    bool hdr;         // RGB9E5 framebuffer tone mapped with ACES
+    bool progressive; // coarse pass, then every tile refined in geometry order (no deadline, so every frame does the same work)
+};
+
+const Config kConfigs[] = {
+    {"flat", false, 1, 0, 0, false, false, 0, false, false},
+    {"lit", true, 1, 0, 0, false, false, 0, false, false},
+    {"lit msaa4 streamed", true, 4, 0, 0, true, false, 0, false, false},
+    {"lit msaa8 shadow", true, 8, 512, 0, false, false, 0, false, false},
+    {"lit ssao", true, 1, 0, 2, false, false, 0, false, false},
+    {"incremental msaa4", true, 4, 0, 0, false, true, 0, false, false},
+    {"lights 256", true, 1, 0, 0, false, false, 256, false, false},
+    {"hdr msaa4 streamed", true, 4, 0, 0, true, false, 0, true, false},
+    {"progressive msaa4", true, 4, 0, 0, false, false, 0, false, true},
+};
+}
+
+//Usage: TinyRenderer --alloc-check [--models dir] [--threads n]
+//The pool gets at least kMinThreads threads, even on fewer cores, so that allocations that
+//depend on which thread takes which job show up.
+int run_alloc_check(int argc, const char *argv[])
+{
+    std::string dir = "Models";
+    int threads = std::max(kMinThreads, (int)std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--models") && i+1 < argc) dir = argv[++i];
+        else if (!strcmp(argv[i], "--threads") && i+1 < argc) threads = std::max(1, atoi(argv[++i]));
+    }
+    if (!ThreadPool::set_instance_size(threads)) threads = ThreadPool::instance().size();
+    printf("threads: %d\n", threads);
+    std::vector<Model*> models;
+    {
+        std::ostringstream sink;
+        std::streambuf *saved = std::cerr.rdbuf(sink.rdbuf());
+        models.push_back(new Model((dir+"/diablo3_pose/diablo3_pose.obj").c_str()));
+        models.push_back(new Model((dir+"/floor.obj").c_str()));
+        std::cerr.rdbuf(saved);
+    }
+    if (models[0]->nFaces() == 0)
+    {
+        std::cerr << "can't load the models from " << dir << ", pass --models\n";
+        return 2;
+    }
+    const Vec3f eye(1, 1, 3), center(0, 0, 0), up(0, 1, 0), light(1, 1, 1);
+    const float coeff = -1.f/(eye-center).norm();
+    const Matrix4f view = lookat(eye, center, up);
+    const Matrix4f transform = projection(coeff)*view;
+    int failures = 0;
+    for (const Config &config : kConfigs)
+    {
+        ShadowMap *shadow = config.shadowSize > 0 ? new ShadowMap(config.shadowSize) : nullptr;
+        const std::vector<Light> lights = scatter_lights(config.lights, center, std::sqrt(3.f));
+        LightGrid grid(kSize, kSize);
+        std::vector<IShader*> shaders;
+        for (Model *model : models)
+        {
+            if (config.lights > 0) shaders.push_back(new LightsShader(model, transform, &lights, &grid));
+            else if (config.lit) shaders.push_back(new LitShader(model, transform, light, shadow));
+            else shaders.push_back(new FlatShader(model));
+        }
+        Renderer renderer(kSize, kSize, config.samples);
+        renderer.set_hdr(config.hdr);
+        ProgressiveRenderer *progressive = config.progressive ? new ProgressiveRenderer(kSize, kSize, config.samples) : nullptr;
+        if (progressive) progressive->set_order(ProgressiveRenderer::GEOMETRY_FIRST);
+        AmbientOcclusion *ssao = config.ssaoScale > 0 ? new AmbientOcclusion(kSize, kSize, config.ssaoScale == 2) : nullptr;
+        TGAImage image(kSize, kSize, TGAImage::RGB);
+        std::string bytes;
+        BufferOutput out(bytes);
+        FrameWriter writer(out, FrameWriter::TGA_RLE, kSize, kSize);
+        unsigned long before = 0;
+        for (int frame = 0; frame < kWarmupFrames+kCheckedFrames; frame++)
+        {
+            if (frame == kWarmupFrames) before = allocation_count();
+            bytes.clear();
+            if (shadow) shadow->render(models, light, center, std::sqrt(3.f));
+            if (progressive)
+            {
+                progressive->render(models, shaders, -1., image);
+                writer.write_image(image);
+                continue;
+            }
+            if (config.incremental)
+            {
+                renderer.begin_frame();
+                for (size_t m = 0; m < models.size(); m++) renderer.draw(*models[m], *shaders[m], m == 0);
+                renderer.end_frame();
+            }
+            else if (config.lights > 0)
+            {
+                renderer.clear();
+                renderer.set_color_write(false);
+                renderer.set_depth_test(Renderer::DEPTH_GREATER);
+                for (size_t m = 0; m < models.size(); m++) renderer.draw(*models[m], *shaders[m]);
+                grid.cull(lights, view, coeff, renderer.depth_buffer());
+                renderer.set_color_write(true);
+                renderer.set_depth_test(Renderer::DEPTH_GREATER_EQUAL);
+                for (size_t m = 0; m < models.size(); m++) renderer.draw(*models[m], *shaders[m]);
+            }
+            else
+            {
+                renderer.clear();
+                for (size_t m = 0; m < models.size(); m++) renderer.draw(*models[m], *shaders[m]);
+            }
+            if (config.stream)
+            {
+                renderer.resolve(writer);
+                continue;
+            }
+            renderer.resolve(image);
+            if (ssao) ssao->apply(renderer.depth_buffer(), renderer.get_samples(), kSize/2.f, image);
+            writer.write_image(image);
+        }
+        const unsigned long count = allocation_count()-before;
+        printf("%-6s %-20s %lu allocations in %d frames\n", count ? "FAIL" : "OK", config.name, count, kCheckedFrames);
+        failures += count != 0;
+        for (IShader *shader : shaders) delete shader;
+        delete shadow;
+        delete ssao;
+        delete progressive;
+    }
+    for (Model *model : models) delete model;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,19 @@
+//
+//  alloccheck.h
+//  TinyRenderer
+//
+//  alloccheck.cpp replaces the global operator new/delete with versions that count calls,
+//  so that the steady state of a frame can be checked for heap allocations.
+//
+
+#ifndef alloccheck_h
+#define alloccheck_h
+
+//Calls to the global operator new (every form) since the program started, all threads
+unsigned long allocation_count();
+
+//Entry point of `TinyRenderer --alloc-check`: renders the golden scenes for a few frames and
+//fails when a frame after the warm-up allocates. Returns the process exit code.
+int run_alloc_check(int argc, const char *argv[]);
+
+#endif /* alloccheck_h */
@@ -0,0 +1,64 @@
+//
+//  arena.cpp
+//  TinyRenderer
+//
+
+#include <algorithm>
+#include <cstdint>
+#include "arena.h"
+
+Arena::Arena(size_t blockSize)
+: blocks_(), current_(0), offset_(0), blockSize_(blockSize), used_(0)
+{}
+
+Arena::~Arena()
+{
+    for (Block &block : blocks_) delete [] block.data;
+}
+
+void *Arena::allocate(size_t bytes, size_t align)
+{
+    for (;;)
+    {
+        if (current_ < blocks_.size())
+        {
+            Block &block = blocks_[current_];
+            const uintptr_t base = (uintptr_t)block.data;
+            const size_t start = ((base+offset_+align-1) & ~(uintptr_t)(align-1))-base;
+            if (start+bytes <= block.size)
+            {
+                offset_ = start+bytes;
+                used_ += bytes;
+                return block.data+start;
+            }
+            //the rest of this block is wasted until the next reset
+            current_++;
+            offset_ = 0;
+            continue;
+        }
+        //only reached while the arena grows to the frame's high water mark
+        Block block;
+        block.size = std::max(blockSize_, bytes+align);
+        block.data = new char[block.size];
+        blocks_.push_back(block);
+    }
+}
+
+void Arena::reset()
+{
+    current_ = 0;
+    offset_ = 0;
+    used_ = 0;
+}
+
+size_t Arena::used()
+{
+    return used_;
+}
+
+size_t Arena::capacity()
+{
+    size_t bytes = 0;
+    for (const Block &block : blocks_) bytes += block.size;
+    return bytes;
+}
@@ -0,0 +1,52 @@
+//
+//  arena.h
+//  TinyRenderer
+//
+//  Linear allocators for data that only lives for one frame. Nothing is freed on its own:
+//  reset() drops every allocation at once in O(1). The memory comes in blocks that are
+//  kept across resets, so once a frame has run, the next ones with the same load don't
+//  touch the heap.
+//
+
+#ifndef arena_h
+#define arena_h
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+class Arena
+{
+private:
+    struct Block
+    {
+        char *data;
+        size_t size;
+    };
+    
+    std::vector<Block> blocks_;
+    size_t current_; // block being filled
+    size_t offset_;  // first free byte in it
+    size_t blockSize_;
+    size_t used_;
+public:
+    Arena(size_t blockSize = 1 << 20);
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena();
+    
+    void *allocate(size_t bytes, size_t align);
+    //Uninitialized storage for count objects, which are never destroyed
+    template <class T>
+    T *allocate(size_t count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return (T *)allocate(count*sizeof(T), alignof(T));
+    }
+    void reset();
+    //Bytes handed out since the last reset, and bytes held in blocks
+    size_t used();
+    size_t capacity();
+};
+
+#endif /* arena_h */
@@ -0,0 +1,232 @@
+//
+//  assetloader.cpp
+//  TinyRenderer
+//
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "assetloader.h"
+#include "profiler.h"
+
+namespace
+{
+//Reads a buffer in place, where an istringstream would copy it
+class MemoryBuffer : public std::streambuf
+{
+public:
+    MemoryBuffer(std::vector<char> &data)
+    {
+        setg(data.data(), data.data(), data.data()+data.size());
+    }
+    
+protected:
+    //Enough seeking for Model::read_cache to measure what is left
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+    {
+        if (!(which & std::ios_base::in)) return pos_type(off_type(-1));
+        char *base = dir == std::ios_base::beg ? eback() : (dir == std::ios_base::cur ? gptr() : egptr());
+        if (base+off < eback() || base+off > egptr()) return pos_type(off_type(-1));
+        setg(eback(), base+off, egptr());
+        return pos_type(gptr()-eback());
+    }
+    
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+    {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+};
+}
+
+AssetLoader::AssetLoader(int decodeThreads)
+: io_(), decoders_(), mutex_(), readWake_(), decodeWake_(), done_(), reads_(), decodes_(), entries_(), finished_(), returned_(0),
+  stopReads_(false), stopDecodes_(false)
+{
+    if (decodeThreads <= 0) decodeThreads = std::max(1, (int)std::thread::hardware_concurrency());
+    io_ = std::thread(&AssetLoader::io_thread, this);
+    for (int i = 0; i < decodeThreads; i++)
+    {
+        decoders_.emplace_back(&AssetLoader::decode_thread, this, i);
+    }
+}
+
+AssetLoader::~AssetLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopReads_ = true;
+    }
+    readWake_.notify_all();
+    io_.join();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopDecodes_ = true;
+    }
+    decodeWake_.notify_all();
+    for (std::thread &t : decoders_) t.join();
+    for (Entry &entry : entries_)
+    {
+        if (!entry.taken) delete entry.model;
+    }
+}
+
+int AssetLoader::load(const char *fileName, bool optimize)
+{
+    int id = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = (int)entries_.size();
+        Model *model = new Model();
+        entries_.push_back({model, PARTS, false});
+        for (int part = 0; part < PARTS; part++)
+        {
+            reads_.push_back({id, (Part)part, model, fileName, optimize, std::string(), false, std::vector<char>()});
+        }
+    }
+    readWake_.notify_one();
+    return id;
+}
+
+int AssetLoader::next()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (returned_ == (int)entries_.size()) return -1;
+    done_.wait(lock, [&]() { return !finished_.empty(); });
+    const int id = finished_.front();
+    finished_.pop_front();
+    returned_++;
+    return id;
+}
+
+bool AssetLoader::ready(int id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_[id].pending == 0;
+}
+
+Model *AssetLoader::take(int id)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [&]() { return entries_[id].pending == 0; });
+    entries_[id].taken = true;
+    return entries_[id].model;
+}
+
+//Files are read one at a time in queue order: the disk streams instead of seeking between
+//several files, and the first model's files are all in memory before the second's start
+void AssetLoader::io_thread()
+{
+    PROFILE_ONLY(profiler::set_thread_name("io");)
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            readWake_.wait(lock, [&]() { return stopReads_ || !reads_.empty(); });
+            if (reads_.empty()) return;
+            job = std::move(reads_.front());
+            reads_.pop_front();
+        }
+        read(job);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            decodes_.push_back(std::move(job));
+        }
+        decodeWake_.notify_one();
+    }
+}
+
+void AssetLoader::decode_thread([[maybe_unused]] int id)
+{
+    PROFILE_ONLY(profiler::set_thread_name(("decode "+std::to_string(id)).c_str());)
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            decodeWake_.wait(lock, [&]() { return stopDecodes_ || !decodes_.empty(); });
+            if (decodes_.empty()) return;
+            job = std::move(decodes_.front());
+            decodes_.pop_front();
+        }
+        decode(job);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--entries_[job.id].pending == 0)
+        {
+            finished_.push_back(job.id);
+            done_.notify_all();
+        }
+    }
+}
+
+void AssetLoader::read(Job &job)
+{
+    PROFILE_SCOPE("file read");
+    if (job.part == MESH)
+    {
+        job.path = Model::cache_file(job.fileName.c_str(), job.optimize);
+        job.cache = !job.path.empty();
+        if (!job.cache) job.path = job.fileName;
+    }
+    else
+    {
+        job.path = Model::texture_file(job.fileName, job.part == DIFFUSE ? "_diffuse.tga" : "_nm_tangent.tga");
+        if (job.path.empty()) return;
+    }
+    std::ifstream in(job.path, std::ios::binary | std::ios::ate);
+    const std::streamoff size = in.is_open() ? (std::streamoff)in.tellg() : -1;
+    if (size >= 0)
+    {
+        job.data.resize((size_t)size);
+        in.seekg(0);
+        in.read(job.data.data(), size);
+    }
+    if (size < 0 || !in.good())
+    {
+        job.path.clear();
+        job.data.clear();
+    }
+}
+
+//Same steps as the Model constructor, from the bytes the I/O thread read
+void AssetLoader::decode(Job &job)
+{
+    MemoryBuffer buffer(job.data);
+    std::istream in(&buffer);
+    if (job.part == MESH)
+    {
+        //A cache that couldn't be read falls back to the obj, which load_mesh opens itself
+        const bool read = !job.path.empty();
+        if (!read && !job.cache) return; // no obj, the model stays empty
+        job.model->load_mesh(job.fileName.c_str(), job.optimize, read && job.cache ? &in : nullptr, read && !job.cache ? &in : nullptr);
+        return;
+    }
+    if (job.path.empty()) return;
+    TGAImage &img = job.part == DIFFUSE ? job.model->diffusemap_ : job.model->normalmap_;
+    const bool ok = img.read_tga(in, TGAImage::BOTTOM_LEFT);
+    std::ostringstream message;
+    message << "texture file " << job.path << " loading " << (ok ? "ok" : "failed") << "\n";
+    std::cerr << message.str();
+}
+
+LockedStringBuf::int_type LockedStringBuf::overflow(int_type c)
+{
+    if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+    std::lock_guard<std::mutex> lock(mutex_);
+    text_.push_back(traits_type::to_char_type(c));
+    return c;
+}
+
+std::streamsize LockedStringBuf::xsputn(const char *s, std::streamsize n)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    text_.append(s, (size_t)n);
+    return n;
+}
+
+std::string LockedStringBuf::str()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return text_;
+}
@@ -0,0 +1,102 @@
+//
+//  assetloader.h
+//  TinyRenderer
+//
+//  Asynchronous model loading. One I/O thread reads every file a model needs (the obj or its
+//  .trmesh cache, the diffuse and normal map TGAs) into memory, in the order the models were
+//  queued, and a set of decode threads parses them as they arrive. A model's mesh and each of
+//  its textures decode independently, so reading a file overlaps decoding the ones before
+//  it, and a scene is ready about when its largest asset is instead of after every asset in
+//  turn. Models are handed out in the order they finish: the caller can draw the ones that
+//  are ready while the others are still loading.
+//
+
+#ifndef assetloader_h
+#define assetloader_h
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include "model.h"
+
+class AssetLoader
+{
+public:
+    AssetLoader(int decodeThreads = 0); // 0 means one per hardware thread
+    AssetLoader(const AssetLoader&) = delete;
+    AssetLoader& operator=(const AssetLoader&) = delete;
+    //Waits for the loads still running and deletes the models nobody took
+    ~AssetLoader();
+    
+    //Queues a model, loaded as Model(fileName, optimize) would. Returns its id, which is the
+    //number of models queued before it.
+    int load(const char *fileName, bool optimize = false);
+    //Id of a model that finished and wasn't returned by next() yet, waiting for one when
+    //none has. -1 once every queued model was returned.
+    int next();
+    bool ready(int id);
+    //Waits for the model and hands it over, the caller deletes it. Once per id.
+    Model *take(int id);
+private:
+    enum Part { MESH, DIFFUSE, NORMALMAP, PARTS };
+    
+    //A file to read, then decode into its model
+    struct Job
+    {
+        int id;
+        Part part;
+        Model *model;
+        std::string fileName;   // the obj
+        bool optimize;
+        std::string path;       // filled in by the I/O thread, empty when there is no such file
+        bool cache;             // MESH: path is the .trmesh rather than the obj
+        std::vector<char> data;
+    };
+    struct Entry
+    {
+        Model *model;
+        int pending; // parts not decoded yet
+        bool taken;
+    };
+    
+    std::thread io_;
+    std::vector<std::thread> decoders_;
+    std::mutex mutex_;
+    std::condition_variable readWake_;
+    std::condition_variable decodeWake_;
+    std::condition_variable done_;
+    std::deque<Job> reads_;
+    std::deque<Job> decodes_;
+    std::vector<Entry> entries_; // by id, only touched under mutex_
+    std::deque<int> finished_;  // ids done but not returned by next() yet
+    int returned_;
+    bool stopReads_;
+    bool stopDecodes_;
+    
+    void io_thread();
+    void decode_thread(int id);
+    void read(Job &job);
+    void decode(Job &job);
+};
+
+//Collects text written from several threads at once. The decode threads report on std::cerr
+//through Model and TGAImage, so a caller that wants them quiet points std::cerr at one of
+//these before creating the loader and restores it after destroying it; a std::stringbuf
+//there would be written to without any locking.
+class LockedStringBuf : public std::streambuf
+{
+private:
+    std::mutex mutex_;
+    std::string text_;
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char *s, std::streamsize n) override;
+public:
+    std::string str();
+};
+
+#endif /* assetloader_h */
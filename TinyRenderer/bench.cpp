@@ -0,0 +1,1176 @@
+//
+//  bench.cpp
+//  TinyRenderer
+//
+//  Fixed warm-up and repeat counts, fixed seeds and fixed scenes so that two runs on the
+//  same machine can be compared. Every benchmark reports the median and p95 of its timed
+//  iterations; --json saves them and --baseline compares medians against a saved run.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "bench.h"
+#include "assetloader.h"
+#include "depthbuffer.h"
+#include "geometry.h"
+#include "imagediff.h"
+#include "lights.h"
+#include "model.h"
+#include "our_gl.h"
+#include "progressive.h"
+#include "renderer.h"
+#include "resample.h"
+#include "shaders.h"
+#include "tgaimage.h"
+#include "threadpool.h"
+#include "wireframe.h"
+
+namespace
+{
+const int kKernelWarmup = 3;
+const int kKernelRepeats = 21;
+const int kFrameWarmup = 2;
+const int kFrameRepeats = 11;
+const unsigned int kSeed = 12345;
+
+struct Result
+{
+    std::string name;
+    double median;
+    double p95;
+    double min;
+    int repeats;
+};
+
+//Model and TGAImage report to std::cerr, which would drown the table
+class QuietCerr
+{
+private:
+    std::streambuf *saved_;
+    LockedStringBuf sink_; // AssetLoader's threads write to it too
+public:
+    QuietCerr() : saved_(std::cerr.rdbuf()), sink_() { std::cerr.rdbuf(&sink_); }
+    ~QuietCerr() { std::cerr.rdbuf(saved_); }
+};
+
+class Suite
+{
+private:
+    std::string filter_;
+    std::vector<Result> results_;
+public:
+    Suite(const std::string &filter) : filter_(filter), results_() {}
+    
+    const std::vector<Result> &results() { return results_; }
+    
+    bool enabled(const std::string &name)
+    {
+        return filter_.empty() || name.find(filter_) != std::string::npos;
+    }
+    
+    //prepare runs before every iteration and is not timed
+    void run(const std::string &name, int warmup, int repeats, const std::function<void()> &fn,
+             const std::function<void()> &prepare = std::function<void()>())
+    {
+        if (!enabled(name)) return;
+        std::vector<double> times;
+        for (int i = 0; i < warmup+repeats; i++)
+        {
+            if (prepare) prepare();
+            auto start = std::chrono::steady_clock::now();
+            {
+                QuietCerr quiet;
+                fn();
+            }
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now()-start;
+            if (i >= warmup) times.push_back(elapsed.count());
+        }
+        std::sort(times.begin(), times.end());
+        const int n = (int)times.size();
+        Result r;
+        r.name = name;
+        r.median = n%2 ? times[n/2] : (times[n/2-1]+times[n/2])/2;
+        r.p95 = times[std::min(n-1, (int)std::ceil(.95*n)-1)];
+        r.min = times[0];
+        r.repeats = n;
+        results_.push_back(r);
+        printf("%-40s %10.3f %10.3f %10.3f\n", name.c_str(), r.median, r.p95, r.min);
+        fflush(stdout);
+    }
+};
+
+volatile float sink = 0.f;
+
+std::string find_models(const std::string &hint)
+{
+    std::vector<std::string> candidates;
+    if (!hint.empty()) candidates.push_back(hint);
+    candidates.push_back("Models");
+    candidates.push_back("TinyRenderer/Models");
+    for (const std::string &dir : candidates)
+    {
+        std::error_code ec;
+        if (std::filesystem::exists(dir+"/african_head/african_head.obj", ec)) return dir;
+    }
+    return "";
+}
+
+//Synthetic meshes are written as obj files so that they go through the same loader
+void write_sphere(const std::string &path, int rings, int segments)
+{
+    std::ofstream out(path);
+    for (int r = 0; r <= rings; r++)
+    {
+        const float theta = (float)M_PI*r/rings;
+        for (int s = 0; s <= segments; s++)
+        {
+            const float phi = 2.f*(float)M_PI*s/segments;
+            const float x = std::sin(theta)*std::cos(phi), y = std::cos(theta), z = std::sin(theta)*std::sin(phi);
+            out << "v " << x*.9f << " " << y*.9f << " " << z*.9f << "\n";
+            out << "vt " << (float)s/segments << " " << (float)r/rings << "\n";
+            out << "vn " << x << " " << y << " " << z << "\n";
+        }
+    }
+    for (int r = 0; r < rings; r++)
+    {
+        for (int s = 0; s < segments; s++)
+        {
+            const int a = r*(segments+1)+s+1, b = a+segments+1;
+            out << "f " << a << "/" << a << "/" << a << " " << b << "/" << b << "/" << b << " " << a+1 << "/" << a+1 << "/" << a+1 << "\n";
+            out << "f " << a+1 << "/" << a+1 << "/" << a+1 << " " << b << "/" << b << "/" << b << " " << b+1 << "/" << b+1 << "/" << b+1 << "\n";
+        }
+    }
+}
+
+//Long thin triangles fanning across the whole screen
+void write_slivers(const std::string &path, int count)
+{
+    std::ofstream out(path);
+    out << "vt 0 0\nvn 0 0 1\n";
+    for (int i = 0; i < count; i++)
+    {
+        const float a = 2.f*(float)M_PI*i/count, b = a+.002f;
+        out << "v 0 0 0\nv " << std::cos(a) << " " << std::sin(a) << " 0\nv " << std::cos(b) << " " << std::sin(b) << " 0\n";
+        out << "f " << i*3+1 << "/1/1 " << i*3+2 << "/1/1 " << i*3+3 << "/1/1\n";
+    }
+}
+
+//Full screen quads stacked back to front, every layer passes the depth test
+void write_layers(const std::string &path, int layers)
+{
+    std::ofstream out(path);
+    out << "vt 0 0\nvn 0 0 1\n";
+    for (int i = 0; i < layers; i++)
+    {
+        const float z = -1.f+2.f*(i+.5f)/layers;
+        out << "v -1 -1 " << z << "\nv 1 -1 " << z << "\nv 1 1 " << z << "\nv -1 1 " << z << "\n";
+        out << "f " << i*4+1 << "/1/1 " << i*4+2 << "/1/1 " << i*4+3 << "/1/1\n";
+        out << "f " << i*4+1 << "/1/1 " << i*4+3 << "/1/1 " << i*4+4 << "/1/1\n";
+    }
+}
+
+//Horizontal strips at depths from -1 to 1, each a quad with a second one gap nearer the
+//camera in front of it. Faces 4k and 4k+1 are the back quad, 4k+2 and 4k+3 the front one.
+//Every quad is scaled by its w under projection(coeff), so strips project to separate bands
+//and the two quads of a strip to the same pixels.
+void write_depth_pairs(const std::string &path, int strips, float gap, float coeff)
+{
+    std::ofstream out(path);
+    out.precision(9);
+    out << "vt 0 0\nvn 0 0 1\n";
+    for (int i = 0; i < strips; i++)
+    {
+        const float z = -1.f+2.f*i/(strips-1);
+        for (int k = 0; k < 2; k++)
+        {
+            const float zk = z+k*gap, w = 1.f+coeff*zk;
+            const float x = .9f*w, y0 = (-1.f+(2.f*i+.1f)/strips)*w, y1 = (-1.f+(2.f*i+1.9f)/strips)*w;
+            const int v = (i*2+k)*4;
+            out << "v " << -x << " " << y0 << " " << zk << "\nv " << x << " " << y0 << " " << zk << "\nv " << x << " " << y1 << " " << zk << "\nv " << -x << " " << y1 << " " << zk << "\n";
+            out << "f " << v+1 << "/1/1 " << v+2 << "/1/1 " << v+3 << "/1/1\n";
+            out << "f " << v+1 << "/1/1 " << v+3 << "/1/1 " << v+4 << "/1/1\n";
+        }
+    }
+}
+
+//Back quads black, front quads white
+struct PairShader : public IShader
+{
+    Model *model;
+    Matrix4f transform;
+    
+    PairShader(Model *m, const Matrix4f &t) : model(m), transform(t) {}
+    
+    virtual Vec4f vertex(int iface, int nthvert) const
+    {
+        return transform*embed<4>(model->vert(iface, nthvert));
+    }
+    
+    virtual bool fragment(int iface, Vec3f, TGAColor &color) const
+    {
+        color = (iface/2)&1 ? TGAColor(255, 255, 255, 255) : TGAColor(0, 0, 0, 255);
+        return false;
+    }
+};
+
+//Distance in world units from view space z to the first nearer z that stores differently,
+//through the same float math as the renderer: the perspective divide, then the format's encode
+template <class D>
+float depth_change(float z, float coeff, float scale, float offset)
+{
+    auto stored = [&](float zv) { return D::encode(zv/(1.f+coeff*zv), scale, offset); };
+    const typename D::Key key = stored(z);
+    float lo = 0.f, hi = 1e-9f;
+    while (hi < 1.f && stored(z+hi) == key)
+    {
+        lo = hi;
+        hi *= 2.f;
+    }
+    for (int i = 0; i < 40; i++)
+    {
+        const float mid = (lo+hi)*.5f;
+        if (stored(z+mid) == key) lo = mid;
+        else hi = mid;
+    }
+    return hi;
+}
+
+//Size of the depth step around z: the distance between the next two changes
+template <class D>
+float depth_step(float z, float coeff, float scale, float offset)
+{
+    const float edge = z+depth_change<D>(z, coeff, scale, offset);
+    return depth_change<D>(edge, coeff, scale, offset);
+}
+
+bool write_json(const char *fileName, const std::vector<Result> &results)
+{
+    std::ofstream out(fileName);
+    if (!out.is_open())
+    {
+        std::cerr << "can't open file " << fileName << "\n";
+        return false;
+    }
+    out << "{\n  \"threads\": " << ThreadPool::instance().size() << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result &r = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"name\": \"" << r.name << "\", \"median_ms\": " << r.median << ", \"p95_ms\": " << r.p95
+            << ", \"min_ms\": " << r.min << ", \"repeats\": " << r.repeats << "}";
+    }
+    out << "\n  ]\n}\n";
+    return out.good();
+}
+
+//Reads back the medians of a file written by write_json
+std::map<std::string, double> read_baseline(const char *fileName)
+{
+    std::map<std::string, double> medians;
+    std::ifstream in(fileName);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        size_t name = line.find("\"name\": \"");
+        size_t median = line.find("\"median_ms\": ");
+        if (name == std::string::npos || median == std::string::npos) continue;
+        name += 9;
+        medians[line.substr(name, line.find('"', name)-name)] = atof(line.c_str()+median+13);
+    }
+    return medians;
+}
+
+void bench_kernels(Suite &suite, const std::string &models)
+{
+    std::mt19937 rng(kSeed);
+    std::uniform_real_distribution<float> coord(0.f, 800.f);
+    
+    std::vector<Vec3f> points(3*4096);
+    for (Vec3f &p : points) p = Vec3f(coord(rng), coord(rng), coord(rng)/800.f);
+    suite.run("kernel/barycentric x1M", kKernelWarmup, kKernelRepeats, [&]()
+    {
+        float acc = 0.f;
+        for (int i = 0; i < 1000000; i++)
+        {
+            const int t = (i%4096)*3;
+            Vec3f bc = barycentric(points[t], points[(t+1)%points.size()], points[(t+2)%points.size()], points[(i*7)%points.size()]);
+            acc += bc.x;
+        }
+        sink = acc;
+    });
+    
+    TGAImage target(800, 800, TGAImage::RGB);
+    std::vector<float> zbuffer(800*800);
+    auto clearZ = [&]() { std::fill(zbuffer.begin(), zbuffer.end(), -std::numeric_limits<float>::max()); };
+    suite.run("kernel/triangle small x4096", kKernelWarmup, kKernelRepeats, [&]()
+    {
+        for (int i = 0; i < 4096; i++)
+        {
+            Vec3f pts[3];
+            for (int k = 0; k < 3; k++) pts[k] = Vec3f((int)points[i*3].x+(k==1 ? 12 : 0), (int)points[i*3].y+(k==2 ? 12 : 0), points[i*3+k].z);
+            triangle(pts, zbuffer.data(), target, TGAColor(255, 255, 255));
+        }
+    }, clearZ);
+    suite.run("kernel/triangle large x64", kKernelWarmup, kKernelRepeats, [&]()
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            Vec3f pts[3];
+            for (int k = 0; k < 3; k++) pts[k] = Vec3f((int)points[i*3+k].x, (int)points[i*3+k].y, points[i*3+k].z);
+            triangle(pts, zbuffer.data(), target, TGAColor(255, 255, 255));
+        }
+    }, clearZ);
+    suite.run("kernel/line x10k", kKernelWarmup, kKernelRepeats, [&]()
+    {
+        for (int i = 0; i < 10000; i++)
+        {
+            const Vec3f &a = points[(i*2)%points.size()], &b = points[(i*2+1)%points.size()];
+            line((int)a.x, (int)a.y, (int)b.x, (int)b.y, target, TGAColor(255, 0, 0));
+        }
+    });
+    suite.run("kernel/line offscreen x1k", kKernelWarmup, kKernelRepeats, [&]()
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            const Vec3f &a = points[(i*2)%points.size()];
+            line((int)a.x-20000, (int)a.y, (int)a.x+20000, (int)a.y+50, target, TGAColor(255, 0, 0));
+        }
+    });
+    
+    const std::string texture = models+"/african_head/african_head_diffuse.tga";
+    TGAImage image;
+    {
+        QuietCerr quiet;
+        image.read_tga_file(texture.c_str());
+    }
+    suite.run("tga/read rle 1024x1024", kKernelWarmup, kKernelRepeats, [&]()
+    {
+        TGAImage read;
+        read.read_tga_file(texture.c_str());
+    });
+    const std::string tmp = (std::filesystem::temp_directory_path()/"tinyrenderer_bench.tga").string();
+    suite.run("tga/write raw 1024x1024", kKernelWarmup, kKernelRepeats, [&]()
+    {
+        image.write_tga_file(tmp.c_str(), false);
+    });
+    suite.run("tga/write rle 1024x1024", kKernelWarmup, kKernelRepeats, [&]()
+    {
+        image.write_tga_file(tmp.c_str(), true);
+    });
+    std::remove(tmp.c_str());
+    TGAImage work;
+    auto copy = [&]() { work = image; };
+    suite.run("tga/scale 1024->512", kKernelWarmup, kKernelRepeats, [&]() { work.scale(512, 512); }, copy);
+    suite.run("tga/scale 1024->1600", kKernelWarmup, kKernelRepeats, [&]() { work.scale(1600, 1600); }, copy);
+    Resampler resampler;
+    TGAImage half(512, 512, image.get_bytespp()), large(1600, 1600, image.get_bytespp());
+    const Resampler::Filter filters[] = {Resampler::BOX, Resampler::BILINEAR, Resampler::LANCZOS3};
+    const char *filterNames[] = {"box", "bilinear", "lanczos3"};
+    for (int f = 0; f < 3; f++)
+    {
+        resampler.set_filter(filters[f]);
+        suite.run(std::string("resample/")+filterNames[f]+" 1024->512", kKernelWarmup, kKernelRepeats, [&]() { resampler.resample(image, half); });
+        suite.run(std::string("resample/")+filterNames[f]+" 1024->1600", kKernelWarmup, kKernelRepeats, [&]() { resampler.resample(image, large); });
+    }
+    std::vector<TGAImage> mips;
+    resampler.set_filter(Resampler::BOX);
+    suite.run("resample/mip chain 1024", kKernelWarmup, kKernelRepeats, [&]() { resampler.mip_chain(image, mips); });
+    suite.run("tga/flip vertically", kKernelWarmup, kKernelRepeats, [&]() { work.flip_vertically(); }, copy);
+    suite.run("tga/flip horizontally", kKernelWarmup, kKernelRepeats, [&]() { work.flip_horizontally(); }, copy);
+    
+    Matrix4f a = lookat(Vec3f(1, 1, 3), Vec3f(0, 0, 0), Vec3f(0, 1, 0));
+    Matrix4f b = projection(-1.f/3.f)*viewport(0, 0, 800, 800);
+    suite.run("matrix/mul x100k", kKernelWarmup, kKernelRepeats, [&]()
+    {
+        float acc = 0.f;
+        for (int i = 0; i < 100000; i++)
+        {
+            Matrix4f m = (i&1 ? a : b);
+            m[0][3] += i*1e-4f;
+            acc += (a*m)[0][3];
+        }
+        sink = acc;
+    });
+    suite.run("matrix/invert x10k", kKernelWarmup, kKernelRepeats, [&]()
+    {
+        float acc = 0.f;
+        for (int i = 0; i < 10000; i++)
+        {
+            Matrix4f m = (i&1 ? a : b);
+            m[0][3] += i*1e-4f;
+            acc += m.invert()[0][0];
+        }
+        sink = acc;
+    });
+    suite.run("matrix/transform x1M", kKernelWarmup, kKernelRepeats, [&]()
+    {
+        Matrix4f m = b*a;
+        float acc = 0.f;
+        for (int i = 0; i < 1000000; i++) acc += (m*embed<4>(points[i%points.size()]))[0];
+        sink = acc;
+    });
+}
+
+void bench_loads(Suite &suite, const std::vector<std::pair<std::string, std::vector<std::string>>> &scenes)
+{
+    for (const auto &scene : scenes)
+    {
+        suite.run("load/"+scene.first, kKernelWarmup, kKernelRepeats, [&]()
+        {
+            for (const std::string &file : scene.second) delete new Model(file.c_str());
+        });
+        suite.run("load/"+scene.first+"/async", kKernelWarmup, kKernelRepeats, [&]()
+        {
+            AssetLoader loader;
+            for (const std::string &file : scene.second) loader.load(file.c_str());
+            for (int id = loader.next(); id >= 0; id = loader.next()) delete loader.take(id);
+        });
+    }
+}
+
+void bench_frames(Suite &suite, const std::vector<std::pair<std::string, std::vector<std::string>>> &scenes, bool lit)
+{
+    const int resolutions[] = {256, 800, 1600};
+    for (const auto &scene : scenes)
+    {
+        bool any = false;
+        for (int res : resolutions) any = any || suite.enabled("frame/"+scene.first+"/"+std::to_string(res));
+        if (!any) continue;
+        std::vector<Model*> models;
+        std::vector<IShader*> shaders;
+        {
+            QuietCerr quiet;
+            for (const std::string &file : scene.second) models.push_back(new Model(file.c_str()));
+        }
+        Matrix4f transform = projection(-1.f/std::sqrt(11.f))*lookat(Vec3f(1, 1, 3), Vec3f(0, 0, 0), Vec3f(0, 1, 0));
+        for (Model *model : models)
+        {
+            if (lit)
+            {
+                shaders.push_back(new LitShader(model, transform, Vec3f(1, 1, 1), nullptr));
+                continue;
+            }
+            shaders.push_back(new FlatShader(model));
+        }
+        for (int res : resolutions)
+        {
+            Renderer renderer(res, res);
+            TGAImage image(res, res, TGAImage::RGB);
+            suite.run("frame/"+scene.first+"/"+std::to_string(res), kFrameWarmup, kFrameRepeats, [&]()
+            {
+                renderer.clear();
+                for (size_t m = 0; m < models.size(); m++) renderer.draw(*models[m], *shaders[m]);
+                renderer.resolve(image);
+            });
+        }
+        for (IShader *shader : shaders) delete shader;
+        for (Model *model : models) delete model;
+    }
+}
+
+//Loading and drawing the same 800x800 frame from the meshes as the obj lists them and after
+//-O, with the cache miss ratio of both face orders. -O writes its .trmesh next to the obj as
+//the command line does, so its loads after the first read the cache.
+void bench_optimize(Suite &suite, const std::vector<std::pair<std::string, std::vector<std::string>>> &scenes, bool lit)
+{
+    const char *variants[] = {"raw", "-O"};
+    for (const auto &scene : scenes)
+    {
+        const std::string prefix = "optimize/"+scene.first+"/";
+        bool any = false;
+        for (const char *variant : variants) any = any || suite.enabled(prefix+variant) || suite.enabled(prefix+"load "+variant);
+        if (!any) continue;
+        Matrix4f transform = projection(-1.f/std::sqrt(11.f))*lookat(Vec3f(1, 1, 3), Vec3f(0, 0, 0), Vec3f(0, 1, 0));
+        Renderer renderer(800, 800);
+        TGAImage image(800, 800, TGAImage::RGB);
+        for (int optimize = 0; optimize < 2; optimize++)
+        {
+            suite.run(prefix+"load "+variants[optimize], kKernelWarmup, kKernelRepeats, [&]()
+            {
+                for (const std::string &file : scene.second) delete new Model(file.c_str(), optimize != 0);
+            });
+            std::vector<Model*> models;
+            std::vector<IShader*> shaders;
+            {
+                QuietCerr quiet;
+                for (const std::string &file : scene.second) models.push_back(new Model(file.c_str(), optimize != 0));
+            }
+            for (Model *model : models)
+            {
+                if (lit) shaders.push_back(new LitShader(model, transform, Vec3f(1, 1, 1), nullptr));
+                else shaders.push_back(new FlatShader(model));
+            }
+            suite.run(prefix+variants[optimize], kFrameWarmup, kFrameRepeats, [&]()
+            {
+                renderer.clear();
+                for (size_t m = 0; m < models.size(); m++) renderer.draw(*models[m], *shaders[m]);
+                renderer.resolve(image);
+            });
+            if (suite.enabled(prefix+variants[optimize]))
+            {
+                printf("    acmr");
+                for (Model *model : models) printf(" %.3f", model->acmr());
+                printf("\n");
+            }
+            for (IShader *shader : shaders) delete shader;
+            for (Model *model : models) delete model;
+        }
+    }
+}
+
+const DepthBuffer::Format kDepthFormats[] = {DepthBuffer::FLOAT32, DepthBuffer::D24S8, DepthBuffer::D16, DepthBuffer::FLOAT32_REVERSED};
+
+//Every depth format on the same lit frames. Besides the time, prints the size of the buffer
+//and how much of it the frame touched: a tile is filled once when first rasterized and
+//stays in cache while its triangles are drawn, so the touched bytes are what goes to
+//memory (an eager clear would write the whole buffer first). The image is compared with
+//the fp32 one to show what the format changes.
+void bench_depth(Suite &suite, const std::vector<std::pair<std::string, std::vector<std::string>>> &scenes)
+{
+    const int res = 1600;
+    const Vec3f eye(1, 1, 3), center(0, 0, 0);
+    const float coeff = -1.f/(eye-center).norm();
+    const Vec2f range = depth_range(coeff, std::sqrt(3.f));
+    for (const auto &scene : scenes)
+    {
+        std::vector<std::string> names[2];
+        bool any = false;
+        for (int msaa = 0; msaa < 2; msaa++)
+        {
+            for (DepthBuffer::Format format : kDepthFormats)
+            {
+                names[msaa].push_back("depth/"+scene.first+"/"+DepthBuffer::format_name(format)+(msaa ? " msaa4" : ""));
+                any = any || suite.enabled(names[msaa].back());
+            }
+        }
+        if (!any) continue;
+        std::vector<Model*> models;
+        std::vector<IShader*> shaders;
+        {
+            QuietCerr quiet;
+            for (const std::string &file : scene.second) models.push_back(new Model(file.c_str()));
+        }
+        Matrix4f transform = projection(coeff)*lookat(eye, center, Vec3f(0, 1, 0));
+        for (Model *model : models) shaders.push_back(new LitShader(model, transform, Vec3f(1, 1, 1), nullptr));
+        for (int msaa = 0; msaa < 2; msaa++)
+        {
+            const int samples = msaa ? 4 : 1;
+            TGAImage reference(res, res, TGAImage::RGB);
+            for (int f = 0; f < 4; f++)
+            {
+                const DepthBuffer::Format format = kDepthFormats[f];
+                const std::string &name = names[msaa][f];
+                //fp32 always renders, it is the reference of the others
+                if (!suite.enabled(name) && format != DepthBuffer::FLOAT32) continue;
+                Renderer renderer(res, res, samples, format);
+                renderer.set_depth_range(range.x, range.y);
+                TGAImage image(res, res, TGAImage::RGB);
+                auto frame = [&]()
+                {
+                    renderer.clear();
+                    for (size_t m = 0; m < models.size(); m++) renderer.draw(*models[m], *shaders[m]);
+                    renderer.resolve(image);
+                };
+                suite.run(name, kFrameWarmup, kFrameRepeats, frame);
+                frame();
+                if (format == DepthBuffer::FLOAT32) reference = image;
+                if (!suite.enabled(name)) continue;
+                const unsigned long touched = renderer.depth_bytes_touched();
+                const unsigned long bytes = renderer.depth_buffer().bytes();
+                ImageDiff diff = {0, 0, 0};
+                diff_images(reference, image, .1f, diff);
+                printf("    %lu KiB, %lu KiB touched per frame, %d pixels differ from fp32 (max delta %d)\n",
+                       bytes/1024, touched/1024, diff.differing, diff.maxDelta);
+            }
+        }
+        for (IShader *shader : shaders) delete shader;
+        for (Model *model : models) delete model;
+    }
+}
+
+//Per face colors at a fixed opacity
+struct TintShader : public FlatShader
+{
+    TintShader(Model *m) : FlatShader(m) {}
+    
+    virtual bool fragment(int iface, Vec3f, TGAColor &color) const
+    {
+        color = colors[iface];
+        color.bgra[3] = 77;
+        return false;
+    }
+};
+
+//Transparency at depth complexities of 4, 16 and 64 full screen layers at 256x256, drawn
+//front to back so that submission order helps nothing. "kbuf exact" keeps every layer and
+//is the reference of the others; "kbuf k8" keeps the 8 nearest. Pixels on the diagonal of a
+//layer are covered by both of its triangles, hence the exact mode's room for two per layer.
+void bench_transparency(Suite &suite, const std::filesystem::path &tmp)
+{
+    const int res = 256;
+    const int depths[] = {4, 16, 64};
+    const char *modes[] = {"wb", "kbuf k8", "kbuf exact"};
+    for (int layers : depths)
+    {
+        const std::string prefix = "oit/layers "+std::to_string(layers)+"/";
+        bool any = false;
+        for (const char *mode : modes) any = any || suite.enabled(prefix+mode);
+        if (!any) continue;
+        const std::string path = (tmp/"tinyrenderer_oit.obj").string();
+        write_layers(path, layers);
+        Model *model;
+        {
+            QuietCerr quiet;
+            model = new Model(path.c_str());
+        }
+        std::remove(path.c_str());
+        //Flipping z puts the last (nearest) layer first
+        struct FrontToBack : public TintShader
+        {
+            FrontToBack(Model *m) : TintShader(m) {}
+            virtual Vec4f vertex(int iface, int nthvert) const
+            {
+                const int n = model->nFaces(), layer = (n-1-iface)/2;
+                Vec3f v = model->vert(layer*2+iface%2, nthvert);
+                return embed<4>(v);
+            }
+            virtual bool fragment(int iface, Vec3f bar, TGAColor &color) const
+            {
+                return TintShader::fragment((model->nFaces()-1-iface)/2*2+iface%2, bar, color);
+            }
+        } shader(model);
+        TGAImage reference(res, res, TGAImage::RGB);
+        for (int m = 2; m >= 0; m--)
+        {
+            const std::string name = prefix+modes[m];
+            if (m < 2 && !suite.enabled(name)) continue;
+            Renderer renderer(res, res);
+            if (m == 0) renderer.set_transparency(Renderer::WEIGHTED_BLENDED);
+            else renderer.set_transparency(Renderer::K_BUFFER, m == 1 ? 8 : 2*layers, m == 1 ? kTileSize*kTileSize*8 : kTileSize*(kTileSize+2)*layers);
+            TGAImage image(res, res, TGAImage::RGB);
+            auto frame = [&]()
+            {
+                renderer.clear(TGAColor(128, 128, 128, 255));
+                renderer.draw_transparent(*model, shader);
+                renderer.resolve(image);
+            };
+            suite.run(name, kKernelWarmup, kKernelRepeats, frame);
+            frame();
+            if (m == 2) reference = image;
+            if (!suite.enabled(name)) continue;
+            ImageDiff diff = {0, 0, 0};
+            diff_images(reference, image, .1f, diff);
+            printf("    %lu KiB, %lld fragments dropped, %d pixels differ from exact (max delta %d)\n",
+                   renderer.transparency_bytes()/1024, renderer.dropped_fragments(), diff.differing, diff.maxDelta);
+        }
+        delete model;
+    }
+}
+
+//Only the eyes of african_head move, alternating between two places every frame. The
+//incremental frame re-renders the tiles the eyes cover now or covered before and keeps the
+//rest; it is compared with a full render of the same frame after timing.
+void bench_incremental(Suite &suite, const std::string &models)
+{
+    const int res = 800;
+    const std::string names[3] = {"incremental/african_head_eyes/full", "incremental/african_head_eyes/eyes moved",
+                                   "incremental/african_head_eyes/static"};
+    if (!suite.enabled(names[0]) && !suite.enabled(names[1]) && !suite.enabled(names[2])) return;
+    std::vector<Model*> scene;
+    {
+        QuietCerr quiet;
+        for (const char *file : {"/african_head/african_head.obj", "/african_head/african_head_eye_inner.obj", "/african_head/african_head_eye_outer.obj"})
+        {
+            scene.push_back(new Model((models+file).c_str()));
+        }
+    }
+    const Vec3f eye(1, 1, 3), center(0, 0, 0);
+    const float coeff = -1.f/(eye-center).norm();
+    const Matrix4f transform = projection(coeff)*lookat(eye, center, Vec3f(0, 1, 0));
+    Matrix4f aside = Matrix4f::identity();
+    aside[0][3] = .05f;
+    //shaders[k][m] draws model m in frame parity k, the head never moves
+    std::vector<IShader*> shaders[2];
+    for (int k = 0; k < 2; k++)
+    {
+        for (size_t m = 0; m < scene.size(); m++) shaders[k].push_back(new LitShader(scene[m], m && k ? transform*aside : transform, Vec3f(1, 1, 1), nullptr));
+    }
+    const Vec2f range = depth_range(coeff, std::sqrt(3.f));
+    Renderer full(res, res), incremental(res, res);
+    full.set_depth_range(range.x, range.y);
+    incremental.set_depth_range(range.x, range.y);
+    TGAImage image(res, res, TGAImage::RGB), reference(res, res, TGAImage::RGB);
+    int parity = 0;
+    auto fullFrame = [&]()
+    {
+        full.clear();
+        for (size_t m = 0; m < scene.size(); m++) full.draw(*scene[m], *shaders[parity][m]);
+        full.resolve(reference);
+    };
+    auto incrementalFrame = [&](bool moved)
+    {
+        incremental.begin_frame();
+        for (size_t m = 0; m < scene.size(); m++) incremental.draw(*scene[m], *shaders[parity][m], moved && m > 0);
+        incremental.end_frame();
+        incremental.resolve(image);
+    };
+    suite.run(names[0], kFrameWarmup, kFrameRepeats, fullFrame, [&]() { parity ^= 1; });
+    incrementalFrame(true);
+    suite.run(names[1], kFrameWarmup, kFrameRepeats, [&]() { incrementalFrame(true); }, [&]() { parity ^= 1; });
+    suite.run(names[2], kFrameWarmup, kFrameRepeats, [&]() { incrementalFrame(false); });
+    for (int moved = 1; moved >= 0; moved--)
+    {
+        if (!suite.enabled(names[2-moved])) continue;
+        parity ^= moved;
+        incrementalFrame(moved);
+        fullFrame();
+        const bool identical = !memcmp(image.buffer(), reference.buffer(), (size_t)res*res*image.get_bytespp());
+        printf("    %d of %d tiles reused, %s\n", incremental.reused_tiles(), incremental.reused_tiles()+incremental.rendered_tiles(),
+               identical ? "identical to the full frame" : "DIFFERS from the full frame");
+    }
+    for (int k = 0; k < 2; k++) for (IShader *shader : shaders[k]) delete shader;
+    for (Model *model : scene) delete model;
+}
+
+//The head and eyes lit by 1 to 1024 point and spot lights at 800. tiled is the whole frame:
+//depth prepass, culling and the color pass over the prepass; cull is the culling alone.
+//every light is a single pass evaluating every light per fragment (fewer repeats past 64,
+//it gets slow).
+void bench_lights(Suite &suite, const std::string &models)
+{
+    const int res = 800;
+    const int counts[] = {1, 4, 16, 64, 256, 1024};
+    bool any = false;
+    for (int n : counts) any = any || suite.enabled("lights/"+std::to_string(n)+"/");
+    if (!any) return;
+    std::vector<Model*> scene;
+    {
+        QuietCerr quiet;
+        for (const char *file : {"/african_head/african_head.obj", "/african_head/african_head_eye_inner.obj", "/african_head/african_head_eye_outer.obj"})
+        {
+            scene.push_back(new Model((models+file).c_str()));
+        }
+    }
+    const Vec3f eye(1, 1, 3), center(0, 0, 0);
+    const float coeff = -1.f/(eye-center).norm();
+    const Matrix4f view = lookat(eye, center, Vec3f(0, 1, 0));
+    const Matrix4f transform = projection(coeff)*view;
+    const Vec2f range = depth_range(coeff, std::sqrt(3.f));
+    Renderer renderer(res, res);
+    renderer.set_depth_range(range.x, range.y);
+    LightGrid grid(res, res);
+    TGAImage image(res, res, TGAImage::RGB);
+    for (int n : counts)
+    {
+        const std::string prefix = "lights/"+std::to_string(n)+"/";
+        if (!suite.enabled(prefix)) continue;
+        const std::vector<Light> lights = scatter_lights(n, center, std::sqrt(3.f));
+        std::vector<IShader*> tiled, every;
+        for (Model *model : scene)
+        {
+            tiled.push_back(new LightsShader(model, transform, &lights, &grid));
+            every.push_back(new LightsShader(model, transform, &lights, nullptr));
+        }
+        auto prepass = [&]()
+        {
+            renderer.clear();
+            renderer.set_color_write(false);
+            renderer.set_depth_test(Renderer::DEPTH_GREATER);
+            for (size_t m = 0; m < scene.size(); m++) renderer.draw(*scene[m], *tiled[m]);
+        };
+        suite.run(prefix+"tiled", kFrameWarmup, kFrameRepeats, [&]()
+        {
+            prepass();
+            grid.cull(lights, view, coeff, renderer.depth_buffer());
+            renderer.set_color_write(true);
+            renderer.set_depth_test(Renderer::DEPTH_GREATER_EQUAL);
+            for (size_t m = 0; m < scene.size(); m++) renderer.draw(*scene[m], *tiled[m]);
+            renderer.resolve(image);
+        });
+        suite.run(prefix+"cull", kKernelWarmup, kKernelRepeats, [&]()
+        {
+            grid.cull(lights, view, coeff, renderer.depth_buffer());
+        }, [&]() { prepass(); });
+        if (suite.enabled(prefix+"cull"))
+        {
+            const int tiles = ((res+kTileSize-1)/kTileSize)*((res+kTileSize-1)/kTileSize);
+            printf("    %.1f lights per tile on average, %d at most\n", (double)grid.total_entries()/tiles, grid.max_entries());
+        }
+        renderer.set_color_write(true);
+        renderer.set_depth_test(Renderer::DEPTH_GREATER);
+        suite.run(prefix+"every light", n > 64 ? 0 : kFrameWarmup, n > 64 ? 3 : kFrameRepeats, [&]()
+        {
+            renderer.clear();
+            for (size_t m = 0; m < scene.size(); m++) renderer.draw(*scene[m], *every[m]);
+            renderer.resolve(image);
+        });
+        for (IShader *shader : tiled) delete shader;
+        for (IShader *shader : every) delete shader;
+    }
+    for (Model *model : scene) delete model;
+}
+
+//The head lit at 3840x2160, drawn into an 8 bit and an HDR framebuffer. raster is clear and
+//draw; resolve is the 8 bit resolve or the HDR one with each tone curve.
+void bench_hdr(Suite &suite, const std::string &models)
+{
+    const int w = 3840, h = 2160;
+    const std::string prefix = "hdr/"+std::to_string(w)+"x"+std::to_string(h)+"/";
+    if (!suite.enabled(prefix)) return;
+    Model *model;
+    {
+        QuietCerr quiet;
+        model = new Model((models+"/african_head/african_head.obj").c_str());
+    }
+    const float coeff = -1.f/std::sqrt(11.f);
+    const Matrix4f transform = projection(coeff)*lookat(Vec3f(1, 1, 3), Vec3f(0, 0, 0), Vec3f(0, 1, 0));
+    const Vec2f range = depth_range(coeff, std::sqrt(3.f));
+    LitShader shader(model, transform, Vec3f(1, 1, 1), nullptr);
+    TGAImage image(w, h, TGAImage::RGB);
+    for (int hdr = 0; hdr < 2; hdr++)
+    {
+        Renderer renderer(w, h);
+        renderer.set_depth_range(range.x, range.y);
+        renderer.set_hdr(hdr);
+        const std::string mode = hdr ? "hdr" : "8 bit";
+        suite.run(prefix+"raster "+mode, kFrameWarmup, kFrameRepeats, [&]()
+        {
+            renderer.clear();
+            renderer.draw(*model, shader);
+        });
+        if (!hdr)
+        {
+            suite.run(prefix+"resolve 8 bit", kKernelWarmup, kKernelRepeats, [&]() { renderer.resolve(image); });
+            continue;
+        }
+        for (ToneCurve curve : {TONE_CLAMP, TONE_REINHARD, TONE_ACES})
+        {
+            renderer.tone_mapper().set_curve(curve);
+            suite.run(prefix+"resolve "+ToneMapper::curve_name(curve), kKernelWarmup, kKernelRepeats, [&]() { renderer.resolve(image); });
+        }
+    }
+    delete model;
+}
+
+//diablo3_pose lit at 800x800 as a plain frame, as the coarse pass of a progressive frame alone
+//(budget 0), then progressive under a few budgets with either tile order. Budgeted frames
+//run kBudgetRepeats times so the p99 printed under them, taken over every frame, means
+//something; refined is the share of tiles that got their full resolution pixels.
+void bench_progressive(Suite &suite, const std::string &models)
+{
+    const int res = 800;
+    const int kBudgetRepeats = 100;
+    const std::string prefix = "progressive/diablo3_pose/";
+    const double budgets[] = {10., 20., 40.};
+    const ProgressiveRenderer::Order orders[] = {ProgressiveRenderer::CENTER_FIRST, ProgressiveRenderer::GEOMETRY_FIRST};
+    auto budgetName = [&](double budget, ProgressiveRenderer::Order order)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "%g ms %s", budget, ProgressiveRenderer::order_name(order));
+        return prefix+name;
+    };
+    bool any = suite.enabled(prefix+"full frame") || suite.enabled(prefix+"coarse");
+    for (double budget : budgets) for (ProgressiveRenderer::Order order : orders) any = any || suite.enabled(budgetName(budget, order));
+    if (!any) return;
+    std::vector<Model*> scene;
+    {
+        QuietCerr quiet;
+        scene.push_back(new Model((models+"/diablo3_pose/diablo3_pose.obj").c_str()));
+    }
+    const float coeff = -1.f/std::sqrt(11.f);
+    const Matrix4f transform = projection(coeff)*lookat(Vec3f(1, 1, 3), Vec3f(0, 0, 0), Vec3f(0, 1, 0));
+    const Vec2f range = depth_range(coeff, std::sqrt(3.f));
+    std::vector<IShader*> shaders = {new LitShader(scene[0], transform, Vec3f(1, 1, 1), nullptr)};
+    Renderer renderer(res, res);
+    ProgressiveRenderer progressive(res, res);
+    for (Renderer *r : {&renderer, &progressive.renderer(), &progressive.coarse_renderer()}) r->set_depth_range(range.x, range.y);
+    TGAImage image(res, res, TGAImage::RGB);
+    suite.run(prefix+"full frame", kFrameWarmup, kFrameRepeats, [&]()
+    {
+        renderer.clear();
+        renderer.draw(*scene[0], *shaders[0]);
+        renderer.resolve(image);
+    });
+    suite.run(prefix+"coarse", kFrameWarmup, kFrameRepeats, [&]() { progressive.render(scene, shaders, 0., image); });
+    for (double budget : budgets)
+    {
+        for (ProgressiveRenderer::Order order : orders)
+        {
+            const std::string name = budgetName(budget, order);
+            if (!suite.enabled(name)) continue;
+            progressive.set_order(order);
+            std::vector<double> frames;
+            long long refined = 0, tiles = 0;
+            suite.run(name, kFrameWarmup, kBudgetRepeats, [&]()
+            {
+                const ProgressiveRenderer::Stats stats = progressive.render(scene, shaders, budget, image);
+                frames.push_back(stats.totalMs);
+                refined += stats.refined;
+                tiles += stats.tiles;
+            });
+            std::sort(frames.begin(), frames.end());
+            const double p99 = frames[std::min(frames.size()-1, (size_t)std::ceil(.99*frames.size())-1)];
+            printf("    %.1f%% of the tiles refined, p99 %.2f ms: %.0f%% of the budget\n", 100.*refined/tiles, p99, 100.*p99/budget);
+        }
+    }
+    for (IShader *shader : shaders) delete shader;
+    for (Model *model : scene) delete model;
+}
+
+//Every bundled mesh raw and compressed: the bytes of both forms, the measured quantization
+//errors next to their bounds, then the time to fetch the position, uv and normal of every
+//face corner through Model, which is what the shaders do
+void bench_meshes(Suite &suite, const std::vector<std::pair<std::string, std::string>> &meshes)
+{
+    for (const auto &mesh : meshes)
+    {
+        const std::string names[2] = {"mesh/"+mesh.first+"/decode raw", "mesh/"+mesh.first+"/decode packed"};
+        if (!suite.enabled(names[0]) && !suite.enabled(names[1])) continue;
+        Model *models[2];
+        {
+            QuietCerr quiet;
+            models[0] = new Model(mesh.second.c_str());
+            models[1] = new Model(mesh.second.c_str());
+            models[1]->compress();
+        }
+        for (int k = 0; k < 2; k++)
+        {
+            Model &model = *models[k];
+            suite.run(names[k], kKernelWarmup, kKernelRepeats, [&]()
+            {
+                float sum = 0.f;
+                for (int f = 0; f < model.nFaces(); f++)
+                {
+                    for (int i = 0; i < 3; i++) sum += model.vert(f, i).x+model.uv(f, i).x+model.normal(f, i).x;
+                }
+                sink = sum;
+            });
+        }
+        const PackedMesh *packed = models[1]->packed();
+        if (suite.enabled(names[1]) && packed)
+        {
+            const PackedMesh::Error error = packed->error(), bound = packed->error_bound();
+            printf("    %d faces, %.1f KiB -> %.1f KiB (%.2fx)\n", models[0]->nFaces(), models[0]->mesh_bytes()/1024., packed->bytes()/1024.,
+                   (double)models[0]->mesh_bytes()/packed->bytes());
+            printf("    max error: position %.2e (bound %.2e), uv %.2e (bound %.2e), normal %.4f deg (bound %.4f)\n",
+                   error.position, bound.position, error.uv, bound.uv, error.normal, bound.normal);
+        }
+        delete models[0];
+        delete models[1];
+    }
+}
+
+const char *kWireModes[] = {"plain", "depth", "aa", "depth aa"};
+
+//The edge overlay alone over a rendered lit frame at 1600: the frame is resolved once and
+//copied back before every timed draw. The depth tested modes read the frame's depth buffer.
+void bench_wire(Suite &suite, const std::vector<std::pair<std::string, std::vector<std::string>>> &scenes)
+{
+    const int res = 1600;
+    for (const auto &scene : scenes)
+    {
+        bool any = false;
+        for (const char *mode : kWireModes) any = any || suite.enabled("wire/"+scene.first+"/"+mode);
+        if (!any) continue;
+        std::vector<Model*> models;
+        std::vector<IShader*> shaders;
+        {
+            QuietCerr quiet;
+            for (const std::string &file : scene.second) models.push_back(new Model(file.c_str()));
+        }
+        Matrix4f transform = projection(-1.f/std::sqrt(11.f))*lookat(Vec3f(1, 1, 3), Vec3f(0, 0, 0), Vec3f(0, 1, 0));
+        for (Model *model : models) shaders.push_back(new LitShader(model, transform, Vec3f(1, 1, 1), nullptr));
+        Renderer renderer(res, res);
+        TGAImage frame(res, res, TGAImage::RGB);
+        renderer.clear();
+        for (size_t m = 0; m < models.size(); m++) renderer.draw(*models[m], *shaders[m]);
+        renderer.resolve(frame);
+        const DepthBuffer &depth = renderer.depth_buffer();
+        TGAImage image(res, res, TGAImage::RGB);
+        Wireframe wire(res, res);
+        for (int flags = 0; flags < 4; flags++)
+        {
+            const std::string name = "wire/"+scene.first+"/"+kWireModes[flags];
+            wire.set_flags(flags);
+            suite.run(name, kKernelWarmup, kKernelRepeats, [&]()
+            {
+                for (size_t m = 0; m < models.size(); m++) wire.draw(*models[m], *shaders[m], image, &depth);
+            }, [&]() { image = frame; });
+            if (suite.enabled(name)) printf("    %d segments\n", wire.drawn_segments());
+        }
+        for (IShader *shader : shaders) delete shader;
+        for (Model *model : models) delete model;
+    }
+}
+
+//Precision of every format with the bench camera: the depth step at the far and near end of
+//the scene, and the share of pixels where a quad loses to the one just behind it for
+//gaps from 1e-3 down to 1e-7 (the scene is 2 units deep)
+void bench_depth_precision(Suite &suite, const std::filesystem::path &tmp)
+{
+    if (!suite.enabled("depth/precision")) return;
+    const int res = 512, strips = 16;
+    const float gaps[] = {1e-3f, 1e-4f, 1e-5f, 1e-6f, 1e-7f};
+    const Vec3f eye(0, 0, 3), center(0, 0, 0);
+    const float coeff = -1.f/(eye-center).norm();
+    const Vec2f range = depth_range(coeff, std::sqrt(3.f));
+    const Matrix4f transform = projection(coeff)*lookat(eye, center, Vec3f(0, 1, 0));
+    const std::string path = (tmp/"tinyrenderer_depth_pairs.obj").string();
+    std::vector<Model*> models;
+    {
+        QuietCerr quiet;
+        for (float gap : gaps)
+        {
+            write_depth_pairs(path, strips, gap, coeff);
+            models.push_back(new Model(path.c_str()));
+        }
+    }
+    std::remove(path.c_str());
+    printf("depth/precision %11s %11s %9s %9s %9s %9s %9s\n", "step far", "step near", "1e-3", "1e-4", "1e-5", "1e-6", "1e-7");
+    for (DepthBuffer::Format format : kDepthFormats)
+    {
+        Renderer renderer(res, res, 1, format);
+        renderer.set_depth_range(range.x, range.y);
+        const float scale = renderer.depth_buffer().get_scale(), offset = renderer.depth_buffer().get_offset();
+        float steps[2] = {0.f, 0.f};
+        for (int end = 0; end < 2; end++)
+        {
+            const float z = end ? 1.f : -1.f;
+            switch (format)
+            {
+                case DepthBuffer::FLOAT32: steps[end] = depth_step<Float32Depth>(z, coeff, scale, offset); break;
+                case DepthBuffer::D24S8: steps[end] = depth_step<Unorm24Depth>(z, coeff, scale, offset); break;
+                case DepthBuffer::D16: steps[end] = depth_step<Unorm16Depth>(z, coeff, scale, offset); break;
+                case DepthBuffer::FLOAT32_REVERSED: steps[end] = depth_step<ReversedDepth>(z, coeff, scale, offset); break;
+            }
+        }
+        printf("  %-13s %11.3g %11.3g", DepthBuffer::format_name(format), steps[0], steps[1]);
+        TGAImage image(res, res, TGAImage::RGB);
+        for (Model *model : models)
+        {
+            PairShader shader(model, transform);
+            renderer.clear(TGAColor(0, 0, 255, 255));
+            renderer.draw(*model, shader);
+            renderer.resolve(image);
+            long wrong = 0, covered = 0;
+            for (int i = 0; i < res*res; i++)
+            {
+                const unsigned char *p = image.buffer()+i*3;
+                if (p[0] == 255 && p[1] == 0 && p[2] == 0) continue; // background, blue in BGR order
+                covered++;
+                wrong += p[0] == 0;
+            }
+            printf(" %8.2f%%", covered ? 100.*wrong/covered : 0.);
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+    for (Model *model : models) delete model;
+}
+}
+
+//Usage: TinyRenderer --bench [--models dir] [--filter substring] [--json out.json] [--baseline old.json] [--threshold percent]
+int run_benchmarks(int argc, const char *argv[])
+{
+    std::string modelsHint, filter;
+    const char *json = nullptr;
+    const char *baseline = nullptr;
+    double threshold = 10.;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--models") && i+1 < argc) modelsHint = argv[++i];
+        else if (!strcmp(argv[i], "--filter") && i+1 < argc) filter = argv[++i];
+        else if (!strcmp(argv[i], "--json") && i+1 < argc) json = argv[++i];
+        else if (!strcmp(argv[i], "--baseline") && i+1 < argc) baseline = argv[++i];
+        else if (!strcmp(argv[i], "--threshold") && i+1 < argc) threshold = atof(argv[++i]);
+    }
+    const std::string models = find_models(modelsHint);
+    if (models.empty())
+    {
+        std::cerr << "can't find the Models directory, pass it with --models\n";
+        return 2;
+    }
+    
+    const std::filesystem::path tmp = std::filesystem::temp_directory_path();
+    const std::string sphere = (tmp/"tinyrenderer_sphere.obj").string();
+    const std::string slivers = (tmp/"tinyrenderer_slivers.obj").string();
+    const std::string layers = (tmp/"tinyrenderer_layers.obj").string();
+    write_sphere(sphere, 256, 512);
+    write_slivers(slivers, 500);
+    write_layers(layers, 32);
+    
+    std::vector<std::pair<std::string, std::vector<std::string>>> scenes = {
+        {"african_head", {models+"/african_head/african_head.obj"}},
+        {"boggie", {models+"/boggie/body.obj", models+"/boggie/head.obj", models+"/boggie/eyes.obj"}},
+        {"diablo3_pose", {models+"/diablo3_pose/diablo3_pose.obj"}},
+    };
+    const std::vector<std::pair<std::string, std::string>> meshes = {
+        {"african_head", models+"/african_head/african_head.obj"},
+        {"african_head_eye_inner", models+"/african_head/african_head_eye_inner.obj"},
+        {"african_head_eye_outer", models+"/african_head/african_head_eye_outer.obj"},
+        {"boggie_body", models+"/boggie/body.obj"},
+        {"boggie_head", models+"/boggie/head.obj"},
+        {"boggie_eyes", models+"/boggie/eyes.obj"},
+        {"diablo3_pose", models+"/diablo3_pose/diablo3_pose.obj"},
+        {"floor", models+"/floor.obj"},
+        {"stress_sphere_262k", sphere},
+    };
+    std::vector<std::pair<std::string, std::vector<std::string>>> stress = {
+        {"stress_sphere_262k", {sphere}},
+        {"stress_slivers", {slivers}},
+        {"stress_layers", {layers}},
+    };
+    
+    printf("threads: %d\n%-40s %10s %10s %10s\n", ThreadPool::instance().size(), "benchmark", "median ms", "p95 ms", "min ms");
+    Suite suite(filter);
+    bench_kernels(suite, models);
+    bench_loads(suite, scenes);
+    bench_frames(suite, scenes, true);
+    bench_frames(suite, stress, false);
+    bench_optimize(suite, scenes, true);
+    bench_optimize(suite, {stress[0]}, false);
+    bench_depth(suite, scenes);
+    bench_depth_precision(suite, tmp);
+    bench_incremental(suite, models);
+    bench_transparency(suite, tmp);
+    bench_lights(suite, models);
+    bench_hdr(suite, models);
+    bench_progressive(suite, models);
+    bench_wire(suite, scenes);
+    bench_wire(suite, stress);
+    bench_meshes(suite, meshes);
+    std::remove(sphere.c_str());
+    std::remove(slivers.c_str());
+    std::remove(layers.c_str());
+    
+    if (json) write_json(json, suite.results());
+    int status = 0;
+    if (baseline)
+    {
+        std::map<std::string, double> old = read_baseline(baseline);
+        for (const Result &r : suite.results())
+        {
+            auto it = old.find(r.name);
+            if (it == old.end() || it->second <= 0.) continue;
+            const double change = (r.median/it->second-1.)*100.;
+            if (change > threshold)
+            {
+                printf("REGRESSION %-40s %+.1f%% (%.3f -> %.3f ms)\n", r.name.c_str(), change, it->second, r.median);
+                status = 1;
+            }
+        }
+        if (!status) printf("no regression above %.1f%% against %s\n", threshold, baseline);
+    }
+    return status;
+}
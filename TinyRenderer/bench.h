@@ -0,0 +1,13 @@
+//
+//  bench.h
+//  TinyRenderer
+//
+
+#ifndef bench_h
+#define bench_h
+
+//Entry point of `TinyRenderer --bench`, argv[0] is "--bench". Returns the process exit code,
+//non zero when a benchmark regressed against --baseline.
+int run_benchmarks(int argc, const char *argv[]);
+
+#endif /* bench_h */
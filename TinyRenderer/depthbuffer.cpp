@@ -0,0 +1,169 @@
+//
+//  depthbuffer.cpp
+//  TinyRenderer
+//
+
+#include <cstring>
+#include "depthbuffer.h"
+#include "threadpool.h"
+
+namespace
+{
+const char *kFormatNames[] = {"fp32", "d24s8", "d16", "rfp32"};
+}
+
+DepthBuffer::DepthBuffer(int width, int height, int samples, int tileSize, Format format)
+: width_(width), height_(height), samples_(samples), tileSize_(tileSize), tilesX_((width+tileSize-1)/tileSize), tilesY_((height+tileSize-1)/tileSize),
+  format_(format), far_(-1.f), near_(1.f), scale_(1.f), offset_(0.f), stencil_(0), storage_(), pending_()
+{
+    set_range(-1.f, 1.f);
+    storage_.resize(((size_t)width_*height_*samples_*bytes_per_sample()+3)/4);
+    pending_.resize(tilesX_*tilesY_);
+    clear();
+}
+
+DepthBuffer::Format DepthBuffer::get_format() const
+{
+    return format_;
+}
+
+int DepthBuffer::get_samples() const
+{
+    return samples_;
+}
+
+int DepthBuffer::bytes_per_sample() const
+{
+    return format_ == D16 ? 2 : 4;
+}
+
+size_t DepthBuffer::bytes() const
+{
+    return (size_t)width_*height_*samples_*bytes_per_sample();
+}
+
+void DepthBuffer::set_range(float zFar, float zNear)
+{
+    far_ = zFar;
+    near_ = zNear;
+    //The unorm formats start at 1 and have 2^bits-2 steps above it, see the encode() of their traits
+    const float steps = format_ == D24S8 ? 16777214.f : (format_ == D16 ? 65534.f : 1.f);
+    const float base = format_ == D24S8 || format_ == D16 ? 1.f : 0.f;
+    scale_ = steps/(zNear-zFar);
+    offset_ = base-zFar*scale_;
+}
+
+float DepthBuffer::get_far() const
+{
+    return far_;
+}
+
+float DepthBuffer::get_near() const
+{
+    return near_;
+}
+
+float DepthBuffer::get_scale() const
+{
+    return scale_;
+}
+
+float DepthBuffer::get_offset() const
+{
+    return offset_;
+}
+
+void DepthBuffer::clear(uint8_t stencil)
+{
+    stencil_ = stencil;
+    std::fill(pending_.begin(), pending_.end(), 1);
+}
+
+void DepthBuffer::clear_tile(int tile)
+{
+    pending_[tile] = 1;
+}
+
+size_t DepthBuffer::tile_bytes(int tile) const
+{
+    const int x0 = (tile%tilesX_)*tileSize_, y0 = (tile/tilesX_)*tileSize_;
+    return (size_t)(std::min(x0+tileSize_, width_)-x0)*(std::min(y0+tileSize_, height_)-y0)*samples_*bytes_per_sample();
+}
+
+template <class D>
+void DepthBuffer::fill_tile(int tile)
+{
+    const int x0 = (tile%tilesX_)*tileSize_, y0 = (tile/tilesX_)*tileSize_;
+    const int x1 = std::min(x0+tileSize_, width_), y1 = std::min(y0+tileSize_, height_);
+    const typename D::Value value = D::clear_value(stencil_);
+    typename D::Value *depth = data<typename D::Value>();
+    for (int y = y0; y < y1; y++)
+    {
+        std::fill_n(depth+((size_t)x0+(size_t)y*width_)*samples_, (size_t)(x1-x0)*samples_, value);
+    }
+}
+
+void DepthBuffer::prepare_tile(int tile)
+{
+    if (!pending_[tile]) return;
+    pending_[tile] = 0;
+    switch (format_)
+    {
+        case FLOAT32: fill_tile<Float32Depth>(tile); break;
+        case D24S8: fill_tile<Unorm24Depth>(tile); break;
+        case D16: fill_tile<Unorm16Depth>(tile); break;
+        case FLOAT32_REVERSED: fill_tile<ReversedDepth>(tile); break;
+    }
+}
+
+void DepthBuffer::flush()
+{
+    ThreadPool::instance().parallel_for(tilesY_, [&](int ty, int)
+    {
+        for (int tile = ty*tilesX_; tile < (ty+1)*tilesX_; tile++) prepare_tile(tile);
+    });
+}
+
+size_t DepthBuffer::touched_bytes() const
+{
+    size_t bytes = 0;
+    for (int tile = 0; tile < tilesX_*tilesY_; tile++)
+    {
+        if (!pending_[tile]) bytes += tile_bytes(tile);
+    }
+    return bytes;
+}
+
+float DepthBuffer::get(size_t i) const
+{
+    float v = 0.f;
+    switch (format_)
+    {
+        case FLOAT32: return data<float>()[i];
+        case FLOAT32_REVERSED: v = data<float>()[i]; break;
+        case D24S8: v = (float)(data<uint32_t>()[i] >> 8); break;
+        case D16: v = (float)data<uint16_t>()[i]; break;
+    }
+    return v == 0.f ? -std::numeric_limits<float>::max() : (v-offset_)/scale_;
+}
+
+uint8_t DepthBuffer::get_stencil(size_t i) const
+{
+    return format_ == D24S8 ? (uint8_t)(data<uint32_t>()[i] & 0xffu) : 0;
+}
+
+const char *DepthBuffer::format_name(Format format)
+{
+    return kFormatNames[format];
+}
+
+bool DepthBuffer::parse_format(const char *name, Format &format)
+{
+    for (int f = 0; f < 4; f++)
+    {
+        if (strcmp(name, kFormatNames[f])) continue;
+        format = (Format)f;
+        return true;
+    }
+    return false;
+}
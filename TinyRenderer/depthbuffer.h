@@ -0,0 +1,152 @@
+//
+//  depthbuffer.h
+//  TinyRenderer
+//
+//  Per sample depth in one of several storage formats. In every format larger values are
+//  nearer, like the renderer's z, and the samples of a pixel are consecutive.
+//  The compact formats store z mapped from a depth range [far, near] to [0, 1] (or to the
+//  unorm steps), so the caller has to set a range that holds the scene; z outside of it is
+//  clamped. 0 is kept for cleared samples and geometry encodes to at least the next value
+//  up, so the far plane itself is never clipped.
+//  clear() only marks the tiles. A tile's memory is filled when the renderer first
+//  touches it, or by flush() before the buffer is read as a whole, so tiles that nothing
+//  covers are never written.
+//
+
+#ifndef depthbuffer_h
+#define depthbuffer_h
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+//Storage type and encoding of each format. The renderer's inner loop is instantiated once
+//per format: key() of a stored value compares against encode() of a new z like z does, and
+//store() writes an encoded z over a stored value. scale and offset come from the buffer and
+//already include the format's resolution, so encoding is one multiply-add, a clamp and a
+//conversion.
+struct Float32Depth
+{
+    typedef float Value;
+    typedef float Key;
+    static Value clear_value(uint8_t) { return -std::numeric_limits<float>::max(); }
+    static Key encode(float z, float, float) { return z; }
+    static Key key(Value v) { return v; }
+    static Value store(Value, Key z) { return z; }
+};
+
+//The far plane is at 0, where floats are densest; perspective z piles up toward the far
+//plane, so the two roughly cancel out
+struct ReversedDepth
+{
+    typedef float Value;
+    typedef float Key;
+    static Value clear_value(uint8_t) { return 0.f; }
+    static Key encode(float z, float scale, float offset)
+    {
+        return std::max(std::min(z*scale+offset, 1.f), std::numeric_limits<float>::min());
+    }
+    static Key key(Value v) { return v; }
+    static Value store(Value, Key z) { return z; }
+};
+
+//Depth in the upper 24 bits, stencil in the lower 8 which depth writes leave alone
+struct Unorm24Depth
+{
+    typedef uint32_t Value;
+    typedef uint32_t Key;
+    static Value clear_value(uint8_t stencil) { return stencil; }
+    static Key encode(float z, float scale, float offset)
+    {
+        return (uint32_t)(int)std::max(std::min(z*scale+offset, 16777215.f), 1.f);
+    }
+    static Key key(Value v) { return v >> 8; }
+    static Value store(Value v, Key z) { return (z << 8) | (v & 0xffu); }
+};
+
+struct Unorm16Depth
+{
+    typedef uint16_t Value;
+    typedef uint32_t Key;
+    static Value clear_value(uint8_t) { return 0; }
+    static Key encode(float z, float scale, float offset)
+    {
+        return (uint32_t)(int)std::max(std::min(z*scale+offset, 65535.f), 1.f);
+    }
+    static Key key(Value v) { return v; }
+    static Value store(Value, Key z) { return (Value)z; }
+};
+
+class DepthBuffer
+{
+public:
+    enum Format { FLOAT32, D24S8, D16, FLOAT32_REVERSED };
+    
+    DepthBuffer(int width, int height, int samples, int tileSize, Format format = FLOAT32);
+    
+    Format get_format() const;
+    int get_samples() const;
+    int bytes_per_sample() const;
+    size_t bytes() const;
+    //Range of z stored by the compact formats, FLOAT32 stores z as is. Set it before the frame's draws.
+    void set_range(float zFar, float zNear);
+    float get_far() const;
+    float get_near() const;
+    //Factors of encode(): z*scale+offset is the stored value before clamping and truncation,
+    //[0, 1] over the range for rfp32 and [1, 2^bits-1] for the unorm formats
+    float get_scale() const;
+    float get_offset() const;
+    
+    //Marks every tile as cleared, in O(tiles). D24S8 clears its stencil bits to stencil.
+    void clear(uint8_t stencil = 0);
+    //Marks one tile as cleared, to the stencil of the last clear()
+    void clear_tile(int tile);
+    //Fills the tile if it is still marked, called before the tile is rasterized
+    void prepare_tile(int tile);
+    //Fills every tile still marked, on the thread pool
+    void flush();
+    //Bytes of the tiles filled since the last clear(); the rest of the buffer wasn't touched
+    size_t touched_bytes() const;
+    
+    //Sample i decoded to z, -FLT_MAX where nothing was drawn. Only valid once the sample's tile was prepared or flushed.
+    float get(size_t i) const;
+    uint8_t get_stencil(size_t i) const;
+    //Samples as the format's Value type
+    template <class T>
+    T *data()
+    {
+        return reinterpret_cast<T *>(storage_.data());
+    }
+    template <class T>
+    const T *data() const
+    {
+        return reinterpret_cast<const T *>(storage_.data());
+    }
+    
+    static const char *format_name(Format format);
+    //fp32, d24s8, d16 or rfp32
+    static bool parse_format(const char *name, Format &format);
+private:
+    int width_;
+    int height_;
+    int samples_;
+    int tileSize_;
+    int tilesX_;
+    int tilesY_;
+    Format format_;
+    float far_;
+    float near_;
+    float scale_;
+    float offset_;
+    uint8_t stencil_;
+    std::vector<uint32_t> storage_;
+    std::vector<char> pending_;
+    
+    template <class D>
+    void fill_tile(int tile);
+    size_t tile_bytes(int tile) const;
+};
+
+#endif /* depthbuffer_h */
@@ -104,7 +104,7 @@ T operator*(const Vec<vectorSize, T> &lhs, const Vec<vectorSize, T> &rhs)
 
 // Addition operator
 template<size_t vectorSize, typename T>
-T operator+(const Vec<vectorSize, T> &lhs, const Vec<vectorSize, T> &rhs)
+Vec<vectorSize, T> operator+(Vec<vectorSize, T> lhs, const Vec<vectorSize, T> &rhs)
 {
     for(size_t i = vectorSize; i--; lhs[i]+=rhs[i]);
     return lhs;
@@ -112,7 +112,7 @@ T operator+(const Vec<vectorSize, T> &lhs, const Vec<vectorSize, T> &rhs)
 
 // Subtraction operator
 template<size_t vectorSize, typename T>
-T operator-(const Vec<vectorSize, T> &lhs, const Vec<vectorSize, T> &rhs)
+Vec<vectorSize, T> operator-(Vec<vectorSize, T> lhs, const Vec<vectorSize, T> &rhs)
 {
     for(size_t i = vectorSize; i--; lhs[i]-=rhs[i]);
     return lhs;
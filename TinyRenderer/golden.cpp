@@ -0,0 +1,336 @@
+//
+//  golden.cpp
+//  TinyRenderer
+//
+//  Renders a fixed set of scenes and compares them with the reference images in Golden/.
+//  A scene passes when it is bit identical, or when it only differs below the perceptual
+//  tolerance (compilers and platforms are free to round floating point differently).
+//  Failing scenes leave the rendered image and a diff image in the output directory.
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "golden.h"
+#include "assetloader.h"
+#include "imagediff.h"
+#include "model.h"
+#include "our_gl.h"
+#include "postprocess.h"
+#include "progressive.h"
+#include "renderer.h"
+#include "shaders.h"
+#include "shadow.h"
+#include "tgaimage.h"
+#include "wireframe.h"
+
+namespace
+{
+const int kSize = 256;
+
+struct Scene
+{
+    const char *name;
+    std::vector<const char*> files; //relative to the Models directory
+    Vec3f eye;
+    bool lit;
+    int samples;
+    int shadowSize;
+    int ssaoScale;
+    DepthBuffer::Format depth;
+    int wireFlags; //edge overlay with these Wireframe flags, -1 for none
+    //Lit only. Also rendered as the second of two incremental frames, after one with every
+    //model but the first moved aside, which has to be bit identical to the full render
+    bool incremental;
+    int oit; //Renderer::Transparency the last model is drawn as glass with, -1 for all opaque
+    bool compressed; //models drawn from their PackedMesh form
+    //Point and spot lights from scatter_lights in place of the directional light, 0 for none.
+    //Culled per tile, which has to match shading with every light bit for bit.
+    int lights;
+    //Models from an AssetLoader, drawn in the order they finish loading
+    bool async;
+    //ToneCurve of an HDR framebuffer at exposure 1, -1 for 8 bit color
+    int tone;
+    //The image is the coarse pass of a progressive frame with a budget of 0. The progressive
+    //frame without a deadline has to match the full render bit for bit.
+    bool progressive;
+};
+
+const Scene kScenes[] = {
+    {"african_head_flat", {"african_head/african_head.obj"}, Vec3f(1, 1, 3), false, 1, 0, 0, DepthBuffer::FLOAT32, -1, false, -1, false, 0, false, -1, false},
+    {"african_head_lit", {"african_head/african_head.obj"}, Vec3f(1, 1, 3), true, 1, 0, 0, DepthBuffer::FLOAT32, -1, false, -1, false, 0, false, -1, false},
+    {"african_head_msaa4", {"african_head/african_head.obj"}, Vec3f(-1, .5f, 3), true, 4, 0, 0, DepthBuffer::FLOAT32, -1, false, -1, false, 0, false, -1, false},
+    {"african_head_ssao", {"african_head/african_head.obj"}, Vec3f(1, 1, 3), true, 1, 0, 2, DepthBuffer::FLOAT32, -1, false, -1, false, 0, false, -1, false},
+    {"boggie_lit", {"boggie/body.obj", "boggie/head.obj", "boggie/eyes.obj"}, Vec3f(0, 0, 3), true, 1, 0, 0, DepthBuffer::FLOAT32, -1, false, -1, false, 0, false, -1, false},
+    {"diablo3_pose_flat", {"diablo3_pose/diablo3_pose.obj"}, Vec3f(1, 1, 3), false, 1, 0, 0, DepthBuffer::FLOAT32, -1, false, -1, false, 0, false, -1, false},
+    {"diablo3_pose_shadow", {"diablo3_pose/diablo3_pose.obj", "floor.obj"}, Vec3f(1, 1, 3), true, 8, 512, 0, DepthBuffer::FLOAT32, -1, false, -1, false, 0, false, -1, false},
+    {"boggie_lit_d16", {"boggie/body.obj", "boggie/head.obj", "boggie/eyes.obj"}, Vec3f(0, 0, 3), true, 1, 0, 0, DepthBuffer::D16, -1, false, -1, false, 0, false, -1, false},
+    {"african_head_ssao_rfp32", {"african_head/african_head.obj"}, Vec3f(1, 1, 3), true, 1, 0, 2, DepthBuffer::FLOAT32_REVERSED, -1, false, -1, false, 0, false, -1, false},
+    {"diablo3_pose_wire", {"diablo3_pose/diablo3_pose.obj"}, Vec3f(1, 1, 3), true, 4, 0, 0, DepthBuffer::FLOAT32, Wireframe::DEPTH_TEST | Wireframe::ANTIALIAS, false, -1, false, 0, false, -1, false},
+    {"african_head_eyes_incremental", {"african_head/african_head.obj", "african_head/african_head_eye_inner.obj", "african_head/african_head_eye_outer.obj"},
+        Vec3f(1, 1, 3), true, 4, 0, 0, DepthBuffer::FLOAT32, -1, true, -1, false, 0, false, -1, false},
+    {"african_head_glass_wb", {"african_head/african_head.obj", "african_head/african_head_eye_inner.obj", "african_head/african_head_eye_outer.obj"},
+        Vec3f(1, 1, 3), true, 1, 0, 0, DepthBuffer::FLOAT32, -1, false, Renderer::WEIGHTED_BLENDED, false, 0, false, -1, false},
+    {"african_head_glass_kbuf", {"african_head/african_head.obj", "african_head/african_head_eye_inner.obj", "african_head/african_head_eye_outer.obj"},
+        Vec3f(-1, .5f, 3), true, 4, 0, 0, DepthBuffer::FLOAT32, -1, false, Renderer::K_BUFFER, false, 0, false, -1, false},
+    {"diablo3_pose_compressed", {"diablo3_pose/diablo3_pose.obj", "floor.obj"}, Vec3f(1, 1, 3), true, 4, 512, 0, DepthBuffer::FLOAT32, -1, false, -1, true, 0, false, -1, false},
+    {"african_head_lights_256", {"african_head/african_head.obj", "african_head/african_head_eye_inner.obj", "african_head/african_head_eye_outer.obj"},
+        Vec3f(1, 1, 3), true, 1, 0, 0, DepthBuffer::FLOAT32, -1, false, -1, false, 256, false, -1, false},
+    {"african_head_lights_msaa4", {"african_head/african_head.obj", "african_head/african_head_eye_inner.obj", "african_head/african_head_eye_outer.obj"},
+        Vec3f(-1, .5f, 3), true, 4, 0, 0, DepthBuffer::FLOAT32, -1, false, -1, false, 256, false, -1, false},
+    {"boggie_lit_async", {"boggie/body.obj", "boggie/head.obj", "boggie/eyes.obj"}, Vec3f(0, 0, 3), true, 1, 0, 0, DepthBuffer::FLOAT32, -1, false, -1, false, 0, true, -1, false},
+    {"african_head_lights_aces", {"african_head/african_head.obj", "african_head/african_head_eye_inner.obj", "african_head/african_head_eye_outer.obj"},
+        Vec3f(1, 1, 3), true, 1, 0, 0, DepthBuffer::FLOAT32, -1, false, -1, false, 256, false, TONE_ACES, false},
+    {"diablo3_pose_hdr_msaa4", {"diablo3_pose/diablo3_pose.obj", "floor.obj"}, Vec3f(1, 1, 3), true, 4, 512, 0, DepthBuffer::FLOAT32, -1, false, -1, false, 0, false, TONE_REINHARD, false},
+    {"diablo3_pose_progressive_coarse", {"diablo3_pose/diablo3_pose.obj", "floor.obj"}, Vec3f(1, 1, 3), true, 4, 512, 0, DepthBuffer::FLOAT32, -1, false, -1, false, 0, false, -1, true},
+};
+
+std::string find_dir(const std::string &hint, const char *name, const char *probe)
+{
+    std::vector<std::string> candidates;
+    if (!hint.empty()) candidates.push_back(hint);
+    candidates.push_back(name);
+    candidates.push_back(std::string("TinyRenderer/")+name);
+    for (const std::string &dir : candidates)
+    {
+        std::error_code ec;
+        if (std::filesystem::exists(dir+"/"+probe, ec)) return dir;
+    }
+    return hint.empty() ? std::string(name) : hint;
+}
+
+//Depth prepass, light culling, then the color pass over the prepass
+void draw_lights(Renderer &renderer, std::vector<Model*> &models, std::vector<IShader*> &shaders, LightGrid *grid,
+                 const std::vector<Light> &lights, const Matrix4f &view, float coeff)
+{
+    renderer.clear();
+    renderer.set_color_write(false);
+    renderer.set_depth_test(Renderer::DEPTH_GREATER);
+    for (size_t m = 0; m < models.size(); m++) renderer.draw(*models[m], *shaders[m]);
+    if (grid) grid->cull(lights, view, coeff, renderer.depth_buffer());
+    renderer.set_color_write(true);
+    renderer.set_depth_test(Renderer::DEPTH_GREATER_EQUAL);
+    for (size_t m = 0; m < models.size(); m++) renderer.draw(*models[m], *shaders[m]);
+}
+
+//Returns false when the incremental, light culled or progressive frame of the scene differs from its full render
+bool render(const Scene &scene, std::vector<Model*> &models, TGAImage &image)
+{
+    const Vec3f center(0, 0, 0), up(0, 1, 0), light(1, 1, 1);
+    const float coeff = -1.f/(scene.eye-center).norm();
+    const Matrix4f view = lookat(scene.eye, center, up);
+    Matrix4f transform = scene.lit ? projection(coeff)*view : Matrix4f::identity();
+    const std::vector<Light> lights = scatter_lights(scene.lights, center, std::sqrt(3.f));
+    LightGrid grid(kSize, kSize);
+    ShadowMap *shadow = scene.shadowSize > 0 ? new ShadowMap(scene.shadowSize) : nullptr;
+    if (shadow) shadow->render(models, light, center, std::sqrt(3.f));
+    std::vector<IShader*> shaders;
+    for (Model *model : models)
+    {
+        if (scene.lights > 0) shaders.push_back(new LightsShader(model, transform, &lights, &grid));
+        else if (scene.oit >= 0 && model == models.back()) shaders.push_back(new GlassShader(model, transform, light, shadow, .4f));
+        else if (scene.lit) shaders.push_back(new LitShader(model, transform, light, shadow));
+        else shaders.push_back(new FlatShader(model));
+    }
+    Renderer renderer(kSize, kSize, scene.samples, scene.depth);
+    const Vec2f range = scene.lit ? depth_range(coeff, std::sqrt(3.f)) : Vec2f(-1.f, 1.f);
+    renderer.set_depth_range(range.x, range.y);
+    renderer.set_hdr(scene.tone >= 0);
+    if (scene.tone >= 0) renderer.tone_mapper().set_curve((ToneCurve)scene.tone);
+    if (scene.oit >= 0) renderer.set_transparency((Renderer::Transparency)scene.oit);
+    if (scene.lights > 0) draw_lights(renderer, models, shaders, &grid, lights, view, coeff);
+    else
+    {
+        renderer.clear();
+        for (size_t m = 0; m < models.size(); m++)
+        {
+            if (scene.oit >= 0 && m+1 == models.size()) renderer.draw_transparent(*models[m], *shaders[m]);
+            else renderer.draw(*models[m], *shaders[m]);
+        }
+    }
+    renderer.resolve(image);
+    bool identical = true;
+    if (scene.lights > 0)
+    {
+        std::vector<IShader*> everyLight;
+        for (Model *model : models) everyLight.push_back(new LightsShader(model, transform, &lights, nullptr));
+        Renderer reference(kSize, kSize, scene.samples, scene.depth);
+        reference.set_depth_range(range.x, range.y);
+        reference.set_hdr(scene.tone >= 0);
+        reference.tone_mapper().set_curve(renderer.tone_mapper().get_curve());
+        draw_lights(reference, models, everyLight, nullptr, lights, view, coeff);
+        TGAImage all(kSize, kSize, TGAImage::RGB);
+        reference.resolve(all);
+        identical = identical && !memcmp(all.buffer(), image.buffer(), (size_t)kSize*kSize*image.get_bytespp());
+        for (IShader *shader : everyLight) delete shader;
+    }
+    if (scene.incremental)
+    {
+        Matrix4f aside = Matrix4f::identity();
+        aside[0][3] = .3f;
+        std::vector<IShader*> moved;
+        for (Model *model : models) moved.push_back(new LitShader(model, transform*aside, light, shadow));
+        Renderer incremental(kSize, kSize, scene.samples, scene.depth);
+        incremental.set_depth_range(range.x, range.y);
+        incremental.set_hdr(scene.tone >= 0);
+        incremental.tone_mapper().set_curve(renderer.tone_mapper().get_curve());
+        for (int frame = 0; frame < 2; frame++)
+        {
+            incremental.begin_frame();
+            incremental.draw(*models[0], *shaders[0], false);
+            for (size_t m = 1; m < models.size(); m++) incremental.draw(*models[m], frame ? *shaders[m] : *moved[m], true);
+            incremental.end_frame();
+        }
+        TGAImage second(kSize, kSize, TGAImage::RGB);
+        incremental.resolve(second);
+        identical = identical && !memcmp(second.buffer(), image.buffer(), (size_t)kSize*kSize*image.get_bytespp()) && incremental.reused_tiles() > 0;
+        for (IShader *shader : moved) delete shader;
+    }
+    if (scene.progressive)
+    {
+        ProgressiveRenderer progressive(kSize, kSize, scene.samples, 4, scene.depth);
+        for (Renderer *r : {&progressive.renderer(), &progressive.coarse_renderer()}) r->set_depth_range(range.x, range.y);
+        TGAImage all(kSize, kSize, TGAImage::RGB);
+        progressive.render(models, shaders, -1., all);
+        identical = identical && !memcmp(all.buffer(), image.buffer(), (size_t)kSize*kSize*image.get_bytespp());
+        progressive.render(models, shaders, 0., image);
+    }
+    if (scene.ssaoScale > 0)
+    {
+        AmbientOcclusion ssao(kSize, kSize, scene.ssaoScale == 2);
+        ssao.apply(renderer.depth_buffer(), renderer.get_samples(), kSize/2.f, image);
+    }
+    if (scene.wireFlags >= 0)
+    {
+        Wireframe wire(kSize, kSize);
+        wire.set_flags(scene.wireFlags);
+        for (size_t m = 0; m < models.size(); m++) wire.draw(*models[m], *shaders[m], image, &renderer.depth_buffer());
+    }
+    for (IShader *shader : shaders) delete shader;
+    delete shadow;
+    return identical;
+}
+}
+
+//Usage: TinyRenderer --golden [--models dir] [--refs dir] [--out dir] [--filter substring] [--tolerance t] [--max-pixels n] [--update]
+//  --update     overwrite the references with the current output instead of comparing
+//  --tolerance  perceptual color tolerance, see diff_images (.1 by default)
+//  --max-pixels perceptible pixels a scene may have and still pass (0 by default)
+int run_golden(int argc, const char *argv[])
+{
+    std::string modelsHint, refsHint, filter;
+    std::string out = "golden_out";
+    float tolerance = .1f;
+    int maxPixels = 0;
+    bool update = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--models") && i+1 < argc) modelsHint = argv[++i];
+        else if (!strcmp(argv[i], "--refs") && i+1 < argc) refsHint = argv[++i];
+        else if (!strcmp(argv[i], "--out") && i+1 < argc) out = argv[++i];
+        else if (!strcmp(argv[i], "--filter") && i+1 < argc) filter = argv[++i];
+        else if (!strcmp(argv[i], "--tolerance") && i+1 < argc) tolerance = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--max-pixels") && i+1 < argc) maxPixels = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--update")) update = true;
+    }
+    const std::string models = find_dir(modelsHint, "Models", "african_head/african_head.obj");
+    const std::string refs = find_dir(refsHint, "Golden", "african_head_flat.tga");
+    
+    std::map<std::string, Model*> loaded;
+    std::vector<Model*> asyncModels;
+    int failures = 0;
+    for (const Scene &scene : kScenes)
+    {
+        if (!filter.empty() && std::string(scene.name).find(filter) == std::string::npos) continue;
+        std::vector<Model*> sceneModels;
+        if (scene.async)
+        {
+            //the decode threads write to std::cerr at the same time
+            LockedStringBuf sink;
+            std::streambuf *saved = std::cerr.rdbuf(&sink);
+            {
+                AssetLoader loader;
+                for (const char *file : scene.files) loader.load((models+"/"+file).c_str());
+                for (int id = loader.next(); id >= 0; id = loader.next()) sceneModels.push_back(loader.take(id));
+            }
+            std::cerr.rdbuf(saved);
+            asyncModels.insert(asyncModels.end(), sceneModels.begin(), sceneModels.end());
+        }
+        for (const char *file : scene.files)
+        {
+            if (scene.async) break;
+            Model *&model = loaded[std::string(file)+(scene.compressed ? "#compressed" : "")];
+            if (!model)
+            {
+                //the loader chats on std::cerr, keep the report readable
+                std::ostringstream sink;
+                std::streambuf *saved = std::cerr.rdbuf(sink.rdbuf());
+                model = new Model((models+"/"+file).c_str());
+                if (scene.compressed) model->compress();
+                std::cerr.rdbuf(saved);
+            }
+            sceneModels.push_back(model);
+        }
+        TGAImage image(kSize, kSize, TGAImage::RGB);
+        if (!render(scene, sceneModels, image))
+        {
+            failures++;
+            printf("%-8s %s (the incremental, light culled or progressive frame differs from a full render)\n", "FAIL", scene.name);
+            continue;
+        }
+        
+        const std::string reference = refs+"/"+scene.name+".tga";
+        if (update)
+        {
+            std::filesystem::create_directories(refs);
+            bool ok = image.write_tga_file(reference.c_str());
+            printf("%-8s %s\n", ok ? "UPDATED" : "ERROR", reference.c_str());
+            failures += !ok;
+            continue;
+        }
+        TGAImage expected;
+        ImageDiff diff = {0, 0, 0};
+        TGAImage diffImage;
+        bool compared = false;
+        {
+            std::ostringstream sink;
+            std::streambuf *saved = std::cerr.rdbuf(sink.rdbuf());
+            compared = expected.read_tga_file(reference.c_str(), image.get_origin());
+            std::cerr.rdbuf(saved);
+        }
+        compared = compared && diff_images(expected, image, tolerance, diff, &diffImage);
+        if (compared && diff.differing == 0)
+        {
+            printf("%-8s %s\n", "EXACT", scene.name);
+            continue;
+        }
+        if (compared && diff.perceptible <= maxPixels)
+        {
+            printf("%-8s %s (%d pixels differ, max channel delta %d)\n", "CLOSE", scene.name, diff.differing, diff.maxDelta);
+            continue;
+        }
+        failures++;
+        std::filesystem::create_directories(out);
+        const std::string actualPath = out+"/"+scene.name+".tga";
+        image.write_tga_file(actualPath.c_str());
+        if (!compared)
+        {
+            printf("%-8s %s (no usable reference %s, output in %s)\n", "FAIL", scene.name, reference.c_str(), actualPath.c_str());
+            continue;
+        }
+        const std::string diffPath = out+"/"+scene.name+"_diff.tga";
+        diffImage.write_tga_file(diffPath.c_str());
+        printf("%-8s %s (%d pixels differ, %d perceptibly, max channel delta %d, see %s)\n", "FAIL", scene.name,
+               diff.differing, diff.perceptible, diff.maxDelta, diffPath.c_str());
+    }
+    for (auto &entry : loaded) delete entry.second;
+    for (Model *model : asyncModels) delete model;
+    if (!update) printf("%d failure%s\n", failures, failures == 1 ? "" : "s");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,13 @@
+//
+//  golden.h
+//  TinyRenderer
+//
+
+#ifndef golden_h
+#define golden_h
+
+//Entry point of `TinyRenderer --golden`, argv[0] is "--golden". Returns the process exit code,
+//non zero when a scene doesn't match its reference image.
+int run_golden(int argc, const char *argv[]);
+
+#endif /* golden_h */
@@ -0,0 +1,96 @@
+//
+//  imagediff.cpp
+//  TinyRenderer
+//
+//  The perceptual check measures color differences in YIQ, which weighs luma above chroma
+//  the way the eye does, and forgives anti-aliased or rasterized edges that moved by a pixel:
+//  a pixel only counts when neither image has a close enough color in the other's 3x3
+//  neighbourhood.
+//
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include "imagediff.h"
+
+namespace
+{
+//Largest possible value of yiq_delta (black against white)
+const float kMaxDelta = 35215.f;
+
+float yiq_delta(const unsigned char *a, const unsigned char *b, int bytespp)
+{
+    //TGA stores BGR(A), grayscale images only have one channel
+    float db = (float)a[0]-b[0];
+    float dg = bytespp >= 3 ? (float)a[1]-b[1] : db;
+    float dr = bytespp >= 3 ? (float)a[2]-b[2] : db;
+    float y = dr*.29889531f+dg*.58662247f+db*.11448223f;
+    float i = dr*.59597799f-dg*.27417610f-db*.32180189f;
+    float q = dr*.21147017f-dg*.52261711f+db*.31114694f;
+    return .5053f*y*y+.299f*i*i+.1957f*q*q;
+}
+
+//True when some pixel of other around (x, y) is within threshold of the pixel of image at (x, y)
+bool has_neighbour(const unsigned char *image, const unsigned char *other, int x, int y, int width, int height, int bytespp, float threshold)
+{
+    const unsigned char *p = image+((size_t)y*width+x)*bytespp;
+    for (int j = std::max(0, y-1); j <= std::min(height-1, y+1); j++)
+    {
+        for (int i = std::max(0, x-1); i <= std::min(width-1, x+1); i++)
+        {
+            if (yiq_delta(p, other+((size_t)j*width+i)*bytespp, bytespp) <= threshold) return true;
+        }
+    }
+    return false;
+}
+}
+
+bool diff_images(TGAImage &expected, TGAImage &actual, float tolerance, ImageDiff &result, TGAImage *diffImage)
+{
+    result.differing = result.perceptible = result.maxDelta = 0;
+    const int width = expected.get_width(), height = expected.get_height(), bytespp = expected.get_bytespp();
+    if (width != actual.get_width() || height != actual.get_height() || bytespp != actual.get_bytespp() || !expected.buffer() || !actual.buffer())
+    {
+        std::cerr << "can't compare a " << width << "x" << height << "/" << bytespp*8 << " image with a "
+                  << actual.get_width() << "x" << actual.get_height() << "/" << actual.get_bytespp()*8 << " one\n";
+        return false;
+    }
+    const unsigned char *a = expected.buffer(), *b = actual.buffer();
+    const float threshold = kMaxDelta*tolerance*tolerance;
+    if (diffImage) *diffImage = TGAImage(width, height, TGAImage::RGB);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            const size_t offset = ((size_t)y*width+x)*bytespp;
+            int delta = 0;
+            for (int c = 0; c < bytespp; c++) delta = std::max(delta, std::abs((int)a[offset+c]-b[offset+c]));
+            bool perceptible = false;
+            if (delta)
+            {
+                result.differing++;
+                result.maxDelta = std::max(result.maxDelta, delta);
+                perceptible = yiq_delta(a+offset, b+offset, bytespp) > threshold
+                              && !(has_neighbour(a, b, x, y, width, height, bytespp, threshold)
+                                   && has_neighbour(b, a, x, y, width, height, bytespp, threshold));
+                if (perceptible) result.perceptible++;
+            }
+            if (!diffImage) continue;
+            if (perceptible)
+            {
+                diffImage->set(x, y, TGAColor(255, 0, 0));
+            }
+            else if (delta)
+            {
+                diffImage->set(x, y, TGAColor(255, 255, 0));
+            }
+            else
+            {
+                const unsigned char *p = a+offset;
+                unsigned char v = (unsigned char)(bytespp >= 3 ? (p[0]*29+p[1]*150+p[2]*77)/256/4 : p[0]/4);
+                diffImage->set(x, y, TGAColor(v, v, v));
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,25 @@
+//
+//  imagediff.h
+//  TinyRenderer
+//
+//  Exact and perceptual comparison of two images of the same size.
+//
+
+#ifndef imagediff_h
+#define imagediff_h
+
+#include "tgaimage.h"
+
+struct ImageDiff
+{
+    int differing;   //pixels that are not bit identical
+    int perceptible; //differing pixels above the tolerance that are not explained by an edge moving by one pixel
+    int maxDelta;    //largest difference of a single channel
+};
+
+//tolerance is a YIQ color distance in [0,1]: 0 flags any change, .1 hides small shading and rounding differences.
+//diffImage, when given, gets a dimmed grayscale copy of expected with differing pixels in yellow and perceptible ones in red.
+//Returns false when the images can't be compared (different size or format).
+bool diff_images(TGAImage &expected, TGAImage &actual, float tolerance, ImageDiff &result, TGAImage *diffImage = nullptr);
+
+#endif /* imagediff_h */
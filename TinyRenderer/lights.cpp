@@ -0,0 +1,196 @@
+//
+//  lights.cpp
+//  TinyRenderer
+//
+
+#include <cmath>
+#include <limits>
+#include "lights.h"
+#include "our_gl.h"
+#include "renderer.h"
+#include "threadpool.h"
+#include "profiler.h"
+
+namespace
+{
+//Room for the float rounding between a shaded position and the bounds it was culled with
+const float kSlack = 1e-4f;
+}
+
+std::vector<Light> scatter_lights(int count, Vec3f center, float radius)
+{
+    std::vector<Light> lights;
+    const float golden = (float)M_PI*(3.f-std::sqrt(5.f));
+    for (int i = 0; i < count; i++)
+    {
+        //Directions on a Fibonacci sphere, distances from an unrelated sequence spaced by volume
+        const float y = 1.f-2.f*(i+.5f)/count, ring = std::sqrt(std::max(0.f, 1.f-y*y)), phi = golden*i;
+        const float u = (i+.5f)*.7548777f;
+        const float r = radius*std::cbrt(u-std::floor(u));
+        Light light;
+        light.position = center+Vec3f(ring*std::cos(phi), y, ring*std::sin(phi))*r;
+        const float hue = i*.618034f;
+        for (int c = 0; c < 3; c++) light.color[c] = 2.f*(.5f+.5f*std::cos(2.f*(float)M_PI*(hue+c/3.f)));
+        light.radius = 1.8f*radius/std::cbrt((float)count);
+        light.direction = Vec3f(0, 0, -1);
+        light.cosOuter = light.cosInner = -1.f;
+        if (i%4 == 3)
+        {
+            light.direction = (center-light.position).normalize();
+            light.cosOuter = std::cos(40.f*(float)M_PI/180.f);
+            light.cosInner = std::cos(25.f*(float)M_PI/180.f);
+        }
+        lights.push_back(light);
+    }
+    return lights;
+}
+
+LightGrid::LightGrid(int width, int height)
+: width_(width), height_(height), tilesX_((width+kTileSize-1)/kTileSize), tilesY_((height+kTileSize-1)/kTileSize), words_(0),
+  viewport_(viewport(0, 0, width, height)), transform_(Matrix4f::identity()), spheres_(), planes_(), masks_(), offsets_(), indices_(), bounds_(), all_(), maxEntries_(0)
+{}
+
+void LightGrid::set_viewport(const Matrix4f &m)
+{
+    viewport_ = m;
+}
+
+int LightGrid::total_entries()
+{
+    return (int)indices_.size();
+}
+
+int LightGrid::max_entries()
+{
+    return maxEntries_;
+}
+
+//A point of view space is inside the tile column [a0, a1] of the projected x when
+//a0 <= x/w <= a1, with w = 1+coeff*z: the planes x-a0*w >= 0 and a1*w-x >= 0, the same for y
+void LightGrid::cull(const std::vector<Light> &lights, const Matrix4f &view, float coeff, const DepthBuffer &depth)
+{
+    PROFILE_SCOPE("light culling");
+    const int n = (int)lights.size(), nTiles = tilesX_*tilesY_;
+    transform_ = viewport_*projection(coeff)*view;
+    spheres_.resize(n);
+    for (int i = 0; i < n; i++)
+    {
+        spheres_[i] = view*embed<4>(lights[i].position);
+        spheres_[i][3] = lights[i].radius;
+    }
+    planes_.resize((tilesX_+tilesY_)*2);
+    for (int axis = 0; axis < 2; axis++)
+    {
+        const int tiles = axis ? tilesY_ : tilesX_, size = axis ? height_ : width_;
+        const float scale = viewport_[axis][axis], offset = viewport_[axis][3];
+        for (int t = 0; t < tiles; t++)
+        {
+            const float e0 = (t*kTileSize-offset)/scale, e1 = (std::min((t+1)*kTileSize, size)-offset)/scale;
+            const float lo = std::min(e0, e1), hi = std::max(e0, e1);
+            Vec4f in0, in1;
+            in0[axis] = 1.f;
+            in0[2] = -lo*coeff;
+            in0[3] = -lo;
+            in1[axis] = -1.f;
+            in1[2] = hi*coeff;
+            in1[3] = hi;
+            Vec4f *planes = &planes_[(axis ? tilesX_ : 0)*2+t*2];
+            planes[0] = in0/std::sqrt(1.f+in0[2]*in0[2]);
+            planes[1] = in1/std::sqrt(1.f+in1[2]*in1[2]);
+        }
+    }
+    //The unorm formats only know depth to a step, the bounds are widened by one
+    const DepthBuffer::Format format = depth.get_format();
+    const float margin = format == DepthBuffer::D16 || format == DepthBuffer::D24S8 ? 1.f/depth.get_scale() : 0.f;
+
+    words_ = (n+31)/32;
+    masks_.assign((size_t)nTiles*words_, 0u);
+    offsets_.assign(nTiles+1, 0);
+    bounds_.resize(nTiles);
+    all_.resize(n);
+    for (int i = 0; i < n; i++) all_[i] = i;
+    ThreadPool &pool = ThreadPool::instance();
+    pool.parallel_for(nTiles, [&](int tile, int)
+    {
+        cull_tile(tile, depth, coeff, margin);
+    });
+    maxEntries_ = 0;
+    for (int t = 0; t < nTiles; t++)
+    {
+        maxEntries_ = std::max(maxEntries_, offsets_[t+1]);
+        offsets_[t+1] += offsets_[t];
+    }
+    indices_.resize(offsets_[nTiles]);
+    pool.parallel_for(nTiles, [&](int tile, int)
+    {
+        int *out = indices_.data()+offsets_[tile];
+        const uint32_t *mask = &masks_[(size_t)tile*words_];
+        for (int w = 0; w < words_; w++)
+        {
+            for (uint32_t bits = mask[w]; bits; bits &= bits-1) *out++ = w*32+__builtin_ctz(bits);
+        }
+    });
+    PROFILE_COUNT(LIGHT_ENTRIES, offsets_[nTiles]);
+}
+
+//Marks the lights of the tile in its mask and counts them in offsets_[tile+1]. Tiles
+//nothing was drawn to get none.
+void LightGrid::cull_tile(int tile, const DepthBuffer &depth, float coeff, float margin)
+{
+    const int tx = tile%tilesX_, ty = tile/tilesX_, S = depth.get_samples();
+    const int x0 = tx*kTileSize, y0 = ty*kTileSize;
+    const int x1 = std::min(x0+kTileSize, width_), y1 = std::min(y0+kTileSize, height_);
+    float lo = std::numeric_limits<float>::max(), hi = -lo;
+    for (int y = y0; y < y1; y++)
+    {
+        for (size_t i = ((size_t)x0+(size_t)y*width_)*S; i < ((size_t)x1+(size_t)y*width_)*S; i++)
+        {
+            const float z = depth.get(i);
+            if (z == -std::numeric_limits<float>::max()) continue;
+            lo = std::min(lo, z);
+            hi = std::max(hi, z);
+        }
+    }
+    lo -= margin;
+    hi += margin;
+    bounds_[tile] = Vec2f(lo, hi);
+    if (lo > hi) return;
+    //Back from z/w to view space z, which keeps the order
+    const float zMin = lo/(1.f-coeff*lo), zMax = hi/(1.f-coeff*hi);
+    const Vec4f *column = &planes_[tx*2], *row = &planes_[(tilesX_+ty)*2];
+    uint32_t *mask = &masks_[(size_t)tile*words_];
+    int count = 0;
+    for (int i = 0; i < (int)spheres_.size(); i++)
+    {
+        const Vec4f &s = spheres_[i];
+        const float r = s[3]+kSlack;
+        if (s[2]+r < zMin || s[2]-r > zMax) continue;
+        bool inside = true;
+        for (const Vec4f *p : {column, column+1, row, row+1})
+        {
+            inside = inside && (*p)[0]*s[0]+(*p)[1]*s[1]+(*p)[2]*s[2]+(*p)[3] >= -r;
+        }
+        if (!inside) continue;
+        mask[i >> 5] |= 1u << (i&31);
+        count++;
+    }
+    offsets_[tile+1] = count;
+}
+
+const int *LightGrid::lights_at(const Vec3f &world, int &count) const
+{
+    const Vec4f c = transform_*embed<4>(world);
+    const float sx = c[0]/c[3], sy = c[1]/c[3], z = c[2]/c[3];
+    const int x = std::min(std::max((int)std::floor(sx), 0), width_-1);
+    const int y = std::min(std::max((int)std::floor(sy), 0), height_-1);
+    const int tile = (y/kTileSize)*tilesX_+x/kTileSize;
+    //Off the screen or off the depth the tile's lights were culled against: an MSAA edge
+    //pixel shaded at its center, extrapolated from a triangle that doesn't cover it
+    if (!(sx >= 0.f && sx < width_ && sy >= 0.f && sy < height_ && z >= bounds_[tile].x && z <= bounds_[tile].y))
+    {
+        count = (int)all_.size();
+        return all_.data();
+    }
+    count = offsets_[tile+1]-offsets_[tile];
+    return indices_.data()+offsets_[tile];
+}
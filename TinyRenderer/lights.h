@@ -0,0 +1,99 @@
+//
+//  lights.h
+//  TinyRenderer
+//
+//  Point and spot lights, and their tiled (Forward+) culling. After a depth prepass every
+//  kTileSize tile of the screen gets the depth bounds of what it shows, and each light's
+//  sphere of influence is tested against the tile's frustum cut to those bounds. The lights
+//  that pass go to a compact index list per tile, so shading a fragment only walks the
+//  lights of its tile instead of all of them.
+//  The lists are conservative: a light left out of a tile's list can't reach anything the
+//  tile shows. With MSAA a partially covered pixel is shaded at its center, which may lie
+//  off the triangle and past the tile's depth bounds; such a point gets every light.
+//
+
+#ifndef lights_h
+#define lights_h
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "geometry.h"
+#include "depthbuffer.h"
+
+struct Light
+{
+    Vec3f position;  // world space
+    Vec3f color;     // rgb, 1 is full strength next to the light
+    float radius;    // the falloff reaches 0 there, nothing past it is lit
+    Vec3f direction; // spot lights only, where the cone points
+    float cosOuter;  // cosine of the cone's half angle, -1 for a point light
+    float cosInner;  // full strength inside this one
+};
+
+//Lambert term of the light at p with normal n (unit length), fading as (1-(d/radius)^2)^2
+//so that it is exactly 0 from the radius on
+inline Vec3f light_contribution(const Light &light, const Vec3f &p, const Vec3f &n)
+{
+    Vec3f d = light.position-p;
+    const float d2 = d*d, r2 = light.radius*light.radius;
+    if (d2 >= r2) return Vec3f();
+    d = d/std::max(std::sqrt(d2), 1e-6f);
+    float f = n*d;
+    if (f <= 0.f) return Vec3f();
+    const float fade = 1.f-d2/r2;
+    f *= fade*fade;
+    if (light.cosOuter > -1.f)
+    {
+        const float c = -(d*light.direction);
+        if (c <= light.cosOuter) return Vec3f();
+        f *= std::min(1.f, (c-light.cosOuter)/std::max(light.cosInner-light.cosOuter, 1e-6f));
+    }
+    return light.color*f;
+}
+
+//count lights spread evenly through the ball around center, every fourth a spot aimed at
+//the center. The radius of influence shrinks with the count so that any point is reached by
+//about the same number of lights whatever the count. Deterministic.
+std::vector<Light> scatter_lights(int count, Vec3f center, float radius);
+
+class LightGrid
+{
+public:
+    LightGrid(int width, int height);
+    LightGrid(const LightGrid&) = delete;
+    LightGrid& operator=(const LightGrid&) = delete;
+    
+    void set_viewport(const Matrix4f &m);
+    //Builds the tile lists for a frame drawn with projection(coeff)*view, whose depth
+    //prepass depth holds (see Renderer::depth_buffer). The lights must stay alive while the
+    //lists are used; their indices are what the lists hold.
+    void cull(const std::vector<Light> &lights, const Matrix4f &view, float coeff, const DepthBuffer &depth);
+    //Lights that can reach the tile a world space point of the frame projects to, or all of
+    //them when the point lies outside what the tile was culled for
+    const int *lights_at(const Vec3f &world, int &count) const;
+    //Entries of all the tile lists together, and of the longest one
+    int total_entries();
+    int max_entries();
+private:
+    int width_;
+    int height_;
+    int tilesX_;
+    int tilesY_;
+    int words_;                    // 32 lights per word of a tile's mask
+    Matrix4f viewport_;
+    Matrix4f transform_;           // world -> screen of the last cull
+    std::vector<Vec4f> spheres_;   // lights in view space, w is the radius
+    std::vector<Vec4f> planes_;    // view space side planes, 2 per tile column then 2 per tile row, pointing in
+    std::vector<uint32_t> masks_;  // words_ per tile
+    std::vector<int> offsets_;     // tile t's lights are indices_[offsets_[t]] to indices_[offsets_[t+1]-1]
+    std::vector<int> indices_;
+    std::vector<Vec2f> bounds_;    // z range every tile was culled for, empty (x > y) when nothing was drawn to it
+    std::vector<int> all_;         // every light, for points outside their tile's bounds
+    int maxEntries_;
+    
+    void cull_tile(int tile, const DepthBuffer &depth, float coeff, float margin);
+};
+
+#endif /* lights_h */
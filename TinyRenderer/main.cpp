@@ -7,157 +7,440 @@
 
 #include "tgaimage.h"
 #include "model.h"
+#include "our_gl.h"
+#include "renderer.h"
+#include "shadow.h"
+#include "shaders.h"
+#include "postprocess.h"
+#include "wireframe.h"
+#include "profiler.h"
+#include "output.h"
+#include "bench.h"
+#include "golden.h"
+#include "server.h"
+#include "alloccheck.h"
+#include "assetloader.h"
+#include "progressive.h"
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <limits>
+#include <chrono>
+#include <string>
 
 const TGAColor white = TGAColor(255,255,255,255);
 const TGAColor red = TGAColor(255,0,0,255);
 const TGAColor green = TGAColor(0, 255, 0, 255);
-Model *model = nullptr;
 const int width = 800;
 const int height = 800;
 
+Vec3f light_dir(1, 1, 1);
+Vec3f eye(1, 1, 3);
+Vec3f center(0, 0, 0);
+Vec3f up(0, 1, 0);
+
 //Vec3f cross(Vec3f &a, Vec3f &b)
 //{
 //    return Vec3f(a.y * b.z - a.z*b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
 //}
 
-void line(int x0, int y0, int x1, int y1, TGAImage &image, TGAColor color)
-{
-    bool steep = false;
-    if (std::abs(x0-x1)<std::abs(y0-y1))
+//Intensity of illumination is equal to the scalar product of the light vector and the normal to the given triangle
+//Usage: TinyRenderer [-O] [-compress] [-n repeats] [-msaa 1|4|8] [-lit] [-shadow size] [-ssao 1|2] [-profile prefix]
+//                    [-depth fp32|d24s8|d16|rfp32] [-wire] [-wire-depth] [-wire-aa]
+//                    [-oit wb|kbuf] [-oit-k k] [-lights n] [-hdr clamp|reinhard|aces] [-exposure e]
+//                    [-budget ms] [-order center|geometry]
+//                    [-o file] [-format rgb|rgba|ppm|tga|tga-raw] [model.obj ...]
+//  -O       reorder the mesh for vertex cache/overdraw (cached next to the obj as .trmesh)
+//  -compress keep the meshes quantized and delta coded, decoded as they are drawn
+//  -n       render the frame this many times and report the average frame time
+//  -msaa    samples per pixel
+//  -lit     perspective camera, textures and lambert lighting instead of per face colors
+//  -shadow  same as -lit with a shadow map of the given resolution
+//  -ssao    ambient occlusion from the depth buffer at full (1) or half (2) resolution
+//  -depth   depth buffer format: 32 bit float (default), 24 bit with stencil, 16 bit or reversed float
+//  -wire    draw the mesh edges over the frame, -wire-depth hides the ones behind surfaces,
+//           -wire-aa anti-aliases them (either implies -wire)
+//  -oit     same as -lit, with the last model drawn as glass over the others, composited
+//           weighted blended (wb) or exactly from the k nearest layers of every pixel (kbuf)
+//  -oit-k   layers kept per pixel by -oit kbuf, 8 by default
+//  -lights  same as -lit, lit by n point and spot lights spread around the scene instead of the
+//           directional light. A depth prepass bounds every tile, each tile keeps the lights
+//           that can reach it and shading only evaluates those.
+//  -hdr     keep linear light in a float framebuffer and tone map it with this curve when resolving
+//  -exposure scale of the linear light before the tone curve, 1 by default
+//  -budget  progressive frames that return within about ms: a quarter resolution pass first,
+//           then full resolution tiles in priority order until the deadline (0 for the coarse
+//           pass alone). Not with -lights, -oit, -ssao or -wire, which need the whole frame.
+//  -order   which tiles -budget refines first: nearest the center (default) or with the most triangles
+//  -profile write prefix.json and prefix.trace.json (needs a build with TR_PROFILE defined)
+//  -o       where the frame goes, output.tga by default. "-" streams every frame to stdout, e.g.
+//           TinyRenderer -n 100 -o - -format rgb | ffmpeg -f rawvideo -pix_fmt rgb24 -s 800x800 -i - out.mp4
+//  -format  output encoding, guessed from the -o extension by default
+//TinyRenderer --bench ... runs the benchmark suite instead, see bench.cpp
+//TinyRenderer --golden ... compares a fixed set of scenes with the reference images, see golden.cpp
+//TinyRenderer --serve socket ... / --loadgen socket ... render server and its load generator, see server.h
+//TinyRenderer --alloc-check checks that steady state frames don't touch the heap, see alloccheck.cpp
+int main(int argc, const char * argv[]) {
+    if (argc > 1 && !strcmp(argv[1], "--bench"))
     {
-        std::swap(x0, y0);
-        std::swap(x1, y1);
-        steep = true;
+        return run_benchmarks(argc-1, argv+1);
     }
-    if (x0>x1)
+    if (argc > 1 && !strcmp(argv[1], "--golden"))
     {
-        std::swap(x0, x1);
-        std::swap(y0, y1);
+        return run_golden(argc-1, argv+1);
     }
-    
-    int dx = x1-x0;
-    int dy = y1-y0;
-    int derror2 = std::abs(dy)*2;
-    int error2 = 0;
-    int y = y0;
-    
-    if(steep)
+    if (argc > 1 && !strcmp(argv[1], "--serve"))
+    {
+        return run_server(argc-1, argv+1);
+    }
+    if (argc > 1 && !strcmp(argv[1], "--loadgen"))
+    {
+        return run_loadgen(argc-1, argv+1);
+    }
+    if (argc > 1 && !strcmp(argv[1], "--alloc-check"))
     {
-        for(int x = x0; x<=x1; x++)
+        return run_alloc_check(argc-1, argv+1);
+    }
+    PROFILE_ONLY(profiler::set_thread_name("main");)
+    std::vector<const char *> fileNames;
+    const char *profile = nullptr;
+    const char *output = "output.tga";
+    const char *formatName = nullptr;
+    DepthBuffer::Format depthFormat = DepthBuffer::FLOAT32;
+    bool optimize = false;
+    bool compress = false;
+    bool lit = false;
+    int repeats = 1;
+    int samples = 1;
+    int shadowSize = 0;
+    int ssaoScale = 0;
+    int wireFlags = -1;
+    int oit = -1;
+    int oitK = 8;
+    int lightCount = 0;
+    int tone = -1;
+    float exposure = 1.f;
+    double budget = -1.;
+    ProgressiveRenderer::Order order = ProgressiveRenderer::CENTER_FIRST;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-O"))
+        {
+            optimize = true;
+        }
+        else if (!strcmp(argv[i], "-compress"))
+        {
+            compress = true;
+        }
+        else if (!strcmp(argv[i], "-n") && i+1 < argc)
+        {
+            repeats = std::max(1, atoi(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "-msaa") && i+1 < argc)
+        {
+            samples = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-lit"))
+        {
+            lit = true;
+        }
+        else if (!strcmp(argv[i], "-shadow") && i+1 < argc)
         {
-            image.set(y, x, color);
-            error2 += derror2;
-            if(error2 > dx)
+            lit = true;
+            shadowSize = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-profile") && i+1 < argc)
+        {
+            profile = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-ssao") && i+1 < argc)
+        {
+            ssaoScale = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-depth") && i+1 < argc)
+        {
+            if (!DepthBuffer::parse_format(argv[++i], depthFormat))
             {
-                y += (y1>y0 ? 1: -1);
-                error2 -= dx*2;
+                std::cerr << "unknown depth format " << argv[i] << std::endl;
+                return 1;
             }
         }
-    }
-    else
-    {
-        for(int x = x0; x<=x1; x++)
+        else if (!strcmp(argv[i], "-wire"))
+        {
+            wireFlags = std::max(wireFlags, 0);
+        }
+        else if (!strcmp(argv[i], "-wire-depth"))
+        {
+            wireFlags = std::max(wireFlags, 0) | Wireframe::DEPTH_TEST;
+        }
+        else if (!strcmp(argv[i], "-wire-aa"))
         {
-            image.set(x, y, color);
-            error2 += derror2;
-            if(error2 > dx)
+            wireFlags = std::max(wireFlags, 0) | Wireframe::ANTIALIAS;
+        }
+        else if (!strcmp(argv[i], "-oit") && i+1 < argc)
+        {
+            lit = true;
+            i++;
+            if (!strcmp(argv[i], "wb")) oit = Renderer::WEIGHTED_BLENDED;
+            else if (!strcmp(argv[i], "kbuf")) oit = Renderer::K_BUFFER;
+            else
             {
-                y += (y1>y0 ? 1: -1);
-                error2 -= dx*2;
+                std::cerr << "unknown transparency mode " << argv[i] << std::endl;
+                return 1;
             }
         }
-    }
-}
-
-Vec3f barycentric(Vec3f A, Vec3f B, Vec3f C, Vec3f P)
-{
-    Vec3f s[2];
-    for (int i=2; i--; )
-    {
-        s[i][0] = C[i]-A[i];
-        s[i][1] = B[i]-A[i];
-        s[i][2] = A[i]-P[i];
-    }
-    Vec3f u = cross(s[0], s[1]);
-    if (std::abs(u[2])>1e-2) // dont forget that u[2] is integer. If it is zero then triangle ABC is degenerate
-        return Vec3f(1.f-(u.x+u.y)/u.z, u.y/u.z, u.x/u.z);
-    return Vec3f(-1,1,1); // in this case generate negative coordinates, it will be thrown away by the rasterizator
-}
-
-void triangle(Vec3f *pts, float *zBuffer, TGAImage &image, TGAColor color)
-{
-    Vec2f bboxmin( std::numeric_limits<float>::max(),  std::numeric_limits<float>::max());
-    Vec2f bboxmax(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
-    Vec2f clamp(image.get_width()-1, image.get_height()-1);
-    for (int i=0; i<3; i++)
-    {
-        for (int j=0; j<2; j++)
+        else if (!strcmp(argv[i], "-oit-k") && i+1 < argc)
         {
-            bboxmin[j] = std::max(0.f,      std::min(bboxmin[j], pts[i][j]));
-            bboxmax[j] = std::min(clamp[j], std::max(bboxmax[j], pts[i][j]));
+            oitK = std::max(1, atoi(argv[++i]));
         }
-    }
-    Vec3f P;
-    for (P.x=bboxmin.x; P.x<=bboxmax.x; P.x++)
-    {
-        for (P.y=bboxmin.y; P.y<=bboxmax.y; P.y++)
+        else if (!strcmp(argv[i], "-lights") && i+1 < argc)
+        {
+            lightCount = atoi(argv[++i]);
+            lit = true;
+        }
+        else if (!strcmp(argv[i], "-hdr") && i+1 < argc)
         {
-            Vec3f bc_screen  = barycentric(pts[0], pts[1], pts[2], P);
-            if (bc_screen.x<0 || bc_screen.y<0 || bc_screen.z<0) continue;
-            P.z = 0;
-            for (int i=0; i<3; i++)
+            ToneCurve curve;
+            if (!ToneMapper::parse_curve(argv[++i], curve))
             {
-                P.z += pts[i][2]*bc_screen[i];
+                std::cerr << "unknown tone curve " << argv[i] << std::endl;
+                return 1;
             }
-            if (zBuffer[int(P.x+P.y*width)]<P.z)
+            tone = curve;
+        }
+        else if (!strcmp(argv[i], "-exposure") && i+1 < argc)
+        {
+            exposure = (float)atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-budget") && i+1 < argc)
+        {
+            budget = std::max(0., atof(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "-order") && i+1 < argc)
+        {
+            if (!ProgressiveRenderer::parse_order(argv[++i], order))
             {
-                zBuffer[int(P.x+P.y*width)] = P.z;
-                image.set(P.x, P.y, color);
+                std::cerr << "unknown tile order " << argv[i] << std::endl;
+                return 1;
             }
         }
+        else if (!strcmp(argv[i], "-o") && i+1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-format") && i+1 < argc)
+        {
+            formatName = argv[++i];
+        }
+        else
+        {
+            fileNames.push_back(argv[i]);
+        }
     }
-    
-}
-
-Vec3f world2screen(Vec3f v)
-{
-    return Vec3f(int((v.x+1.f)*width/2.f+.5f), int((v.y+1.f)*height/2.f+.5f), v.z);
-}
-
-//Intensity of illumination is equal to the scalar product of the light vector and the normal to the given triangle
-int main(int argc, const char * argv[]) {
-    if (argc==2)
+    if (budget >= 0. && (lightCount > 0 || oit >= 0 || ssaoScale > 0 || wireFlags >= 0))
+    {
+        std::cerr << "-budget doesn't combine with -lights, -oit, -ssao or -wire" << std::endl;
+        return 1;
+    }
+    FrameWriter::Format format = FrameWriter::format_for(output);
+    if (formatName && !FrameWriter::parse_format(formatName, format))
     {
-        model = new Model(argv[1]);
+        std::cerr << "unknown format " << formatName << std::endl;
+        return 1;
     }
-    else
+    FileOutput out(output);
+    if (!out.is_open()) return 1;
+    FrameWriter writer(out, format, width, height);
+    const bool streaming = !strcmp(output, "-");
+    if (fileNames.empty())
     {
-        model = new Model("/Users/radsherwin/Documents/Xcode/TinyRenderer/TinyRenderer/Models/african_head/african_head.obj");
+        fileNames.push_back("/Users/radsherwin/Documents/Xcode/TinyRenderer/TinyRenderer/Models/african_head/african_head.obj");
     }
+    auto loadStart = std::chrono::steady_clock::now();
+    AssetLoader loader;
+    for (const char *fileName : fileNames) loader.load(fileName, optimize);
+    std::vector<Model*> models(fileNames.size(), nullptr);
     
-    float *zBuffer = new float[width*height];
-    for(int i = width*height; i--; zBuffer[i] = -std::numeric_limits<float>::max());
+    ShadowMap *shadow = shadowSize > 0 ? new ShadowMap(shadowSize) : nullptr;
+    const float coeff = -1.f/(eye-center).norm();
+    const Matrix4f view = lookat(eye, center, up);
+    Matrix4f transform = projection(coeff)*view;
+    const std::vector<Light> lights = scatter_lights(lightCount, center, std::sqrt(3.f));
+    LightGrid *grid = lightCount > 0 ? new LightGrid(width, height) : nullptr;
+    std::vector<IShader*> shaders(fileNames.size(), nullptr);
+    //Takes model m from the loader once it is ready and gives it its shader
+    auto prepare = [&](int m)
+    {
+        Model *model = models[m] = loader.take(m);
+        const size_t before = model->mesh_bytes();
+        if (compress && model->compress())
+        {
+            std::cerr << "mesh: " << before/1024 << " KiB -> " << model->mesh_bytes()/1024 << " KiB" << std::endl;
+        }
+        if (grid) shaders[m] = new LightsShader(model, transform, &lights, grid);
+        else if (oit >= 0 && models.size() > 1 && m+1 == (int)models.size()) shaders[m] = new GlassShader(model, transform, light_dir, shadow, .4f);
+        else if (lit) shaders[m] = new LitShader(model, transform, light_dir, shadow);
+        else shaders[m] = new FlatShader(model);
+    };
+    //Opaque models can be drawn in any order, so the first frame draws each one as soon as it
+    //has loaded. The shadow map, the light prepass, the glass and the coarse pass of a
+    //progressive frame need them all first.
+    const bool drawWhileLoading = !shadow && !grid && oit < 0 && budget < 0.;
+    std::chrono::duration<double, std::milli> loadTime(0);
+    if (!drawWhileLoading)
+    {
+        for (int m = loader.next(); m >= 0; m = loader.next()) prepare(m);
+        loadTime = std::chrono::steady_clock::now()-loadStart;
+    }
     
+    ProgressiveRenderer *progressive = budget >= 0. ? new ProgressiveRenderer(width, height, samples, 4, depthFormat) : nullptr;
+    Renderer *plain = progressive ? nullptr : new Renderer(width, height, samples, depthFormat);
+    Renderer &renderer = progressive ? progressive->renderer() : *plain;
+    //Per face colors are drawn straight from model space, where z is already in [-1, 1]
+    const Vec2f range = lit ? depth_range(coeff, std::sqrt(3.f)) : Vec2f(-1.f, 1.f);
+    for (Renderer *r : {&renderer, progressive ? &progressive->coarse_renderer() : nullptr})
+    {
+        if (!r) continue;
+        r->set_depth_range(range.x, range.y);
+        if (oit >= 0) r->set_transparency((Renderer::Transparency)oit, oitK);
+        if (tone < 0) continue;
+        r->set_hdr(true);
+        r->tone_mapper().set_curve((ToneCurve)tone);
+        r->tone_mapper().set_exposure(exposure);
+    }
+    if (progressive) progressive->set_order(order);
+    AmbientOcclusion *ssao = ssaoScale > 0 ? new AmbientOcclusion(width, height, ssaoScale == 2) : nullptr;
+    Wireframe *wire = nullptr;
+    if (wireFlags >= 0)
+    {
+        wire = new Wireframe(width, height);
+        wire->set_flags(wireFlags);
+        wire->set_color(lit ? TGAColor(255, 255, 255, 255) : TGAColor(0, 0, 0, 255));
+    }
+    //the overlay goes over the finished image, so streamed frames can't be encoded band by band
+    const bool wholeImage = ssao || wire;
     TGAImage image(width, height, TGAImage::RGB);
-    for(int i = 0; i < model->nFaces(); i++)
+    std::chrono::duration<double, std::milli> shadowTime(0), cullTime(0), rasterTime(0), resolveTime(0), ssaoTime(0), wireTime(0);
+    std::vector<double> frameMs;
+    long long refinedTiles = 0, frameTiles = 0;
+    for (int i = 0; i < repeats; i++)
     {
-        std::vector<int> face = model->face(i);
-        Vec3f pts[3];
-        Vec2f uv[3];
-        for(int i = 0; i < 3; i++)
+        PROFILE_SCOPE("frame");
+        auto start = std::chrono::steady_clock::now();
+        if (shadow) shadow->render(models, light_dir, center, std::sqrt(3.f));
+        auto shadowed = std::chrono::steady_clock::now();
+        if (progressive)
+        {
+            const ProgressiveRenderer::Stats stats = progressive->render(models, shaders, budget, image);
+            refinedTiles += stats.refined;
+            frameTiles += stats.tiles;
+            frameMs.push_back(stats.totalMs);
+            if (streaming) writer.write_image(image);
+            shadowTime += shadowed-start;
+            rasterTime += std::chrono::steady_clock::now()-shadowed;
+            continue;
+        }
+        renderer.clear();
+        if (grid)
+        {
+            renderer.set_color_write(false);
+            renderer.set_depth_test(Renderer::DEPTH_GREATER);
+            for (size_t m = 0; m < models.size(); m++) renderer.draw(*models[m], *shaders[m]);
+            grid->cull(lights, view, coeff, renderer.depth_buffer());
+            renderer.set_color_write(true);
+            renderer.set_depth_test(Renderer::DEPTH_GREATER_EQUAL);
+        }
+        auto culled = std::chrono::steady_clock::now();
+        for (int m = i == 0 && drawWhileLoading ? loader.next() : -1; m >= 0; m = loader.next())
+        {
+            prepare(m);
+            loadTime = std::chrono::steady_clock::now()-loadStart;
+            renderer.draw(*models[m], *shaders[m]);
+        }
+        for (size_t m = 0; m < models.size() && (i > 0 || !drawWhileLoading); m++)
+        {
+            if (oit >= 0 && m > 0 && m+1 == models.size()) renderer.draw_transparent(*models[m], *shaders[m]);
+            else renderer.draw(*models[m], *shaders[m]);
+        }
+        auto rastered = std::chrono::steady_clock::now();
+        //streamed frames are encoded as the bands resolve unless SSAO needs the whole image first
+        if (streaming && !wholeImage) renderer.resolve(writer);
+        else renderer.resolve(image);
+        auto resolved = std::chrono::steady_clock::now();
+        if (ssao) ssao->apply(renderer.depth_buffer(), renderer.get_samples(), width/2.f, image);
+        auto occluded = std::chrono::steady_clock::now();
+        if (wire)
         {
-            pts[i] = world2screen(model->vert(face[i]));
-            uv[i] = model->texCoords(face[i]);
+            const DepthBuffer *depth = wireFlags & Wireframe::DEPTH_TEST ? &renderer.depth_buffer() : nullptr;
+            for (size_t m = 0; m < models.size(); m++) wire->draw(*models[m], *shaders[m], image, depth);
         }
-        triangle(pts, zBuffer, image, TGAColor(rand()%255, rand()%255, rand()%255, 255));
+        if (streaming && wholeImage) writer.write_image(image);
+        shadowTime += shadowed-start;
+        cullTime += culled-shadowed;
+        rasterTime += rastered-culled;
+        resolveTime += resolved-rastered;
+        ssaoTime += occluded-resolved;
+        wireTime += std::chrono::steady_clock::now()-occluded;
+    }
+    std::cerr << "load " << loadTime.count() << " ms" << (drawWhileLoading ? ", the first frame drawn as the models arrived" : "") << std::endl;
+    std::cerr << renderer.get_samples() << "x: ";
+    if (shadow) std::cerr << "shadow " << shadow->get_size() << " " << shadowTime.count()/repeats << " ms, ";
+    if (grid) std::cerr << "prepass+culling " << cullTime.count()/repeats << " ms, ";
+    if (progressive) std::cerr << "progressive " << rasterTime.count()/repeats << " ms";
+    else std::cerr << "raster " << rasterTime.count()/repeats << " ms, resolve " << resolveTime.count()/repeats << " ms";
+    if (tone >= 0) std::cerr << " (hdr, " << ToneMapper::curve_name((ToneCurve)tone) << ")";
+    if (ssao) std::cerr << ", ssao " << ssaoTime.count()/repeats << " ms";
+    if (wire) std::cerr << ", wireframe " << wireTime.count()/repeats << " ms";
+    std::cerr << "/frame";
+    std::cerr << " (acmr " << models[0]->acmr() << ")" << std::endl;
+    if (progressive)
+    {
+        std::sort(frameMs.begin(), frameMs.end());
+        const size_t p99 = std::min(frameMs.size()-1, (size_t)std::ceil(.99*frameMs.size())-1);
+        std::cerr << "budget " << budget << " ms, " << ProgressiveRenderer::order_name(order) << " first: " << 100.*refinedTiles/frameTiles
+                  << "% of the tiles refined, p50 " << frameMs[frameMs.size()/2] << " ms, p99 " << frameMs[p99] << " ms";
+        if (budget > 0.) std::cerr << " (" << 100.*frameMs[p99]/budget << "% of the budget)";
+        std::cerr << std::endl;
+    }
+    const unsigned long touched = renderer.depth_bytes_touched(); // before depth_buffer() fills the rest in
+    std::cerr << "depth " << DepthBuffer::format_name(depthFormat) << ": " << renderer.depth_buffer().bytes()/1024 << " KiB, last frame touched "
+              << touched/1024 << " KiB" << std::endl;
+    if (oit >= 0)
+    {
+        std::cerr << "transparency " << (oit == Renderer::K_BUFFER ? "kbuf" : "wb") << ": " << renderer.transparency_bytes()/1024 << " KiB, "
+                  << renderer.dropped_fragments() << " fragments dropped" << std::endl;
+    }
+    if (grid)
+    {
+        std::cerr << "lights " << lightCount << ": " << (double)grid->total_entries()/((width+kTileSize-1)/kTileSize*((height+kTileSize-1)/kTileSize))
+                  << " per tile on average, " << grid->max_entries() << " at most" << std::endl;
+    }
+    if (renderer.get_samples() > 1)
+    {
+        std::cerr << "expanded pixels: " << renderer.expanded_pixels() << "/" << width*height << ", sample color storage "
+                  << renderer.sample_bytes()/1024 << " KiB (uncompressed " << (unsigned long)width*height*renderer.get_samples()*4/1024 << " KiB)" << std::endl;
     }
     
-    
-    image.flip_vertically(); //to set origin at the bottom left corner of the image
-    image.write_tga_file("output.tga");
-    delete model;
+    if (!streaming) writer.write_image(image); //bottom left origin, no flip needed
+    if (profile)
+    {
+#ifdef TR_PROFILE
+        std::string prefix(profile);
+        profiler::write_json((prefix+".json").c_str());
+        profiler::write_trace((prefix+".trace.json").c_str());
+#else
+        std::cerr << "-profile ignored, this build was made without TR_PROFILE" << std::endl;
+#endif
+    }
+    for (IShader *shader : shaders) delete shader;
+    for (Model *model : models) delete model;
+    delete shadow;
+    delete ssao;
+    delete wire;
+    delete grid;
+    delete plain;
+    delete progressive;
     return 0;
     
 }
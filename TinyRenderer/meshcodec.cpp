@@ -0,0 +1,314 @@
+//
+//  meshcodec.cpp
+//  TinyRenderer
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include "meshcodec.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+const int kStreams = 4; // position, uv, normal, tangent frame
+
+//Indices of the last cluster the thread decoded
+struct ClusterCache
+{
+    unsigned mesh;
+    int cluster;
+    int corners[PackedMesh::kClusterFaces*3*kStreams];
+};
+
+thread_local ClusterCache cache = {0, -1, {}};
+std::atomic<unsigned> nextId(1);
+
+float length(const Vec3f &v)
+{
+    return std::sqrt(v.x*v.x+v.y*v.y+v.z*v.z);
+}
+
+Vec3f oct_decode(int16_t a, int16_t b)
+{
+    float x = a/32767.f, y = b/32767.f;
+    const float z = 1.f-std::abs(x)-std::abs(y);
+    const float t = std::max(-z, 0.f);
+    x += x >= 0.f ? -t : t;
+    y += y >= 0.f ? -t : t;
+    const float l = 1.f/std::sqrt(x*x+y*y+z*z);
+    return Vec3f(x*l, y*l, z*l);
+}
+
+//Projected on the octahedron, the lower half folded over the upper one, then whichever
+//rounding of the two coordinates decodes closest to the direction
+void oct_encode(const Vec3f &n, int16_t *out)
+{
+    const float l1 = std::abs(n.x)+std::abs(n.y)+std::abs(n.z);
+    if (l1 == 0.f)
+    {
+        out[0] = out[1] = 0;
+        return;
+    }
+    float x = n.x/l1, y = n.y/l1;
+    if (n.z < 0.f)
+    {
+        const float fx = (1.f-std::abs(y))*(x >= 0.f ? 1.f : -1.f);
+        const float fy = (1.f-std::abs(x))*(y >= 0.f ? 1.f : -1.f);
+        x = fx;
+        y = fy;
+    }
+    const Vec3f dir = n/length(n);
+    float best = std::numeric_limits<float>::max();
+    for (int k = 0; k < 4; k++)
+    {
+        const float sx = std::min(std::max(x, -1.f), 1.f)*32767.f, sy = std::min(std::max(y, -1.f), 1.f)*32767.f;
+        const float qx = k&1 ? std::ceil(sx) : std::floor(sx), qy = k&2 ? std::ceil(sy) : std::floor(sy);
+        const Vec3f d = oct_decode((int16_t)qx, (int16_t)qy);
+        const float s = length(cross(d, dir)); // sine of the error, the cosine is 1 in float
+        if (s >= best) continue;
+        best = s;
+        out[0] = (int16_t)qx;
+        out[1] = (int16_t)qy;
+    }
+}
+
+//atan2 rather than acos of the dot product, which can't resolve angles below 0.02 degree in float
+float angle_degrees(const Vec3f &a, const Vec3f &b)
+{
+    if (length(a) == 0.f || length(b) == 0.f) return 0.f;
+    return std::atan2(length(cross(a, b)), a*b)*180.f/(float)M_PI;
+}
+
+//Half a step, plus the float rounding of the decode's multiply and add at the largest magnitude
+float step_bound(float lo, float scale)
+{
+    const float magnitude = std::max(std::abs(lo), std::abs(lo+scale*65535.f));
+    return scale*.5f+magnitude*std::numeric_limits<float>::epsilon();
+}
+
+uint16_t quantize(float v, float lo, float scale)
+{
+    return scale > 0.f ? (uint16_t)std::min(65535.f, std::max(0.f, std::round((v-lo)/scale))) : 0;
+}
+
+void write_varint(std::vector<uint8_t> &out, int value)
+{
+    uint32_t v = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31); // zigzag, small magnitudes stay small
+    while (v >= 0x80)
+    {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+}
+
+PackedMesh::PackedMesh(const std::vector<Vec3f> &verts, const std::vector<Vec2f> &uvs, const std::vector<Vec3f> &norms,
+                       const std::vector<std::vector<Vec3i>> &faces, const std::vector<int> &frames,
+                       const std::vector<Vec3f> &tangents, const std::vector<Vec3f> &bitangents)
+: id_(nextId++), nVerts_((int)verts.size()), nTexCoords_((int)uvs.size()), nNorms_((int)norms.size()), nFaces_((int)faces.size()),
+  nFrames_(frames.empty() ? 0 : (int)tangents.size()), posMin_(), posScale_(), uvMin_(), uvScale_(), positions_(), uvs_(), normals_(),
+  frames_(), indices_(), clusters_(), error_()
+{
+    //16 bit steps across the bounding box of each stream
+    for (int a = 0; a < 3; a++)
+    {
+        float lo = std::numeric_limits<float>::max(), hi = -lo;
+        for (const Vec3f &v : verts)
+        {
+            lo = std::min(lo, v[a]);
+            hi = std::max(hi, v[a]);
+        }
+        posMin_[a] = verts.empty() ? 0.f : lo;
+        posScale_[a] = verts.empty() ? 0.f : (hi-lo)/65535.f;
+    }
+    for (int a = 0; a < 2; a++)
+    {
+        float lo = std::numeric_limits<float>::max(), hi = -lo;
+        for (const Vec2f &v : uvs)
+        {
+            lo = std::min(lo, v[a]);
+            hi = std::max(hi, v[a]);
+        }
+        uvMin_[a] = uvs.empty() ? 0.f : lo;
+        uvScale_[a] = uvs.empty() ? 0.f : (hi-lo)/65535.f;
+    }
+    positions_.reserve(verts.size()*3+1);
+    for (const Vec3f &v : verts)
+    {
+        for (int a = 0; a < 3; a++) positions_.push_back(quantize(v[a], posMin_[a], posScale_[a]));
+    }
+    positions_.push_back(0);
+    uvs_.reserve(uvs.size()*2);
+    for (const Vec2f &v : uvs)
+    {
+        for (int a = 0; a < 2; a++) uvs_.push_back(quantize(v[a], uvMin_[a], uvScale_[a]));
+    }
+    normals_.resize(norms.size()*2);
+    for (size_t i = 0; i < norms.size(); i++) oct_encode(norms[i], &normals_[i*2]);
+    frames_.resize((size_t)nFrames_*4);
+    for (int i = 0; i < nFrames_; i++)
+    {
+        oct_encode(tangents[i], &frames_[(size_t)i*4]);
+        oct_encode(bitangents[i], &frames_[(size_t)i*4+2]);
+    }
+
+    //Every stream is delta coded against the previous corner's, starting over at each cluster
+    clusters_.reserve((nFaces_+kClusterFaces-1)/kClusterFaces);
+    int previous[kStreams] = {0, 0, 0, 0};
+    for (int f = 0; f < nFaces_; f++)
+    {
+        if (f%kClusterFaces == 0)
+        {
+            clusters_.push_back((uint32_t)indices_.size());
+            std::fill(previous, previous+kStreams, 0);
+        }
+        for (int c = 0; c < 3; c++)
+        {
+            const int corner[kStreams] = {faces[f][c][0], faces[f][c][1], faces[f][c][2], nFrames_ ? frames[f*3+c] : -1};
+            for (int s = 0; s < kStreams; s++)
+            {
+                write_varint(indices_, corner[s]-previous[s]);
+                previous[s] = corner[s];
+            }
+        }
+    }
+
+    error_.position = error_.uv = error_.normal = 0.f;
+    for (int i = 0; i < nVerts_; i++)
+    {
+        const Vec3f d = vert(i)-verts[i];
+        error_.position = std::max(error_.position, std::max(std::abs(d.x), std::max(std::abs(d.y), std::abs(d.z))));
+    }
+    for (int i = 0; i < nTexCoords_; i++)
+    {
+        const Vec2f d = uv(i)-uvs[i];
+        error_.uv = std::max(error_.uv, std::max(std::abs(d.x), std::abs(d.y)));
+    }
+    for (int i = 0; i < nNorms_; i++) error_.normal = std::max(error_.normal, angle_degrees(normal(i), norms[i]));
+    for (int i = 0; i < nFrames_; i++)
+    {
+        error_.normal = std::max(error_.normal, angle_degrees(tangent(i), tangents[i]));
+        error_.normal = std::max(error_.normal, angle_degrees(bitangent(i), bitangents[i]));
+    }
+}
+
+int PackedMesh::nVerts() const
+{
+    return nVerts_;
+}
+
+int PackedMesh::nTexCoords() const
+{
+    return nTexCoords_;
+}
+
+int PackedMesh::nNorms() const
+{
+    return nNorms_;
+}
+
+int PackedMesh::nFaces() const
+{
+    return nFaces_;
+}
+
+int PackedMesh::nFrames() const
+{
+    return nFrames_;
+}
+
+//x, y, z and the next vertex's x (or the padding) are widened and scaled as one vector
+Vec3f PackedMesh::vert(int i) const
+{
+#if defined(__SSE2__)
+    const __m128i q = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(&positions_[(size_t)i*3]));
+    const __m128 f = _mm_cvtepi32_ps(_mm_unpacklo_epi16(q, _mm_setzero_si128()));
+    float v[4];
+    _mm_storeu_ps(v, _mm_add_ps(_mm_mul_ps(f, _mm_loadu_ps(posScale_)), _mm_loadu_ps(posMin_)));
+    return Vec3f(v[0], v[1], v[2]);
+#else
+    const uint16_t *q = &positions_[(size_t)i*3];
+    return Vec3f(q[0]*posScale_[0]+posMin_[0], q[1]*posScale_[1]+posMin_[1], q[2]*posScale_[2]+posMin_[2]);
+#endif
+}
+
+Vec2f PackedMesh::uv(int i) const
+{
+    const uint16_t *q = &uvs_[(size_t)i*2];
+    return Vec2f(q[0]*uvScale_[0]+uvMin_[0], q[1]*uvScale_[1]+uvMin_[1]);
+}
+
+Vec3f PackedMesh::normal(int i) const
+{
+    return oct_decode(normals_[(size_t)i*2], normals_[(size_t)i*2+1]);
+}
+
+Vec3f PackedMesh::tangent(int frame) const
+{
+    return oct_decode(frames_[(size_t)frame*4], frames_[(size_t)frame*4+1]);
+}
+
+Vec3f PackedMesh::bitangent(int frame) const
+{
+    return oct_decode(frames_[(size_t)frame*4+2], frames_[(size_t)frame*4+3]);
+}
+
+void PackedMesh::decode_cluster(int cluster, int *out) const
+{
+    const uint8_t *p = indices_.data()+clusters_[cluster];
+    const int corners = std::min((int)kClusterFaces, nFaces_-cluster*kClusterFaces)*3;
+    int previous[kStreams] = {0, 0, 0, 0};
+    for (int i = 0; i < corners*kStreams; i++)
+    {
+        uint32_t v = 0;
+        for (int shift = 0;; shift += 7)
+        {
+            const uint8_t b = *p++;
+            v |= (uint32_t)(b & 0x7f) << shift;
+            if (!(b & 0x80)) break;
+        }
+        const int s = i%kStreams;
+        previous[s] += (int)(v >> 1) ^ -(int)(v & 1);
+        out[i] = previous[s];
+    }
+}
+
+const int *PackedMesh::corner(int iface, int nthvert) const
+{
+    const int cluster = iface/kClusterFaces;
+    if (cache.mesh != id_ || cache.cluster != cluster)
+    {
+        decode_cluster(cluster, cache.corners);
+        cache.mesh = id_;
+        cache.cluster = cluster;
+    }
+    return &cache.corners[((iface%kClusterFaces)*3+nthvert)*kStreams];
+}
+
+size_t PackedMesh::bytes() const
+{
+    return positions_.size()*sizeof(uint16_t)+uvs_.size()*sizeof(uint16_t)+normals_.size()*sizeof(int16_t)+frames_.size()*sizeof(int16_t)+
+           indices_.size()+clusters_.size()*sizeof(uint32_t);
+}
+
+PackedMesh::Error PackedMesh::error() const
+{
+    return error_;
+}
+
+//Rounding is off by half a step at most (and the decode by a float rounding). For the octahedral directions half a step on each
+//coordinate moves the point on the octahedron by sqrt(6)/2 steps at most, and normalizing
+//stretches that by sqrt(3) at most, where the octahedron is nearest to the center.
+PackedMesh::Error PackedMesh::error_bound() const
+{
+    Error bound;
+    bound.position = std::max(step_bound(posMin_[0], posScale_[0]), std::max(step_bound(posMin_[1], posScale_[1]), step_bound(posMin_[2], posScale_[2])));
+    bound.uv = std::max(step_bound(uvMin_[0], uvScale_[0]), step_bound(uvMin_[1], uvScale_[1]));
+    bound.normal = std::sqrt(18.f)*.5f/32767.f*180.f/(float)M_PI;
+    return bound;
+}
@@ -0,0 +1,83 @@
+//
+//  meshcodec.h
+//  TinyRenderer
+//
+//  Compressed triangle mesh. Positions are 16 bit fractions of the mesh's bounding box
+//  and uvs 16 bit fractions of theirs (unorm16 for uvs in [0, 1]). Normals, tangents and
+//  bitangents are octahedral encoded on two 16 bit snorms. Indices come in clusters of
+//  kClusterFaces faces; every corner stores its position, uv, normal and tangent frame
+//  indices as zigzag varints of the difference to the previous corner's.
+//  Everything decodes on access, so the mesh can be rendered without being unpacked:
+//  a thread keeps the indices of the last cluster it touched, and positions are turned
+//  back into floats with SSE2 when it is available.
+//
+
+#ifndef meshcodec_h
+#define meshcodec_h
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "geometry.h"
+
+class PackedMesh
+{
+public:
+    enum { kClusterFaces = 64 };
+    
+    //Largest differences between the source and the decoded streams
+    struct Error
+    {
+        float position; // model units, along any axis
+        float uv;       // along either axis
+        float normal;   // degrees, normals, tangents and bitangents alike
+    };
+    
+    //faces must be triangles. frames, tangents and bitangents may be empty.
+    PackedMesh(const std::vector<Vec3f> &verts, const std::vector<Vec2f> &uvs, const std::vector<Vec3f> &norms,
+               const std::vector<std::vector<Vec3i>> &faces, const std::vector<int> &frames,
+               const std::vector<Vec3f> &tangents, const std::vector<Vec3f> &bitangents);
+    PackedMesh(const PackedMesh&) = delete;
+    PackedMesh& operator=(const PackedMesh&) = delete;
+    
+    int nVerts() const;
+    int nTexCoords() const;
+    int nNorms() const;
+    int nFaces() const;
+    int nFrames() const;
+    Vec3f vert(int i) const;
+    Vec2f uv(int i) const;
+    Vec3f normal(int i) const;
+    Vec3f tangent(int frame) const;
+    Vec3f bitangent(int frame) const;
+    //Position, uv, normal and tangent frame index of a corner, -1 where the stream is missing.
+    //Points into a per thread cache, valid until the thread decodes another cluster.
+    const int *corner(int iface, int nthvert) const;
+    
+    size_t bytes() const;
+    //Measured when the mesh was packed, with the bounds each quantization guarantees
+    Error error() const;
+    Error error_bound() const;
+private:
+    unsigned id_; // cache key, unlike the address never reused by another mesh
+    int nVerts_;
+    int nTexCoords_;
+    int nNorms_;
+    int nFaces_;
+    int nFrames_;
+    float posMin_[4];
+    float posScale_[4];
+    float uvMin_[2];
+    float uvScale_[2];
+    std::vector<uint16_t> positions_; // 3 per vertex and one of padding for the 8 byte loads
+    std::vector<uint16_t> uvs_;
+    std::vector<int16_t> normals_;    // 2 per normal
+    std::vector<int16_t> frames_;     // 4 per tangent frame: tangent then bitangent
+    std::vector<uint8_t> indices_;
+    std::vector<uint32_t> clusters_;  // start of every cluster in indices_
+    Error error_;
+    
+    void decode_cluster(int cluster, int *out) const;
+};
+
+#endif /* meshcodec_h */
@@ -0,0 +1,258 @@
+//
+//  meshopt.cpp
+//  TinyRenderer
+//
+
+#include <algorithm>
+#include <cmath>
+#include "meshopt.h"
+
+namespace
+{
+const int   kCacheSize         = 32;
+const float kCacheDecayPower   = 1.5f;
+const float kLastTriScore      = 0.75f;
+const float kValenceBoostScale = 2.f;
+const float kValenceBoostPower = 0.5f;
+
+float vertex_score(int cachePos, int remaining)
+{
+    if (remaining == 0) return -1.f; // nothing left to draw with this vertex
+    float score = 0.f;
+    if (cachePos >= 0)
+    {
+        if (cachePos < 3)
+        {
+            score = kLastTriScore; // was used by the last triangle, no bonus to avoid strips
+        }
+        else
+        {
+            const float scaler = 1.f/(kCacheSize-3);
+            score = std::pow(1.f-(cachePos-3)*scaler, kCacheDecayPower);
+        }
+    }
+    //Low valence vertices get a boost so that lone triangles are not left behind
+    score += kValenceBoostScale*std::pow((float)remaining, -kValenceBoostPower);
+    return score;
+}
+
+//Simulates a FIFO cache using timestamps, returns the number of misses for the triangle
+int update_fifo(const int *tri, std::vector<unsigned int> &timestamps, unsigned int &timestamp, int cacheSize)
+{
+    int misses = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        if (timestamp-timestamps[tri[i]] > (unsigned int)cacheSize)
+        {
+            timestamps[tri[i]] = timestamp++;
+            misses++;
+        }
+    }
+    return misses;
+}
+}
+
+std::vector<int> optimize_vertex_cache(const std::vector<int> &indices, int nVerts)
+{
+    const int nTris = (int)indices.size()/3;
+    std::vector<int> order;
+    order.reserve(nTris);
+    if (nTris == 0) return order;
+    
+    //Vertex -> triangle adjacency stored as one flat array with per vertex offsets
+    std::vector<int> remaining(nVerts, 0);
+    for (int idx : indices) remaining[idx]++;
+    std::vector<int> offsets(nVerts+1, 0);
+    for (int v = 0; v < nVerts; v++) offsets[v+1] = offsets[v]+remaining[v];
+    std::vector<int> adjacency(indices.size());
+    std::vector<int> fill(offsets.begin(), offsets.end()-1);
+    for (int t = 0; t < nTris; t++)
+    {
+        for (int k = 0; k < 3; k++) adjacency[fill[indices[t*3+k]]++] = t;
+    }
+    
+    std::vector<int> cachePos(nVerts, -1);
+    std::vector<float> vScore(nVerts);
+    for (int v = 0; v < nVerts; v++) vScore[v] = vertex_score(-1, remaining[v]);
+    std::vector<float> tScore(nTris);
+    std::vector<char> emitted(nTris, 0);
+    for (int t = 0; t < nTris; t++)
+    {
+        tScore[t] = vScore[indices[t*3]]+vScore[indices[t*3+1]]+vScore[indices[t*3+2]];
+    }
+    
+    std::vector<int> cache, newCache;
+    cache.reserve(kCacheSize+3);
+    newCache.reserve(kCacheSize+3);
+    int best = (int)(std::max_element(tScore.begin(), tScore.end())-tScore.begin());
+    int cursor = 0;
+    while ((int)order.size() < nTris)
+    {
+        if (best < 0)
+        {
+            //Cache ran dry, fall back to the next triangle not emitted yet
+            while (emitted[cursor]) cursor++;
+            best = cursor;
+        }
+        const int *tri = &indices[best*3];
+        order.push_back(best);
+        emitted[best] = 1;
+        
+        newCache.clear();
+        for (int k = 0; k < 3; k++)
+        {
+            const int v = tri[k];
+            newCache.push_back(v);
+            //Drop the triangle from the vertex's live adjacency
+            int *adj = &adjacency[offsets[v]];
+            for (int j = 0; j < remaining[v]; j++)
+            {
+                if (adj[j] == best)
+                {
+                    std::swap(adj[j], adj[remaining[v]-1]);
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+        for (int v : cache)
+        {
+            if (v != tri[0] && v != tri[1] && v != tri[2]) newCache.push_back(v);
+        }
+        for (int i = kCacheSize; i < (int)newCache.size(); i++)
+        {
+            cachePos[newCache[i]] = -1;
+            vScore[newCache[i]] = vertex_score(-1, remaining[newCache[i]]);
+        }
+        if ((int)newCache.size() > kCacheSize) newCache.resize(kCacheSize);
+        for (int i = 0; i < (int)newCache.size(); i++)
+        {
+            cachePos[newCache[i]] = i;
+            vScore[newCache[i]] = vertex_score(i, remaining[newCache[i]]);
+        }
+        std::swap(cache, newCache);
+        
+        //Only triangles touching the cache changed score, pick the best among them
+        best = -1;
+        float bestScore = -1.f;
+        for (int v : cache)
+        {
+            const int *adj = &adjacency[offsets[v]];
+            for (int j = 0; j < remaining[v]; j++)
+            {
+                const int t = adj[j];
+                const float score = vScore[indices[t*3]]+vScore[indices[t*3+1]]+vScore[indices[t*3+2]];
+                tScore[t] = score;
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    best = t;
+                }
+            }
+        }
+    }
+    return order;
+}
+
+std::vector<int> optimize_overdraw(const std::vector<int> &indices, const std::vector<Vec3f> &verts, float threshold)
+{
+    const int nTris = (int)indices.size()/3;
+    const int nVerts = (int)verts.size();
+    const int cacheSize = 16;
+    
+    //Hard boundaries: all three vertices missed the cache, i.e. the cache optimizer jumped
+    std::vector<unsigned int> timestamps(nVerts, 0);
+    unsigned int timestamp = cacheSize+1;
+    std::vector<int> hard;
+    for (int t = 0; t < nTris; t++)
+    {
+        if (update_fifo(&indices[t*3], timestamps, timestamp, cacheSize) == 3 || t == 0) hard.push_back(t);
+    }
+    hard.push_back(nTris);
+    
+    //Soft boundaries: split a hard cluster where the prefix acmr is already close to the
+    //cluster's own acmr, so that splitting doesn't cost much vertex reuse
+    std::vector<int> clusters;
+    for (size_t c = 0; c+1 < hard.size(); c++)
+    {
+        const int start = hard[c], end = hard[c+1];
+        timestamp += cacheSize+1;
+        int misses = 0;
+        for (int t = start; t < end; t++) misses += update_fifo(&indices[t*3], timestamps, timestamp, cacheSize);
+        const float limit = threshold*misses/(end-start);
+        
+        timestamp += cacheSize+1;
+        int clusterStart = start;
+        misses = 0;
+        clusters.push_back(start);
+        for (int t = start; t < end; t++)
+        {
+            misses += update_fifo(&indices[t*3], timestamps, timestamp, cacheSize);
+            const int count = t-clusterStart+1;
+            if (t+1 < end && count >= 8 && (float)misses/count <= limit)
+            {
+                clusters.push_back(t+1);
+                clusterStart = t+1;
+                misses = 0;
+                timestamp += cacheSize+1;
+            }
+        }
+    }
+    clusters.push_back(nTris);
+    
+    //Sort key: how much the cluster faces away from the mesh center
+    Vec3f center;
+    for (const Vec3f &v : verts) center = center+v*(1.f/nVerts);
+    const int nClusters = (int)clusters.size()-1;
+    std::vector<float> keys(nClusters);
+    for (int c = 0; c < nClusters; c++)
+    {
+        Vec3f centroid, normal;
+        float area = 0.f;
+        for (int t = clusters[c]; t < clusters[c+1]; t++)
+        {
+            const Vec3f &a = verts[indices[t*3]], &b = verts[indices[t*3+1]], &d = verts[indices[t*3+2]];
+            Vec3f n = cross(b-a, d-a);
+            const float triArea = n.norm();
+            centroid = centroid+(a+b+d)*(triArea/3.f);
+            normal = normal+n;
+            area += triArea;
+        }
+        if (area > 0.f) centroid = centroid*(1.f/area);
+        const float len = normal.norm();
+        keys[c] = len > 0.f ? (centroid-center)*normal/len : 0.f;
+    }
+    std::vector<int> clusterOrder(nClusters);
+    for (int c = 0; c < nClusters; c++) clusterOrder[c] = c;
+    std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&keys](int a, int b) { return keys[a] > keys[b]; });
+    
+    std::vector<int> order;
+    order.reserve(nTris);
+    for (int c : clusterOrder)
+    {
+        for (int t = clusters[c]; t < clusters[c+1]; t++) order.push_back(t);
+    }
+    return order;
+}
+
+std::vector<int> optimize_vertex_fetch(const std::vector<int> &indices, int nVerts)
+{
+    std::vector<int> remap(nVerts, -1);
+    int next = 0;
+    for (int idx : indices)
+    {
+        if (remap[idx] < 0) remap[idx] = next++;
+    }
+    return remap;
+}
+
+float compute_acmr(const std::vector<int> &indices, int nVerts, int cacheSize)
+{
+    const int nTris = (int)indices.size()/3;
+    if (nTris == 0) return 0.f;
+    std::vector<unsigned int> timestamps(nVerts, 0);
+    unsigned int timestamp = cacheSize+1;
+    int misses = 0;
+    for (int t = 0; t < nTris; t++) misses += update_fifo(&indices[t*3], timestamps, timestamp, cacheSize);
+    return (float)misses/nTris;
+}
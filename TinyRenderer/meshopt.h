@@ -0,0 +1,30 @@
+//
+//  meshopt.h
+//  TinyRenderer
+//
+//  Triangle reordering for a mesh given as a flat triangle list (3 indices per face).
+//  Every function returns a permutation (new position -> old index) instead of touching
+//  the mesh so the caller can carry along whatever per-face data it has.
+//
+
+#ifndef meshopt_h
+#define meshopt_h
+
+#include <vector>
+#include "geometry.h"
+
+//Forsyth "linear-speed vertex cache optimisation", modelled on a 32 entry LRU cache
+std::vector<int> optimize_vertex_cache(const std::vector<int> &indices, int nVerts);
+
+//Sander/Nehab/Barczak style clustering: the cache ordered list is cut wherever the
+//simulated cache starts over, then clusters are sorted so that the outward facing ones
+//(likely occluders) get drawn first. threshold > 1 merges short clusters together.
+std::vector<int> optimize_overdraw(const std::vector<int> &indices, const std::vector<Vec3f> &verts, float threshold = 1.05f);
+
+//Vertex renumbering in order of first use: remap[old] = new, -1 for unused vertices
+std::vector<int> optimize_vertex_fetch(const std::vector<int> &indices, int nVerts);
+
+//Average cache miss ratio (misses per triangle) of a FIFO cache
+float compute_acmr(const std::vector<int> &indices, int nVerts, int cacheSize);
+
+#endif /* meshopt_h */
@@ -10,13 +10,143 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <filesystem>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
 #include "model.h"
+#include "meshopt.h"
+#include "threadpool.h"
+#include "profiler.h"
 
-Model::Model(const char *filename) : verts_(), faces_()
+namespace
 {
-    std::ifstream in;
-    in.open (filename, std::ifstream::in);
-    if (in.fail()) return;
+const char kCacheMagic[4] = {'T','R','M','S'};
+const int kCacheVersion = 2;
+const int kTangentBatch = 1024;
+
+struct CacheHeader
+{
+    char magic[4];
+    int version;
+    int optimized;
+    int nVerts;
+    int nTexCoords;
+    int nNorms;
+    int nFaces;
+    int nFrames;
+};
+
+//Bytes between the stream's position and its end, -1 when the stream can't tell
+std::streamoff remaining_bytes(std::istream &in)
+{
+    const std::streampos here = in.tellg();
+    if (here < 0) return -1;
+    in.seekg(0, std::ios::end);
+    const std::streampos end = in.tellg();
+    in.seekg(here);
+    if (end < 0 || !in.good()) return -1;
+    return end-here;
+}
+
+//Position, uv and normal index of a face corner, the corners compute_tangents welds
+struct CornerKey
+{
+    int v[3];
+    
+    bool operator==(const CornerKey &o) const { return v[0] == o.v[0] && v[1] == o.v[1] && v[2] == o.v[2]; }
+};
+
+struct CornerHash
+{
+    size_t operator()(const CornerKey &k) const
+    {
+        const uint64_t a = ((uint64_t)(uint32_t)k.v[0] << 32) | (uint32_t)k.v[1];
+        return std::hash<uint64_t>()(a ^ ((uint64_t)(uint32_t)k.v[2]*0x9E3779B97F4A7C15ull));
+    }
+};
+
+//The cache is only trusted when it was written after the obj was last touched
+bool cache_is_fresh(const std::string &obj, const std::string &cache)
+{
+    std::error_code ec;
+    auto objTime = std::filesystem::last_write_time(obj, ec);
+    if (ec) return false;
+    auto cacheTime = std::filesystem::last_write_time(cache, ec);
+    if (ec) return false;
+    return cacheTime >= objTime;
+}
+}
+
+Model::Model() : verts_(), texCoords_(), norms_(), faces_(), frames_(), tangents_(), bitangents_(), edges_(), diffusemap_(), normalmap_(), optimized_(false), packed_(nullptr)
+{}
+
+Model::Model(const char *filename, bool optimize) : Model()
+{
+    std::ifstream cache;
+    const std::string cacheFile = cache_file(filename, optimize);
+    if (!cacheFile.empty()) cache.open(cacheFile, std::ios::binary);
+    if (!load_mesh(filename, optimize, cache.is_open() ? &cache : nullptr, nullptr)) return;
+    load_texture(filename, "_diffuse.tga", diffusemap_);
+    load_texture(filename, "_nm_tangent.tga", normalmap_);
+}
+
+bool Model::load_mesh(const char *filename, bool optimize, std::istream *cache, std::istream *obj)
+{
+    if (cache && read_cache(*cache) && optimized_)
+    {
+        std::cerr << "vt: " << texCoords_.size() <<" v: " << verts_.size() << " f: "  << faces_.size() << " (cached)" << std::endl;
+        return true;
+    }
+    std::ifstream file;
+    if (!obj)
+    {
+        file.open(filename, std::ifstream::in);
+        if (file.fail()) return false;
+        obj = &file;
+    }
+    if (!parse_obj(*obj)) return false;
+    bool optimized = optimize && this->optimize();
+    compute_tangents();
+    if (optimized)
+    {
+        write_cache((std::string(filename)+".trmesh").c_str());
+    }
+    std::cerr << "vt: " << texCoords_.size() <<" v: " << verts_.size() << " f: "  << faces_.size() << std::endl;
+    return true;
+}
+
+std::string Model::cache_file(const char *filename, bool optimize)
+{
+    const std::string cache = std::string(filename)+".trmesh";
+    return optimize && cache_is_fresh(filename, cache) ? cache : std::string();
+}
+
+std::string Model::texture_file(const std::string &filename, const char *suffix)
+{
+    size_t dot = filename.find_last_of(".");
+    if (dot == std::string::npos) return std::string();
+    std::string texfile = filename.substr(0, dot) + std::string(suffix);
+    std::error_code ec;
+    return std::filesystem::exists(texfile, ec) ? texfile : std::string();
+}
+
+void Model::load_texture(std::string filename, const char *suffix, TGAImage &img)
+{
+    const std::string texfile = texture_file(filename, suffix);
+    if (texfile.empty()) return;
+    //uv (0,0) is the bottom left corner, which is the row order most TGA files are stored in
+    std::cerr << "texture file " << texfile << " loading " << (img.read_tga_file(texfile.c_str(), TGAImage::BOTTOM_LEFT) ? "ok" : "failed") << std::endl;
+}
+
+bool Model::parse_obj(std::istream &in)
+{
+    PROFILE_SCOPE("obj load");
+    verts_.clear();
+    texCoords_.clear();
+    norms_.clear();
+    faces_.clear();
     std::string line;
     while (!in.eof())
     {
@@ -32,16 +162,23 @@ Model::Model(const char *filename) : verts_(), faces_()
         }
         else if (!line.compare(0, 2, "f "))
         {
-            std::vector<int> f;
-            int itrash, idx;
+            std::vector<Vec3i> f;
+            Vec3i tmp;
             iss >> trash;
-            while (iss >> idx >> trash >> itrash >> trash >> itrash)
+            while (iss >> tmp[0] >> trash >> tmp[1] >> trash >> tmp[2])
             {
-                idx--; // in wavefront obj all indices start at 1, not zero
-                f.push_back(idx);
+                for (int i=0; i<3; i++) tmp[i]--; // in wavefront obj all indices start at 1, not zero
+                f.push_back(tmp);
             }
             faces_.push_back(f);
         }
+        else if (!line.compare(0, 3, "vn "))
+        {
+            iss >> trash >> trash;
+            Vec3f n;
+            for (int i=0;i<3;i++) iss >> n[i];
+            norms_.push_back(n);
+        }
         else if (!line.compare(0, 2, "vt"))
         {
             iss >> trash;
@@ -54,40 +191,515 @@ Model::Model(const char *filename) : verts_(), faces_()
             texCoords_.push_back(vt);
         }
     }
-    std::cerr << "vt: " << texCoords_.size() <<" v: " << verts_.size() << " f: "  << faces_.size() << std::endl;
+    return true;
+}
+
+//Same conventions as MikkTSpace: per corner tangents are projected on the corner normal and
+//weighted by the corner angle, corners sharing position, uv and normal are welded, and the
+//bitangent is sign*cross(n, t) with the sign taken from the accumulated uv derivatives.
+void Model::compute_tangents()
+{
+    PROFILE_SCOPE("tangents");
+    frames_.clear();
+    tangents_.clear();
+    bitangents_.clear();
+    const int nFaces = (int)faces_.size();
+    if (texCoords_.empty() || norms_.empty()) return;
+    for (const std::vector<Vec3i> &f : faces_)
+    {
+        if (f.size() != 3) return;
+        for (const Vec3i &corner : f) if (corner[1] < 0 || corner[2] < 0) return;
+    }
+    
+    //Weld corners into frames
+    std::unordered_map<CornerKey, int, CornerHash> keys;
+    frames_.resize(nFaces*3);
+    for (int i = 0; i < nFaces*3; i++)
+    {
+        const Vec3i &v = faces_[i/3][i%3];
+        auto it = keys.emplace(CornerKey{{v[0], v[1], v[2]}}, (int)keys.size()).first;
+        frames_[i] = it->second;
+    }
+    const int nFrames = (int)keys.size();
+    
+    //Per corner contributions, every triangle is independent
+    std::vector<Vec3f> cornerT(nFaces*3), cornerB(nFaces*3);
+    ThreadPool &pool = ThreadPool::instance();
+    pool.parallel_for((nFaces+kTangentBatch-1)/kTangentBatch, [&](int batch, int)
+    {
+        const int last = std::min(nFaces, (batch+1)*kTangentBatch);
+        for (int f = batch*kTangentBatch; f < last; f++)
+        {
+            Vec3f p[3];
+            Vec2f uv[3];
+            for (int i = 0; i < 3; i++)
+            {
+                p[i] = verts_[faces_[f][i][0]];
+                uv[i] = texCoords_[faces_[f][i][1]];
+            }
+            Vec3f e1 = p[1]-p[0], e2 = p[2]-p[0];
+            const float du1 = uv[1].x-uv[0].x, dv1 = uv[1].y-uv[0].y;
+            const float du2 = uv[2].x-uv[0].x, dv2 = uv[2].y-uv[0].y;
+            const float r = du1*dv2-du2*dv1;
+            Vec3f t, b;
+            if (std::abs(r) > 1e-12f)
+            {
+                t = (e1*dv2-e2*dv1)/r;
+                b = (e2*du1-e1*du2)/r;
+            }
+            for (int i = 0; i < 3; i++)
+            {
+                Vec3f n = norms_[faces_[f][i][2]];
+                n.normalize();
+                Vec3f a = p[(i+1)%3]-p[i], c = p[(i+2)%3]-p[i];
+                const float la = a.norm(), lc = c.norm();
+                const float angle = la > 0.f && lc > 0.f ? std::acos(std::max(-1.f, std::min(1.f, a*c/(la*lc)))) : 0.f;
+                Vec3f tp = t-n*(n*t);
+                const float len = tp.norm();
+                cornerT[f*3+i] = len > 0.f ? tp*(angle/len) : Vec3f();
+                cornerB[f*3+i] = b*angle;
+            }
+        }
+    });
+    
+    //Gather instead of scatter so that frames can be finished in parallel without atomics
+    std::vector<int> offsets(nFrames+1, 0);
+    for (int frame : frames_) offsets[frame+1]++;
+    for (int i = 0; i < nFrames; i++) offsets[i+1] += offsets[i];
+    std::vector<int> corners(nFaces*3);
+    std::vector<int> fill(offsets.begin(), offsets.end()-1);
+    for (int i = 0; i < nFaces*3; i++) corners[fill[frames_[i]]++] = i;
+    
+    tangents_.resize(nFrames);
+    bitangents_.resize(nFrames);
+    pool.parallel_for((nFrames+kTangentBatch-1)/kTangentBatch, [&](int batch, int)
+    {
+        const int last = std::min(nFrames, (batch+1)*kTangentBatch);
+        for (int frame = batch*kTangentBatch; frame < last; frame++)
+        {
+            Vec3f t, b;
+            for (int k = offsets[frame]; k < offsets[frame+1]; k++)
+            {
+                t = t+cornerT[corners[k]];
+                b = b+cornerB[corners[k]];
+            }
+            const int corner = corners[offsets[frame]];
+            Vec3f n = norms_[faces_[corner/3][corner%3][2]];
+            n.normalize();
+            t = t-n*(n*t);
+            if (t.norm() < 1e-12f)
+            {
+                //No usable uv derivatives, any direction orthogonal to the normal will do
+                t = cross(std::abs(n.x) < .9f ? Vec3f(1, 0, 0) : Vec3f(0, 1, 0), n);
+            }
+            t.normalize();
+            const float sign = cross(n, t)*b < 0.f ? -1.f : 1.f;
+            tangents_[frame] = t;
+            bitangents_[frame] = cross(n, t)*sign;
+        }
+    });
 }
 
 Model::~Model()
 {
+    delete packed_;
 }
 
 int Model::nVerts()
 {
-    return (int)verts_.size();
+    return packed_ ? packed_->nVerts() : (int)verts_.size();
 }
 
 int Model::nTexCoords()
 {
-    return (int)texCoords_.size();
+    return packed_ ? packed_->nTexCoords() : (int)texCoords_.size();
+}
+
+int Model::nNorms()
+{
+    return packed_ ? packed_->nNorms() : (int)norms_.size();
 }
 
 int Model::nFaces()
 {
-    return (int)faces_.size();
+    return packed_ ? packed_->nFaces() : (int)faces_.size();
 }
 
 std::vector<int> Model::face(int idx)
 {
-    return faces_[idx];
+    std::vector<int> face;
+    if (packed_)
+    {
+        for (int i=0; i<3; i++) face.push_back(packed_->corner(idx, i)[0]);
+        return face;
+    }
+    for (int i=0; i<(int)faces_[idx].size(); i++) face.push_back(faces_[idx][i][0]);
+    return face;
+}
+
+const std::vector<Vec2i> &Model::edges()
+{
+    if (!edges_.empty()) return edges_;
+    //Keyed by the two vertex indices, smaller first. Sorting brings the copies of a shared
+    //edge together behind their first use, the survivors are then put back in face order.
+    struct Use
+    {
+        uint64_t key;
+        int face;
+        int corner;
+    };
+    std::vector<Use> uses;
+    for (int f=0; f<nFaces(); f++)
+    {
+        const std::vector<int> vs = face(f);
+        const int n = (int)vs.size();
+        for (int c=0; c<n; c++)
+        {
+            const uint32_t a = (uint32_t)vs[c], b = (uint32_t)vs[(c+1)%n];
+            if (a == b) continue;
+            uses.push_back(Use{((uint64_t)std::min(a, b) << 32) | std::max(a, b), f, c});
+        }
+    }
+    std::sort(uses.begin(), uses.end(), [](const Use &l, const Use &r)
+    {
+        return l.key != r.key ? l.key < r.key : (l.face != r.face ? l.face < r.face : l.corner < r.corner);
+    });
+    for (size_t i=0; i<uses.size(); i++)
+    {
+        if (i == 0 || uses[i].key != uses[i-1].key) edges_.push_back(Vec2i(uses[i].face, uses[i].corner));
+    }
+    std::sort(edges_.begin(), edges_.end(), [](const Vec2i &l, const Vec2i &r) { return l.x != r.x ? l.x < r.x : l.y < r.y; });
+    return edges_;
 }
 
 Vec3f Model::vert(int i)
 {
-    return verts_[i];
+    return packed_ ? packed_->vert(i) : verts_[i];
+}
+
+Vec3f Model::vert(int iface, int nthvert)
+{
+    return packed_ ? packed_->vert(packed_->corner(iface, nthvert)[0]) : verts_[faces_[iface][nthvert][0]];
 }
 
 Vec2f Model::texCoords(int i)
 {
-    return texCoords_[i];
+    return packed_ ? packed_->uv(i) : texCoords_[i];
+}
+
+Vec3f Model::normal(int iface, int nthvert)
+{
+    if (packed_)
+    {
+        int idx = packed_->corner(iface, nthvert)[2];
+        return idx < 0 ? Vec3f(0, 0, 1) : packed_->normal(idx);
+    }
+    int idx = faces_[iface][nthvert][2];
+    return idx < 0 ? Vec3f(0, 0, 1) : norms_[idx];
+}
+
+Vec3f Model::tangent(int iface, int nthvert)
+{
+    if (packed_) return packed_->nFrames() ? packed_->tangent(packed_->corner(iface, nthvert)[3]) : Vec3f(1, 0, 0);
+    return tangents_.empty() ? Vec3f(1, 0, 0) : tangents_[frames_[iface*3+nthvert]];
+}
+
+Vec3f Model::bitangent(int iface, int nthvert)
+{
+    if (packed_) return packed_->nFrames() ? packed_->bitangent(packed_->corner(iface, nthvert)[3]) : Vec3f(0, 1, 0);
+    return bitangents_.empty() ? Vec3f(0, 1, 0) : bitangents_[frames_[iface*3+nthvert]];
+}
+
+bool Model::has_normalmap()
+{
+    return normalmap_.buffer() != nullptr && (packed_ ? packed_->nFrames() > 0 : !tangents_.empty());
+}
+
+Vec3f Model::normal(Vec2f uv)
+{
+    TGAColor c = normalmap_.get(uv.x*normalmap_.get_width(), uv.y*normalmap_.get_height());
+    return Vec3f(c[2]/255.f*2.f-1.f, c[1]/255.f*2.f-1.f, c[0]/255.f*2.f-1.f);
+}
+
+bool Model::has_diffuse()
+{
+    return diffusemap_.buffer() != nullptr;
+}
+
+TGAColor Model::diffuse(Vec2f uv)
+{
+    return diffusemap_.get(uv.x*diffusemap_.get_width(), uv.y*diffusemap_.get_height());
+}
+
+Vec2f Model::uv(int iface, int nthvert)
+{
+    if (packed_)
+    {
+        int idx = packed_->corner(iface, nthvert)[1];
+        return idx < 0 ? Vec2f() : packed_->uv(idx);
+    }
+    int idx = faces_[iface][nthvert][1];
+    return idx < 0 ? Vec2f() : texCoords_[idx];
+}
+
+bool Model::is_optimized()
+{
+    return optimized_;
+}
+
+float Model::acmr(int cacheSize)
+{
+    std::vector<int> indices;
+    indices.reserve(nFaces()*3);
+    for (int f=0; f<nFaces(); f++)
+    {
+        for (int v : face(f)) indices.push_back(v);
+    }
+    return compute_acmr(indices, nVerts(), cacheSize);
+}
+
+bool Model::compress()
+{
+    if (packed_) return true;
+    for (const std::vector<Vec3i> &f : faces_)
+    {
+        if (f.size() != 3)
+        {
+            std::cerr << "only triangle meshes can be compressed\n";
+            return false;
+        }
+    }
+    PROFILE_SCOPE("mesh compress");
+    packed_ = new PackedMesh(verts_, texCoords_, norms_, faces_, frames_, tangents_, bitangents_);
+    //Swapped out rather than cleared so that the memory is actually given back
+    std::vector<Vec3f>().swap(verts_);
+    std::vector<Vec2f>().swap(texCoords_);
+    std::vector<Vec3f>().swap(norms_);
+    std::vector<std::vector<Vec3i>>().swap(faces_);
+    std::vector<int>().swap(frames_);
+    std::vector<Vec3f>().swap(tangents_);
+    std::vector<Vec3f>().swap(bitangents_);
+    return true;
+}
+
+bool Model::is_compressed()
+{
+    return packed_ != nullptr;
+}
+
+const PackedMesh *Model::packed()
+{
+    return packed_;
+}
+
+size_t Model::mesh_bytes()
+{
+    if (packed_) return packed_->bytes();
+    size_t bytes = verts_.size()*sizeof(Vec3f)+texCoords_.size()*sizeof(Vec2f)+norms_.size()*sizeof(Vec3f);
+    for (const std::vector<Vec3i> &f : faces_) bytes += sizeof(f)+f.size()*sizeof(Vec3i);
+    bytes += frames_.size()*sizeof(int)+(tangents_.size()+bitangents_.size())*sizeof(Vec3f);
+    return bytes;
+}
+
+bool Model::optimize()
+{
+    if (packed_)
+    {
+        std::cerr << "a compressed mesh can't be optimized\n";
+        return false;
+    }
+    std::vector<int> indices;
+    indices.reserve(faces_.size()*3);
+    for (const std::vector<Vec3i> &f : faces_)
+    {
+        if (f.size() != 3) return false;
+        for (int i=0; i<3; i++) indices.push_back(f[i].x);
+    }
+    
+    float before = compute_acmr(indices, (int)verts_.size(), 16);
+    std::vector<int> order = optimize_vertex_cache(indices, (int)verts_.size());
+    std::vector<int> cacheIndices(indices.size());
+    for (size_t t=0; t<order.size(); t++)
+    {
+        for (int i=0; i<3; i++) cacheIndices[t*3+i] = indices[order[t]*3+i];
+    }
+    std::vector<int> clusterOrder = optimize_overdraw(cacheIndices, verts_);
+    
+    std::vector<std::vector<Vec3i>> faces(faces_.size());
+    for (size_t t=0; t<clusterOrder.size(); t++) faces[t] = faces_[order[clusterOrder[t]]];
+    faces_.swap(faces);
+    edges_.clear();
+    
+    //Renumber the position, uv and normal streams in first use order
+    for (int stream=0; stream<3; stream++)
+    {
+        int count = stream==0 ? nVerts() : (stream==1 ? nTexCoords() : nNorms());
+        std::vector<int> streamIndices;
+        streamIndices.reserve(faces_.size()*3);
+        for (const std::vector<Vec3i> &f : faces_)
+        {
+            for (const Vec3i &v : f) if (v[stream] >= 0) streamIndices.push_back(v[stream]);
+        }
+        std::vector<int> remap = optimize_vertex_fetch(streamIndices, count);
+        //Unreferenced entries keep their relative order at the end of the buffer
+        int next = 0;
+        for (int r : remap) if (r >= 0) next++;
+        for (int &r : remap) if (r < 0) r = next++;
+        for (std::vector<Vec3i> &f : faces_)
+        {
+            for (Vec3i &v : f) if (v[stream] >= 0) v[stream] = remap[v[stream]];
+        }
+        if (stream == 0)
+        {
+            std::vector<Vec3f> verts(verts_.size());
+            for (int i=0; i<count; i++) verts[remap[i]] = verts_[i];
+            verts_.swap(verts);
+        }
+        else if (stream == 1)
+        {
+            std::vector<Vec2f> texCoords(texCoords_.size());
+            for (int i=0; i<count; i++) texCoords[remap[i]] = texCoords_[i];
+            texCoords_.swap(texCoords);
+        }
+        else
+        {
+            std::vector<Vec3f> norms(norms_.size());
+            for (int i=0; i<count; i++) norms[remap[i]] = norms_[i];
+            norms_.swap(norms);
+        }
+    }
+    optimized_ = true;
+    std::cerr << "acmr: " << before << " -> " << acmr(16) << std::endl;
+    return true;
+}
+
+bool Model::write_cache(const char *filename)
+{
+    if (packed_)
+    {
+        std::cerr << "a compressed mesh can't be cached\n";
+        return false;
+    }
+    std::ofstream out;
+    out.open(filename, std::ios::binary);
+    if (!out.is_open())
+    {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    CacheHeader header;
+    std::copy(kCacheMagic, kCacheMagic+4, header.magic);
+    header.version = kCacheVersion;
+    header.optimized = optimized_;
+    header.nVerts = nVerts();
+    header.nTexCoords = nTexCoords();
+    header.nNorms = nNorms();
+    header.nFaces = nFaces();
+    header.nFrames = (int)tangents_.size();
+    out.write((char *)&header, sizeof(header));
+    
+    std::vector<float> floats;
+    for (Vec3f &v : verts_) for (int i=0; i<3; i++) floats.push_back(v[i]);
+    for (Vec2f &v : texCoords_) for (int i=0; i<2; i++) floats.push_back(v[i]);
+    for (Vec3f &v : norms_) for (int i=0; i<3; i++) floats.push_back(v[i]);
+    for (Vec3f &v : tangents_) for (int i=0; i<3; i++) floats.push_back(v[i]);
+    for (Vec3f &v : bitangents_) for (int i=0; i<3; i++) floats.push_back(v[i]);
+    out.write((char *)floats.data(), floats.size()*sizeof(float));
+    
+    std::vector<int> ints;
+    for (const std::vector<Vec3i> &f : faces_)
+    {
+        if (f.size() != 3)
+        {
+            std::cerr << "only triangle meshes can be cached\n";
+            return false;
+        }
+        for (const Vec3i &v : f) for (int i=0; i<3; i++) ints.push_back(v[i]);
+    }
+    if (!tangents_.empty()) ints.insert(ints.end(), frames_.begin(), frames_.end());
+    out.write((char *)ints.data(), ints.size()*sizeof(int));
+    if (!out.good())
+    {
+        std::cerr << "can't dump the mesh cache\n";
+        return false;
+    }
+    return true;
+}
+
+bool Model::read_cache(const char *filename)
+{
+    if (packed_) return false;
+    std::ifstream in;
+    in.open(filename, std::ios::binary);
+    if (!in.is_open()) return false;
+    return read_cache(in);
 }
 
+bool Model::read_cache(std::istream &in)
+{
+    if (packed_) return false;
+    PROFILE_SCOPE("obj load");
+    CacheHeader header;
+    in.read((char *)&header, sizeof(header));
+    if (!in.good() || !std::equal(kCacheMagic, kCacheMagic+4, header.magic) || header.version != kCacheVersion)
+    {
+        return false;
+    }
+    //The counts have to describe exactly what follows the header before anything is sized by them
+    const long long nFloats = (long long)header.nVerts*3+(long long)header.nTexCoords*2+(long long)header.nNorms*3+(long long)header.nFrames*6;
+    const long long nInts = (long long)header.nFaces*(header.nFrames ? 12 : 9);
+    const std::streamoff left = remaining_bytes(in);
+    if (header.nVerts < 0 || header.nTexCoords < 0 || header.nNorms < 0 || header.nFaces < 0 || header.nFrames < 0
+        || header.nFrames > (long long)header.nFaces*3 || left < 0 || (nFloats+nInts)*4 != left)
+    {
+        std::cerr << "the mesh cache is corrupt\n";
+        return false;
+    }
+    std::vector<float> floats((size_t)nFloats);
+    std::vector<int> ints((size_t)nInts);
+    in.read((char *)floats.data(), floats.size()*sizeof(float));
+    in.read((char *)ints.data(), ints.size()*sizeof(int));
+    if (!in.good())
+    {
+        std::cerr << "an error occured while reading the mesh cache\n";
+        return false;
+    }
+    //Positions must exist, a missing uv or normal is -1
+    const int counts[3] = {header.nVerts, header.nTexCoords, header.nNorms};
+    for (long long i = 0; i < (long long)header.nFaces*9; i++)
+    {
+        const int c = (int)(i%3);
+        if (ints[i] < (c ? -1 : 0) || ints[i] >= counts[c])
+        {
+            std::cerr << "the mesh cache is corrupt\n";
+            return false;
+        }
+    }
+    for (long long i = (long long)header.nFaces*9; i < nInts; i++)
+    {
+        if (ints[i] < 0 || ints[i] >= header.nFrames)
+        {
+            std::cerr << "the mesh cache is corrupt\n";
+            return false;
+        }
+    }
+    const float *f = floats.data();
+    verts_.resize(header.nVerts);
+    for (Vec3f &v : verts_) for (int i=0; i<3; i++) v[i] = *f++;
+    texCoords_.resize(header.nTexCoords);
+    for (Vec2f &v : texCoords_) for (int i=0; i<2; i++) v[i] = *f++;
+    norms_.resize(header.nNorms);
+    for (Vec3f &v : norms_) for (int i=0; i<3; i++) v[i] = *f++;
+    tangents_.resize(header.nFrames);
+    for (Vec3f &v : tangents_) for (int i=0; i<3; i++) v[i] = *f++;
+    bitangents_.resize(header.nFrames);
+    for (Vec3f &v : bitangents_) for (int i=0; i<3; i++) v[i] = *f++;
+    faces_.assign(header.nFaces, std::vector<Vec3i>(3));
+    edges_.clear();
+    const int *idx = ints.data();
+    for (std::vector<Vec3i> &face : faces_) for (Vec3i &v : face) for (int i=0; i<3; i++) v[i] = *idx++;
+    if (header.nFrames) frames_.assign(idx, idx+header.nFaces*3);
+    else frames_.clear();
+    optimized_ = header.optimized != 0;
+    return true;
+}
@@ -9,16 +9,43 @@
 #define model_h
 
 #include <vector>
+#include <string>
 #include "geometry.h"
+#include "tgaimage.h"
+#include "meshcodec.h"
 
 class Model
 {
 private:
     std::vector<Vec3f> verts_;
     std::vector<Vec2f> texCoords_;
-    std::vector<std::vector<int>> faces_;
+    std::vector<Vec3f> norms_;
+    std::vector<std::vector<Vec3i>> faces_; // Vec3i is vertex/uv/normal index, -1 when missing
+    std::vector<int> frames_;               // tangent frame of every face corner, nFaces*3
+    std::vector<Vec3f> tangents_;
+    std::vector<Vec3f> bitangents_;
+    std::vector<Vec2i> edges_;              // built by edges() on first use
+    TGAImage diffusemap_;
+    TGAImage normalmap_;
+    bool optimized_;
+    PackedMesh *packed_;                    // replaces the streams above once compressed
+    
+    Model();
+    bool parse_obj(std::istream &in);
+    bool read_cache(std::istream &in);
+    //Mesh half of the constructor from the already opened .trmesh cache or obj, either may
+    //be null: the obj is then opened from fileName if the cache isn't there or usable
+    bool load_mesh(const char *fileName, bool optimize, std::istream *cache, std::istream *obj);
+    //The .trmesh to load instead of the obj, empty unless optimize and it is up to date
+    static std::string cache_file(const char *fileName, bool optimize);
+    //The obj's texture with the given suffix, empty when there is none
+    static std::string texture_file(const std::string &fileName, const char *suffix);
+    void load_texture(std::string fileName, const char *suffix, TGAImage &img);
+    void compute_tangents();
+    
+    friend class AssetLoader;
 public:
-    Model(const char* const fileName);
+    Model(const char* const fileName, bool optimize = false);
     Model(const Model&) =delete;
     Model& operator=(const Model&) = delete;
     Model(Model&&) = delete;
@@ -27,10 +54,42 @@ public:
     
     int nVerts();
     int nTexCoords();
+    int nNorms();
     int nFaces();
     Vec3f vert(int i);
+    Vec3f vert(int iface, int nthvert);
     Vec2f texCoords(int i);
+    Vec2f uv(int iface, int nthvert);
+    Vec3f normal(int iface, int nthvert);
+    Vec3f tangent(int iface, int nthvert);
+    Vec3f bitangent(int iface, int nthvert);
+    bool has_diffuse();
+    TGAColor diffuse(Vec2f uv);
+    bool has_normalmap();
+    //Tangent space normal from the _nm_tangent map
+    Vec3f normal(Vec2f uv);
     std::vector<int> face(int idx);
+    //Every edge once, even when several faces share it, as the (face, corner) of its first
+    //use: the edge runs from that corner to the face's next one. Built on the first call.
+    const std::vector<Vec2i> &edges();
+    
+    //Reorders faces for post-transform cache locality and overdraw, then renumbers
+    //every vertex stream in first-use order. Only triangle meshes are touched.
+    bool optimize();
+    bool is_optimized();
+    //Cache acmr of the current face order for a FIFO cache of the given size
+    float acmr(int cacheSize = 16);
+    
+    //Replaces the vertex and index streams with their PackedMesh form, decoded on access.
+    //Only triangle meshes; optimize or read the cache first, neither works afterwards.
+    bool compress();
+    bool is_compressed();
+    const PackedMesh *packed();
+    //Bytes held by the vertex and index streams, in whichever form they are in
+    size_t mesh_bytes();
+    
+    bool read_cache(const char *fileName);
+    bool write_cache(const char *fileName);
 };
 
 
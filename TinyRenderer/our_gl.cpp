@@ -0,0 +1,187 @@
+//
+//  our_gl.cpp
+//  TinyRenderer
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include "our_gl.h"
+#include "tonemap.h"
+
+Matrix4f viewport(int x, int y, int w, int h)
+{
+    Matrix4f m = Matrix4f::identity();
+    m[0][3] = x+w/2.f;
+    m[1][3] = y+h/2.f;
+    m[0][0] = w/2.f;
+    m[1][1] = h/2.f;
+    return m;
+}
+
+Matrix4f projection(float coeff)
+{
+    Matrix4f m = Matrix4f::identity();
+    m[3][2] = coeff;
+    return m;
+}
+
+Vec2f depth_range(float coeff, float radius)
+{
+    //lookat puts center at z = 0, so the scene spans [-radius, radius] and w is 1+coeff*z
+    return Vec2f(-radius/(1.f-coeff*radius), radius/(1.f+coeff*radius));
+}
+
+Matrix4f lookat(Vec3f eye, Vec3f center, Vec3f up)
+{
+    Vec3f z = (eye-center).normalize();
+    Vec3f x = cross(up, z).normalize();
+    Vec3f y = cross(z, x).normalize();
+    Matrix4f m = Matrix4f::identity();
+    for (int i = 0; i < 3; i++)
+    {
+        m[0][i] = x[i];
+        m[1][i] = y[i];
+        m[2][i] = z[i];
+    }
+    //Rotation after moving the center to the origin
+    for (int i = 0; i < 3; i++)
+    {
+        m[i][3] = -(m[i][0]*center.x+m[i][1]*center.y+m[i][2]*center.z);
+    }
+    return m;
+}
+
+namespace
+{
+long long floor_div(long long a, long long b)
+{
+    return a/b-((a%b != 0) && ((a < 0) != (b < 0)));
+}
+}
+
+//Bresenham along the major axis. The minor offset after k steps has a closed form, so the
+//walk starts and stops at the image edges instead of stepping over the off-screen part,
+//and still lights exactly the pixels of a walk from the first endpoint. Pixels are written
+//straight into the rows.
+void line(int x0, int y0, int x1, int y1, TGAImage &image, TGAColor color)
+{
+    unsigned char *data = image.buffer();
+    const int width = image.get_width(), height = image.get_height(), bpp = image.get_bytespp();
+    if (!data) return;
+    bool steep = false;
+    if (std::abs(x0-x1)<std::abs(y0-y1))
+    {
+        std::swap(x0, y0);
+        std::swap(x1, y1);
+        steep = true;
+    }
+    if (x0>x1)
+    {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+    }
+    const int majorSize = steep ? height : width, minorSize = steep ? width : height;
+    const long long dx = (long long)x1-x0, dy = std::abs((long long)y1-y0);
+    const int sy = y1 > y0 ? 1 : -1;
+    if (dx == 0)
+    {
+        if (x0 >= 0 && x0 < majorSize && y0 >= 0 && y0 < minorSize)
+        {
+            memcpy(data+(steep ? y0+(size_t)x0*width : x0+(size_t)y0*width)*bpp, color.bgra, bpp);
+        }
+        return;
+    }
+    //After k steps the minor axis has moved m(k) = floor((2dy*k+dx-1)/(2dx)) pixels
+    long long kmin = std::max(0LL, -(long long)x0), kmax = std::min(dx, (long long)majorSize-1-x0);
+    const long long mlo = sy > 0 ? -(long long)y0 : (long long)y0-(minorSize-1);
+    const long long mhi = sy > 0 ? (long long)minorSize-1-y0 : (long long)y0;
+    if (dy == 0)
+    {
+        if (mlo > 0 || mhi < 0) return;
+    }
+    else
+    {
+        kmin = std::max(kmin, -floor_div(-(2*dx*mlo-dx+1), 2*dy)); // first k with m(k) >= mlo
+        kmax = std::min(kmax, floor_div(2*dx*(mhi+1)-dx, 2*dy));    // last k with m(k) <= mhi
+    }
+    if (kmin > kmax) return;
+    
+    long long m = floor_div(2*dy*kmin+dx-1, 2*dx);
+    long long error2 = 2*dy*kmin-2*dx*m;
+    const int major = x0+(int)kmin, minor = y0+sy*(int)m;
+    unsigned char *p = data+(steep ? minor+(size_t)major*width : major+(size_t)minor*width)*bpp;
+    const ptrdiff_t stepMajor = steep ? (ptrdiff_t)width*bpp : bpp;
+    const ptrdiff_t stepMinor = steep ? (ptrdiff_t)sy*bpp : (ptrdiff_t)sy*width*bpp;
+    for (long long k = kmin; k <= kmax; k++)
+    {
+        memcpy(p, color.bgra, bpp);
+        p += stepMajor;
+        error2 += 2*dy;
+        if (error2 > dx)
+        {
+            p += stepMinor;
+            error2 -= dx*2;
+        }
+    }
+}
+
+bool IShader::fragment_hdr(int iface, Vec3f bar, Vec3f &color) const
+{
+    TGAColor c;
+    if (fragment(iface, bar, c)) return true;
+    color = srgb_to_linear(c);
+    return false;
+}
+
+Vec3f barycentric(Vec3f A, Vec3f B, Vec3f C, Vec3f P)
+{
+    Vec3f s[2];
+    for (int i=2; i--; )
+    {
+        s[i][0] = C[i]-A[i];
+        s[i][1] = B[i]-A[i];
+        s[i][2] = A[i]-P[i];
+    }
+    Vec3f u = cross(s[0], s[1]);
+    if (std::abs(u[2])>1e-2) // dont forget that u[2] is integer. If it is zero then triangle ABC is degenerate
+        return Vec3f(1.f-(u.x+u.y)/u.z, u.y/u.z, u.x/u.z);
+    return Vec3f(-1,1,1); // in this case generate negative coordinates, it will be thrown away by the rasterizator
+}
+
+void triangle(Vec3f *pts, float *zBuffer, TGAImage &image, TGAColor color)
+{
+    const int width = image.get_width();
+    Vec2f bboxmin( std::numeric_limits<float>::max(),  std::numeric_limits<float>::max());
+    Vec2f bboxmax(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+    Vec2f clamp(image.get_width()-1, image.get_height()-1);
+    for (int i=0; i<3; i++)
+    {
+        for (int j=0; j<2; j++)
+        {
+            bboxmin[j] = std::max(0.f,      std::min(bboxmin[j], pts[i][j]));
+            bboxmax[j] = std::min(clamp[j], std::max(bboxmax[j], pts[i][j]));
+        }
+    }
+    Vec3f P;
+    for (P.x=bboxmin.x; P.x<=bboxmax.x; P.x++)
+    {
+        for (P.y=bboxmin.y; P.y<=bboxmax.y; P.y++)
+        {
+            Vec3f bc_screen  = barycentric(pts[0], pts[1], pts[2], P);
+            if (bc_screen.x<0 || bc_screen.y<0 || bc_screen.z<0) continue;
+            P.z = 0;
+            for (int i=0; i<3; i++)
+            {
+                P.z += pts[i][2]*bc_screen[i];
+            }
+            if (zBuffer[int(P.x+P.y*width)]<P.z)
+            {
+                zBuffer[int(P.x+P.y*width)] = P.z;
+                image.set(P.x, P.y, color);
+            }
+        }
+    }
+    
+}
@@ -0,0 +1,37 @@
+//
+//  our_gl.h
+//  TinyRenderer
+//
+
+#ifndef our_gl_h
+#define our_gl_h
+
+#include "tgaimage.h"
+#include "geometry.h"
+
+Matrix4f viewport(int x, int y, int w, int h);
+//coeff = -1/c where c is the camera distance, 0 gives an orthographic projection
+Matrix4f projection(float coeff);
+Matrix4f lookat(Vec3f eye, Vec3f center, Vec3f up);
+//z after the perspective divide of projection(coeff)*lookat(..., center, ...) over a scene within
+//radius of center, as (far, near). The compact depth formats are mapped to this range.
+Vec2f depth_range(float coeff, float radius);
+
+struct IShader
+{
+    virtual ~IShader() {}
+    //Returns the clip space position of a corner. Called from several threads at once.
+    virtual Vec4f vertex(int iface, int nthvert) const = 0;
+    //bar is perspective correct. Return true to discard the fragment. Called from several threads at once.
+    virtual bool fragment(int iface, Vec3f bar, TGAColor &color) const = 0;
+    //Linear rgb for HDR frames (see Renderer::set_hdr), any brightness. By default the color
+    //of fragment() read as sRGB.
+    virtual bool fragment_hdr(int iface, Vec3f bar, Vec3f &color) const;
+};
+
+void line(int x0, int y0, int x1, int y1, TGAImage &image, TGAColor color);
+Vec3f barycentric(Vec3f A, Vec3f B, Vec3f C, Vec3f P);
+//Plain single threaded rasterizer, kept as the reference for the binned Renderer
+void triangle(Vec3f *pts, float *zBuffer, TGAImage &image, TGAColor color);
+
+#endif /* our_gl_h */
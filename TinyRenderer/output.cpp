@@ -0,0 +1,193 @@
+//
+//  output.cpp
+//  TinyRenderer
+//
+
+#include <cstring>
+#include <iostream>
+#include "output.h"
+#include "profiler.h"
+
+FileOutput::FileOutput(const char *path)
+: file_(nullptr), owned_(strcmp(path, "-") != 0)
+{
+    file_ = owned_ ? fopen(path, "wb") : stdout;
+    if (!file_) std::cerr << "can't open file " << path << "\n";
+}
+
+FileOutput::FileOutput(int fd)
+: file_(fdopen(fd, "wb")), owned_(true)
+{
+    if (!file_) std::cerr << "can't open descriptor " << fd << "\n";
+}
+
+FileOutput::~FileOutput()
+{
+    if (!file_) return;
+    if (owned_) fclose(file_);
+    else fflush(file_);
+}
+
+bool FileOutput::is_open()
+{
+    return file_ != nullptr;
+}
+
+bool FileOutput::write(const void *data, size_t size)
+{
+    return file_ && fwrite(data, 1, size, file_) == size;
+}
+
+bool FileOutput::flush()
+{
+    return file_ && fflush(file_) == 0;
+}
+
+bool BufferOutput::write(const void *data, size_t size)
+{
+    buffer_.append((const char *)data, size);
+    return true;
+}
+
+FrameWriter::FrameWriter(OutputStream &out, Format format, int width, int height)
+: out_(out), format_(format), width_(width), height_(height), rows_(0), origin_(TGAImage::TOP_LEFT), row_(), packets_()
+{
+    row_.resize((size_t)width_*4);
+    //worst case is raw packets, one header every 128 pixels
+    if (format_ == TGA_RLE) packets_.resize((size_t)width_*3+width_/128+1);
+}
+
+bool FrameWriter::parse_format(const std::string &name, Format &format)
+{
+    if (name == "rgb") format = RGB;
+    else if (name == "rgba") format = RGBA;
+    else if (name == "ppm") format = PPM;
+    else if (name == "tga") format = TGA_RLE;
+    else if (name == "tga-raw") format = TGA;
+    else return false;
+    return true;
+}
+
+FrameWriter::Format FrameWriter::format_for(const std::string &fileName)
+{
+    size_t dot = fileName.rfind('.');
+    Format format = TGA_RLE;
+    if (dot != std::string::npos) parse_format(fileName.substr(dot+1), format);
+    return format;
+}
+
+int FrameWriter::get_width()
+{
+    return width_;
+}
+
+int FrameWriter::get_height()
+{
+    return height_;
+}
+
+bool FrameWriter::begin()
+{
+    rows_ = 0;
+    if (format_ == PPM)
+    {
+        char header[64];
+        int n = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width_, height_);
+        return out_.write(header, n);
+    }
+    if (format_ == TGA || format_ == TGA_RLE)
+    {
+        TGA_Header header;
+        memset((void *)&header, 0, sizeof(header));
+        header.bitsperpixel = 24;
+        header.width = width_;
+        header.height = height_;
+        header.datatypecode = format_ == TGA_RLE ? 10 : 2;
+        header.imagedescriptor = origin_ == TGAImage::TOP_LEFT ? 0x20 : 0x00;
+        return out_.write(&header, sizeof(header));
+    }
+    return true;
+}
+
+//Packets never cross a row, which the TGA 2.0 spec recommends and row streaming needs
+bool FrameWriter::encode_rle(const unsigned char *bgr)
+{
+    size_t size = 0;
+    int x = 0;
+    auto same = [&](int a, int b) { return !memcmp(bgr+a*3, bgr+b*3, 3); };
+    while (x < width_)
+    {
+        int run = 1;
+        while (x+run < width_ && run < 128 && same(x, x+run)) run++;
+        if (run > 1)
+        {
+            packets_[size++] = (unsigned char)(0x80|(run-1));
+            memcpy(&packets_[size], bgr+x*3, 3);
+            size += 3;
+            x += run;
+            continue;
+        }
+        int raw = 1;
+        while (x+raw < width_ && raw < 128 && !(x+raw+1 < width_ && same(x+raw, x+raw+1))) raw++;
+        packets_[size++] = (unsigned char)(raw-1);
+        memcpy(&packets_[size], bgr+x*3, raw*3);
+        size += raw*3;
+        x += raw;
+    }
+    return out_.write(packets_.data(), size);
+}
+
+bool FrameWriter::write_row(const unsigned char *pixels, int bytespp)
+{
+    if (rows_ >= height_) return false;
+    rows_++;
+    const bool bgr = format_ == TGA || format_ == TGA_RLE;
+    const int channels = format_ == RGBA ? 4 : 3;
+    //already in the output layout, nothing to convert
+    if (bgr && bytespp == 3) return format_ == TGA ? out_.write(pixels, (size_t)width_*3) : encode_rle(pixels);
+    unsigned char *dst = row_.data();
+    for (int x = 0; x < width_; x++, pixels += bytespp, dst += channels)
+    {
+        unsigned char b = pixels[0], g = bytespp == 1 ? b : pixels[1], r = bytespp == 1 ? b : pixels[2];
+        dst[0] = bgr ? b : r;
+        dst[1] = g;
+        dst[2] = bgr ? r : b;
+        if (channels == 4) dst[3] = bytespp == 4 ? pixels[3] : 255;
+    }
+    return format_ == TGA_RLE ? encode_rle(row_.data()) : out_.write(row_.data(), (size_t)width_*channels);
+}
+
+bool FrameWriter::end()
+{
+    if (rows_ != height_)
+    {
+        std::cerr << "frame ended after " << rows_ << " of " << height_ << " rows\n";
+        return false;
+    }
+    if (format_ == TGA || format_ == TGA_RLE)
+    {
+        unsigned char developer_area_ref[4] = {0, 0, 0, 0};
+        unsigned char extension_area_ref[4] = {0, 0, 0, 0};
+        unsigned char footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
+        if (!out_.write(developer_area_ref, sizeof(developer_area_ref)) || !out_.write(extension_area_ref, sizeof(extension_area_ref))
+            || !out_.write(footer, sizeof(footer))) return false;
+    }
+    return out_.flush();
+}
+
+bool FrameWriter::write_image(TGAImage &image)
+{
+    if (image.get_width() != width_ || image.get_height() != height_ || !image.buffer()) return false;
+    PROFILE_SCOPE("encode");
+    const int bytespp = image.get_bytespp();
+    origin_ = format_ == TGA || format_ == TGA_RLE ? image.get_origin() : TGAImage::TOP_LEFT;
+    const bool backwards = origin_ != image.get_origin();
+    bool ok = begin();
+    for (int i = 0; ok && i < height_; i++)
+    {
+        const int y = backwards ? height_-1-i : i;
+        ok = write_row(image.buffer()+(size_t)y*width_*bytespp, bytespp);
+    }
+    origin_ = TGAImage::TOP_LEFT;
+    return ok && end();
+}
@@ -0,0 +1,93 @@
+//
+//  output.h
+//  TinyRenderer
+//
+//  Frame output without a round trip through a file: encoders write row by row into an
+//  OutputStream, which can be stdout, a file or fifo, a pipe descriptor or a memory buffer.
+//
+
+#ifndef output_h
+#define output_h
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "tgaimage.h"
+
+class OutputStream
+{
+public:
+    virtual ~OutputStream() {}
+    virtual bool write(const void *data, size_t size) = 0;
+    virtual bool flush() { return true; }
+};
+
+//A named file or fifo, "-" for stdout, or a descriptor that is already open (a pipe end)
+class FileOutput : public OutputStream
+{
+private:
+    FILE *file_;
+    bool owned_;
+public:
+    FileOutput(const char *path);
+    FileOutput(int fd);
+    FileOutput(const FileOutput&) = delete;
+    FileOutput& operator=(const FileOutput&) = delete;
+    ~FileOutput();
+    
+    bool is_open();
+    virtual bool write(const void *data, size_t size);
+    virtual bool flush();
+};
+
+//Appends to a caller owned buffer, which keeps its capacity from one frame to the next
+class BufferOutput : public OutputStream
+{
+private:
+    std::string &buffer_;
+public:
+    BufferOutput(std::string &buffer) : buffer_(buffer) {}
+    virtual bool write(const void *data, size_t size);
+};
+
+//Encodes one frame: begin(), write_row() for every row from the top, end().
+//Rows come in TGAImage's layout (BGR, BGRA or grayscale) and are converted on the fly,
+//only one row is ever buffered.
+class FrameWriter
+{
+public:
+    enum Format {
+        RGB, RGBA, PPM, TGA, TGA_RLE
+    };
+    
+    FrameWriter(OutputStream &out, Format format, int width, int height);
+    
+    //"rgb", "rgba", "ppm", "tga" (RLE) or "tga-raw"
+    static bool parse_format(const std::string &name, Format &format);
+    //Format matching a file name's extension, TGA with RLE when it has none we know
+    static Format format_for(const std::string &fileName);
+    
+    bool begin();
+    bool write_row(const unsigned char *pixels, int bytespp);
+    bool end();
+    //A whole frame from an image. TGA output keeps the image's row order and origin, like
+    //write_tga_file; the other formats are top down and read bottom up images backwards.
+    //Either way no flip is needed.
+    bool write_image(TGAImage &image);
+    
+    int get_width();
+    int get_height();
+private:
+    OutputStream &out_;
+    Format format_;
+    int width_;
+    int height_;
+    int rows_;
+    int origin_;                         // of the rows passed to write_row, TGA only
+    std::vector<unsigned char> row_;     // converted pixels
+    std::vector<unsigned char> packets_; // RLE packets of a row
+    
+    bool encode_rle(const unsigned char *bgr);
+};
+
+#endif /* output_h */
@@ -0,0 +1,243 @@
+//
+//  postprocess.cpp
+//  TinyRenderer
+//
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "postprocess.h"
+#include "threadpool.h"
+#include "profiler.h"
+
+namespace
+{
+const int kBandHeight = 16;
+const int kBlockWidth = 64;
+const int kSlices = 4;        // each slice is a pair of opposite directions
+const int kSteps = 4;
+const int kBlurRadius = 4;
+const float kBackground = -std::numeric_limits<float>::max();
+
+//The slice directions rotate with a 4x4 pattern, the blur averages the pattern away
+const float kJitter[16] = {0.f, .5f, .125f, .625f, .75f, .25f, .875f, .375f, .1875f, .6875f, .0625f, .5625f, .9375f, .4375f, .8125f, .3125f};
+}
+
+AmbientOcclusion::AmbientOcclusion(int width, int height, bool halfRes)
+: width_(width), height_(height), scale_(halfRes ? 2 : 1), aoWidth_((width+scale_-1)/scale_), aoHeight_((height+scale_-1)/scale_),
+  radius_(24.f), strength_(1.5f), directions_(), depth_(), ao_(), tmp_()
+{
+    for (int j = 0; j < 16; j++)
+    {
+        for (int s = 0; s < kSlices; s++)
+        {
+            const float angle = (s+kJitter[j])*(float)M_PI/kSlices;
+            directions_.push_back(Vec2f(std::cos(angle), std::sin(angle)));
+        }
+    }
+    depth_.resize((size_t)aoWidth_*aoHeight_);
+    ao_.resize(depth_.size());
+    tmp_.resize(depth_.size());
+}
+
+void AmbientOcclusion::set_radius(float pixels)
+{
+    radius_ = pixels;
+}
+
+void AmbientOcclusion::set_strength(float strength)
+{
+    strength_ = strength;
+}
+
+const std::vector<float> &AmbientOcclusion::occlusion()
+{
+    return ao_;
+}
+
+void AmbientOcclusion::gather_depth(const DepthBuffer &depth, int samples, float depthScale)
+{
+    //Depth goes to pixel units so that the horizon angles are isotropic. At half resolution
+    //the nearest of the four pixels is kept so thin foreground objects survive.
+    ThreadPool::instance().parallel_for((aoHeight_+kBandHeight-1)/kBandHeight, [&](int band, int)
+    {
+        const int y1 = std::min(aoHeight_, (band+1)*kBandHeight);
+        for (int y = band*kBandHeight; y < y1; y++)
+        {
+            for (int x = 0; x < aoWidth_; x++)
+            {
+                float z = kBackground;
+                for (int j = 0; j < scale_; j++)
+                {
+                    const int sy = std::min(height_-1, y*scale_+j);
+                    for (int i = 0; i < scale_; i++)
+                    {
+                        const int sx = std::min(width_-1, x*scale_+i);
+                        z = std::max(z, depth.get(((size_t)sx+(size_t)sy*width_)*samples));
+                    }
+                }
+                depth_[x+y*aoWidth_] = z == kBackground ? kBackground : z*depthScale/scale_;
+            }
+        }
+    });
+}
+
+void AmbientOcclusion::compute_block(int x0, int y0, int x1, int y1)
+{
+    const float radius = radius_/scale_;
+    const float stepLength = radius/kSteps;
+    const float radius2 = radius*radius;
+    const float invRadius2 = 1.f/radius2;
+    float t2[kSteps+1], invT[kSteps+1];
+    for (int k = 1; k <= kSteps; k++)
+    {
+        t2[k] = k*stepLength*k*stepLength;
+        invT[k] = 1.f/(k*stepLength);
+    }
+    for (int y = y0; y < y1; y++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            const float z = depth_[x+y*aoWidth_];
+            if (z == kBackground)
+            {
+                ao_[x+y*aoWidth_] = 1.f;
+                continue;
+            }
+            const Vec2f *dirs = &directions_[((x&3)+((y&3)<<2))*kSlices];
+            float occlusion = 0.f;
+            for (int s = 0; s < kSlices; s++)
+            {
+                const float dx = dirs[s].x*stepLength, dy = dirs[s].y*stepLength;
+                float horizon[2];
+                bool found[2] = {false, false};
+                for (int side = 0; side < 2; side++)
+                {
+                    const float sign = side ? -1.f : 1.f;
+                    //The steepest sample is tracked by its tangent, one sqrt per side at the end.
+                    //Background depth is so far away that it always fails the radius test.
+                    float tangent = -std::numeric_limits<float>::max();
+                    float dist2 = 0.f;
+                    for (int k = 1; k <= kSteps; k++)
+                    {
+                        const int sx = (int)(x+sign*dx*k+.5f), sy = (int)(y+sign*dy*k+.5f);
+                        if (sx < 0 || sy < 0 || sx >= aoWidth_ || sy >= aoHeight_) break;
+                        const float dz = depth_[sx+sy*aoWidth_]-z;
+                        const float d2 = t2[k]+dz*dz;
+                        if (d2 > radius2 || dz*invT[k] <= tangent) continue;
+                        tangent = dz*invT[k];
+                        dist2 = d2;
+                        found[side] = true;
+                    }
+                    horizon[side] = found[side] ? tangent/std::sqrt(1.f+tangent*tangent)*(1.f-dist2*invRadius2) : 0.f;
+                }
+                //A side without samples mirrors the other, the slice then adds nothing
+                if (!found[0]) horizon[0] = -horizon[1];
+                if (!found[1]) horizon[1] = -horizon[0];
+                occlusion += std::max(0.f, horizon[0]+horizon[1]);
+            }
+            ao_[x+y*aoWidth_] = std::max(0.f, 1.f-strength_*occlusion/(2*kSlices));
+        }
+    }
+}
+
+void AmbientOcclusion::blur_horizontal(int y0, int y1)
+{
+    for (int y = y0; y < y1; y++)
+    {
+        const float *ao = &ao_[y*aoWidth_];
+        const float *depth = &depth_[y*aoWidth_];
+        float *out = &tmp_[y*aoWidth_];
+        for (int x = 0; x < aoWidth_; x++)
+        {
+            const float z = depth[x];
+            float sum = 0.f, weights = 0.f;
+            for (int k = std::max(0, x-kBlurRadius); k <= std::min(aoWidth_-1, x+kBlurRadius); k++)
+            {
+                const float dz = depth[k]-z;
+                const float w = (kBlurRadius+1-std::abs(k-x))/(1.f+dz*dz);
+                sum += ao[k]*w;
+                weights += w;
+            }
+            out[x] = sum/weights;
+        }
+    }
+}
+
+void AmbientOcclusion::blur_vertical(int x0, int y0, int x1, int y1)
+{
+    for (int y = y0; y < y1; y++)
+    {
+        const int k0 = std::max(0, y-kBlurRadius), k1 = std::min(aoHeight_-1, y+kBlurRadius);
+        for (int x = x0; x < x1; x++)
+        {
+            const float z = depth_[x+y*aoWidth_];
+            float sum = 0.f, weights = 0.f;
+            for (int k = k0; k <= k1; k++)
+            {
+                const float dz = depth_[x+k*aoWidth_]-z;
+                const float w = (kBlurRadius+1-std::abs(k-y))/(1.f+dz*dz);
+                sum += tmp_[x+k*aoWidth_]*w;
+                weights += w;
+            }
+            ao_[x+y*aoWidth_] = sum/weights;
+        }
+    }
+}
+
+void AmbientOcclusion::composite(int y0, int y1, TGAImage &image)
+{
+    const int bpp = image.get_bytespp();
+    const int channels = std::min(bpp, 3); // alpha stays untouched
+    unsigned char *data = image.buffer();
+    for (int y = y0; y < y1; y++)
+    {
+        //Bilinear upsampling of the half resolution term, a plain copy at full resolution
+        const float fy = std::max(0.f, (y+.5f)/scale_-.5f);
+        const int ay0 = std::min(aoHeight_-1, (int)fy), ay1 = std::min(aoHeight_-1, ay0+1);
+        const float ty = fy-ay0;
+        unsigned char *row = data+(size_t)y*width_*bpp;
+        for (int x = 0; x < width_; x++)
+        {
+            const float fx = std::max(0.f, (x+.5f)/scale_-.5f);
+            const int ax0 = std::min(aoWidth_-1, (int)fx), ax1 = std::min(aoWidth_-1, ax0+1);
+            const float tx = fx-ax0;
+            const float top = ao_[ax0+ay0*aoWidth_]*(1.f-tx)+ao_[ax1+ay0*aoWidth_]*tx;
+            const float bottom = ao_[ax0+ay1*aoWidth_]*(1.f-tx)+ao_[ax1+ay1*aoWidth_]*tx;
+            const float ao = top*(1.f-ty)+bottom*ty;
+            for (int c = 0; c < channels; c++) row[x*bpp+c] = (unsigned char)(row[x*bpp+c]*ao+.5f);
+        }
+    }
+}
+
+bool AmbientOcclusion::apply(const DepthBuffer &depth, int samples, float depthScale, TGAImage &image)
+{
+    if (image.get_width() != width_ || image.get_height() != height_ || !image.buffer()) return false;
+    PROFILE_SCOPE("ssao");
+    ThreadPool &pool = ThreadPool::instance();
+    const int bands = (aoHeight_+kBandHeight-1)/kBandHeight;
+    const int blocks = (aoWidth_+kBlockWidth-1)/kBlockWidth;
+    
+    gather_depth(depth, samples, depthScale);
+    //Bands are walked in column blocks so the rows within the radius stay in cache
+    pool.parallel_for(bands*blocks, [&](int job, int)
+    {
+        const int band = job/blocks, block = job%blocks;
+        compute_block(block*kBlockWidth, band*kBandHeight, std::min(aoWidth_, (block+1)*kBlockWidth), std::min(aoHeight_, (band+1)*kBandHeight));
+    });
+    pool.parallel_for(bands, [&](int band, int)
+    {
+        blur_horizontal(band*kBandHeight, std::min(aoHeight_, (band+1)*kBandHeight));
+    });
+    pool.parallel_for(bands*blocks, [&](int job, int)
+    {
+        const int band = job/blocks, block = job%blocks;
+        blur_vertical(block*kBlockWidth, band*kBandHeight, std::min(aoWidth_, (block+1)*kBlockWidth), std::min(aoHeight_, (band+1)*kBandHeight));
+    });
+    const int outBands = (height_+kBandHeight-1)/kBandHeight;
+    pool.parallel_for(outBands, [&](int band, int)
+    {
+        composite(band*kBandHeight, std::min(height_, (band+1)*kBandHeight), image);
+    });
+    return true;
+}
@@ -0,0 +1,52 @@
+//
+//  postprocess.h
+//  TinyRenderer
+//
+//  Screen space passes run on the Renderer's buffers after a frame is rasterized.
+//
+
+#ifndef postprocess_h
+#define postprocess_h
+
+#include <vector>
+#include "tgaimage.h"
+#include "geometry.h"
+#include "depthbuffer.h"
+
+//Horizon based ambient occlusion from the depth buffer alone: for every slice the two
+//opposite horizons are added, which cancels out on planes of any slope so no normal buffer
+//is needed. The result is blurred with a separable depth aware filter and multiplied into
+//the color buffer. Scratch buffers are kept between frames.
+class AmbientOcclusion
+{
+private:
+    int width_;
+    int height_;
+    int scale_;       // 1 full resolution, 2 half resolution
+    int aoWidth_;
+    int aoHeight_;
+    float radius_;    // in full resolution pixels
+    float strength_;
+    std::vector<Vec2f> directions_; // kSlices unit directions for each of the 16 jitter offsets
+    std::vector<float> depth_;
+    std::vector<float> ao_;
+    std::vector<float> tmp_;
+    
+    void gather_depth(const DepthBuffer &depth, int samples, float depthScale);
+    void compute_block(int x0, int y0, int x1, int y1);
+    void blur_horizontal(int y0, int y1);
+    void blur_vertical(int x0, int y0, int x1, int y1);
+    void composite(int y0, int y1, TGAImage &image);
+public:
+    AmbientOcclusion(int width, int height, bool halfRes = false);
+    
+    void set_radius(float pixels);
+    void set_strength(float strength);
+    //depth is the renderer's per sample buffer (only the first sample of a pixel is used),
+    //depthScale converts depth units to pixels. image must be width x height.
+    bool apply(const DepthBuffer &depth, int samples, float depthScale, TGAImage &image);
+    //Blurred ambient term of the last apply(), 1 is unoccluded
+    const std::vector<float> &occlusion();
+};
+
+#endif /* postprocess_h */
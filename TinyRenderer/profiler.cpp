@@ -0,0 +1,184 @@
+//
+//  profiler.cpp
+//  TinyRenderer
+//
+
+#include "profiler.h"
+
+#ifdef TR_PROFILE
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace profiler
+{
+namespace
+{
+struct Event
+{
+    const char *name;
+    long long start;
+    long long duration;
+    int depth;
+};
+
+//Every thread writes to its own log, the mutex is only taken to register a thread and to report
+struct ThreadLog
+{
+    int id;
+    std::string name;
+    std::vector<Event> events;
+    long long counters[COUNTER_COUNT];
+    std::map<std::string, long long> stageTimes;
+    int depth;
+    
+    ThreadLog(int i) : id(i), name(), events(), counters(), stageTimes(), depth(0) {}
+};
+
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadLog>> registry;
+long long epoch = now();
+
+ThreadLog &log()
+{
+    thread_local ThreadLog *current = nullptr;
+    if (!current)
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.emplace_back(new ThreadLog((int)registry.size()));
+        current = registry.back().get();
+        current->name = current->id == 0 ? "main" : "worker " + std::to_string(current->id);
+    }
+    return *current;
+}
+
+const char *counterNames[COUNTER_COUNT] = {"triangles_in", "triangles_out", "pixels_tested", "pixels_written", "pixels_covered", "light_entries"};
+}
+
+long long now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Scope::Scope(const char *name) : name_(name), start_(now())
+{
+    log().depth++;
+}
+
+Scope::~Scope()
+{
+    ThreadLog &l = log();
+    l.depth--;
+    l.events.push_back(Event{name_, start_, now()-start_, l.depth});
+}
+
+void add(Counter counter, long long n)
+{
+    log().counters[counter] += n;
+}
+
+void add_time(const char *stage, long long ns)
+{
+    log().stageTimes[stage] += ns;
+}
+
+void set_thread_name(const char *name)
+{
+    log().name = name;
+}
+
+void reset()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (std::unique_ptr<ThreadLog> &l : registry)
+    {
+        l->events.clear();
+        l->stageTimes.clear();
+        std::fill(l->counters, l->counters+COUNTER_COUNT, 0);
+    }
+    epoch = now();
+}
+
+bool write_json(const char *fileName)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    const long long end = now();
+    long long counters[COUNTER_COUNT] = {};
+    std::map<std::string, std::pair<long long, long long>> stages; // total ns, calls
+    for (std::unique_ptr<ThreadLog> &l : registry)
+    {
+        for (int c = 0; c < COUNTER_COUNT; c++) counters[c] += l->counters[c];
+        for (const Event &e : l->events)
+        {
+            stages[e.name].first += e.duration;
+            stages[e.name].second++;
+        }
+        for (auto &stage : l->stageTimes) stages[stage.first].first += stage.second;
+    }
+    
+    std::ofstream out(fileName);
+    if (!out.is_open())
+    {
+        std::cerr << "can't open file " << fileName << "\n";
+        return false;
+    }
+    out << "{\n  \"wall_ms\": " << (end-epoch)/1e6 << ",\n  \"stages\": {";
+    bool first = true;
+    for (auto &stage : stages)
+    {
+        out << (first ? "\n" : ",\n") << "    \"" << stage.first << "\": {\"total_ms\": " << stage.second.first/1e6 << ", \"calls\": " << stage.second.second << "}";
+        first = false;
+    }
+    out << "\n  },\n  \"counters\": {";
+    for (int c = 0; c < COUNTER_COUNT; c++)
+    {
+        out << (c ? ",\n" : "\n") << "    \"" << counterNames[c] << "\": " << counters[c];
+    }
+    out << "\n  },\n  \"overdraw\": " << (counters[PIXELS_COVERED] ? (double)counters[PIXELS_WRITTEN]/counters[PIXELS_COVERED] : 0.);
+    //A thread is busy while it is inside an outermost scope
+    out << ",\n  \"threads\": [";
+    for (size_t t = 0; t < registry.size(); t++)
+    {
+        long long busy = 0;
+        for (const Event &e : registry[t]->events) if (e.depth == 0) busy += e.duration;
+        out << (t ? ",\n" : "\n") << "    {\"id\": " << registry[t]->id << ", \"name\": \"" << registry[t]->name << "\", \"busy_ms\": " << busy/1e6
+            << ", \"idle_ms\": " << std::max(0LL, end-epoch-busy)/1e6 << "}";
+    }
+    out << "\n  ]\n}\n";
+    return out.good();
+}
+
+bool write_trace(const char *fileName)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    std::ofstream out(fileName);
+    if (!out.is_open())
+    {
+        std::cerr << "can't open file " << fileName << "\n";
+        return false;
+    }
+    //Chrome trace event format, complete ("X") events in microseconds
+    out << "{\"traceEvents\": [";
+    bool first = true;
+    for (std::unique_ptr<ThreadLog> &l : registry)
+    {
+        out << (first ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << l->id << ", \"args\": {\"name\": \"" << l->name << "\"}}";
+        first = false;
+        for (const Event &e : l->events)
+        {
+            out << ",\n{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << l->id
+                << ", \"ts\": " << (e.start-epoch)/1e3 << ", \"dur\": " << e.duration/1e3 << "}";
+        }
+    }
+    out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+    return out.good();
+}
+}
+
+#endif /* TR_PROFILE */
@@ -0,0 +1,65 @@
+//
+//  profiler.h
+//  TinyRenderer
+//
+//  Scoped timers and counters for the pipeline stages. Build with -DTR_PROFILE to turn
+//  them on; otherwise every macro below expands to nothing and costs nothing.
+//
+
+#ifndef profiler_h
+#define profiler_h
+
+#ifdef TR_PROFILE
+
+#include <chrono>
+
+namespace profiler
+{
+enum Counter
+{
+    TRIANGLES_IN,     // faces submitted to draw()
+    TRIANGLES_OUT,    // faces left after clipping/culling
+    PIXELS_TESTED,    // pixel samples inside a triangle that went through the depth test
+    PIXELS_WRITTEN,   // pixels whose color was written
+    PIXELS_COVERED,   // pixels holding geometry at resolve time
+    LIGHT_ENTRIES,    // entries of the tile light lists built by LightGrid::cull
+    COUNTER_COUNT
+};
+
+//Records a complete event on the calling thread's timeline
+class Scope
+{
+private:
+    const char *name_;
+    long long start_;
+public:
+    Scope(const char *name);
+    ~Scope();
+};
+
+long long now();
+void add(Counter counter, long long n);
+//Adds time to a stage without a trace event, for stages too fine grained to trace one by one
+void add_time(const char *stage, long long ns);
+//Names the calling thread in the trace
+void set_thread_name(const char *name);
+void reset();
+bool write_json(const char *fileName);
+bool write_trace(const char *fileName);
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) profiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_COUNT(counter, n) profiler::add(profiler::counter, (n))
+#define PROFILE_ONLY(...) __VA_ARGS__
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNT(counter, n)
+#define PROFILE_ONLY(...)
+
+#endif /* TR_PROFILE */
+
+#endif /* profiler_h */
@@ -0,0 +1,253 @@
+//
+//  progressive.cpp
+//  TinyRenderer
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "progressive.h"
+#include "threadpool.h"
+#include "profiler.h"
+
+namespace
+{
+typedef std::chrono::steady_clock Clock;
+
+//A tile is estimated to cost its binned triangles plus this much for clearing, shading and
+//resolving its pixels
+const int kTileCost = 16;
+//Tiles per pool thread in a batch: enough to keep every thread busy, few enough that one
+//misprediction stays small
+const int kBatchPerThread = 4;
+const char *kOrderNames[2] = {"center", "geometry"};
+
+int coarse_size(int size, int scale)
+{
+    scale = std::max(1, scale);
+    return std::max(1, (size+scale-1)/scale);
+}
+
+//Source pixel left of destination pixel i's center and the 8 bit weight of the one after it,
+//with the centers of both sizes lined up
+void bilinear_tap(int i, int dstSize, int srcSize, int &first, int &weight)
+{
+    const float center = std::max(0.f, std::min(srcSize-1.f, (i+.5f)*srcSize/dstSize-.5f));
+    first = std::min(srcSize-2, (int)center);
+    if (first < 0)
+    {
+        first = 0;
+        weight = 0;
+        return;
+    }
+    weight = (int)((center-first)*256.f+.5f);
+}
+
+double ms_since(Clock::time_point since)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now()-since).count();
+}
+}
+
+ProgressiveRenderer::ProgressiveRenderer(int width, int height, int samples, int coarseScale, DepthBuffer::Format depthFormat)
+: full_(width, height, samples, depthFormat), coarse_(coarse_size(width, coarseScale), coarse_size(height, coarseScale), 1, depthFormat),
+  coarseImage_(coarse_size(width, coarseScale), coarse_size(height, coarseScale), TGAImage::RGB), columns_(), wide_(),
+  order_(CENTER_FIRST), centerOrder_(), centerRank_(), tiles_(), cost_(), msPerCost_(0.), setupMs_(0.)
+{
+    const int tilesX = full_.get_tiles_x(), tiles = tilesX*full_.get_tiles_y();
+    //squared distance from the tile's center to the frame's, in pixels
+    std::vector<long long> distance(tiles);
+    for (int t = 0; t < tiles; t++)
+    {
+        const long long dx = 2*((t%tilesX)*kTileSize+std::min(kTileSize, width-(t%tilesX)*kTileSize)/2)-width;
+        const long long dy = 2*((t/tilesX)*kTileSize+std::min(kTileSize, height-(t/tilesX)*kTileSize)/2)-height;
+        distance[t] = dx*dx+dy*dy;
+        centerOrder_.push_back(t);
+    }
+    std::sort(centerOrder_.begin(), centerOrder_.end(), [&](int a, int b)
+    {
+        return distance[a] != distance[b] ? distance[a] < distance[b] : a < b;
+    });
+    centerRank_.resize(tiles);
+    for (int i = 0; i < tiles; i++) centerRank_[centerOrder_[i]] = i;
+    tiles_.resize(tiles);
+    cost_.resize(tiles);
+    const int coarseWidth = coarse_.get_width();
+    for (int x = 0; x < width; x++)
+    {
+        int x0, weight;
+        bilinear_tap(x, width, coarseWidth, x0, weight);
+        columns_.push_back(x0);
+        columns_.push_back(weight);
+    }
+    wide_.resize((size_t)coarse_.get_height()*width*4);
+}
+
+void ProgressiveRenderer::set_order(Order order)
+{
+    order_ = order;
+}
+
+ProgressiveRenderer::Order ProgressiveRenderer::get_order()
+{
+    return order_;
+}
+
+Renderer &ProgressiveRenderer::renderer()
+{
+    return full_;
+}
+
+Renderer &ProgressiveRenderer::coarse_renderer()
+{
+    return coarse_;
+}
+
+int ProgressiveRenderer::get_width()
+{
+    return full_.get_width();
+}
+
+int ProgressiveRenderer::get_height()
+{
+    return full_.get_height();
+}
+
+void ProgressiveRenderer::prioritize()
+{
+    const int tiles = (int)tiles_.size();
+    for (int t = 0; t < tiles; t++) cost_[t] = kTileCost+full_.binned_triangles(t);
+    std::copy(centerOrder_.begin(), centerOrder_.end(), tiles_.begin());
+    if (order_ != GEOMETRY_FIRST) return;
+    std::sort(tiles_.begin(), tiles_.end(), [&](int a, int b)
+    {
+        return cost_[a] != cost_[b] ? cost_[a] > cost_[b] : centerRank_[a] < centerRank_[b];
+    });
+}
+
+//Rows first: the coarse rows are widened to the frame's width once, then every row of the
+//frame blends the two nearest of them. Both passes are plain integer loops the compiler
+//vectorizes, where Resampler's float filter took as long as drawing the coarse pass.
+void ProgressiveRenderer::upscale(TGAImage &image)
+{
+    PROFILE_SCOPE("upscale");
+    const int width = image.get_width(), height = image.get_height(), bpp = image.get_bytespp();
+    const int coarseWidth = coarseImage_.get_width(), coarseHeight = coarseImage_.get_height();
+    const unsigned char *src = coarseImage_.buffer();
+    unsigned char *dst = image.buffer();
+    const size_t rowSize = (size_t)width*bpp;
+    ThreadPool &pool = ThreadPool::instance();
+    pool.parallel_for(coarseHeight, [&](int y, int)
+    {
+        const unsigned char *row = src+(size_t)y*coarseWidth*bpp;
+        uint16_t *out = &wide_[y*rowSize];
+        for (int x = 0; x < width; x++)
+        {
+            const unsigned char *a = row+columns_[x*2]*bpp, *b = coarseWidth > 1 ? a+bpp : a;
+            const int w = columns_[x*2+1];
+            for (int c = 0; c < bpp; c++) out[x*bpp+c] = (uint16_t)(a[c]*(256-w)+b[c]*w);
+        }
+    });
+    const int kBandRows = 16;
+    pool.parallel_for((height+kBandRows-1)/kBandRows, [&](int band, int)
+    {
+        for (int y = band*kBandRows; y < std::min(height, (band+1)*kBandRows); y++)
+        {
+            int y0, w;
+            bilinear_tap(y, height, coarseHeight, y0, w);
+            const uint16_t *a = &wide_[y0*rowSize], *b = coarseHeight > 1 ? a+rowSize : a;
+            unsigned char *out = dst+y*rowSize;
+            for (size_t i = 0; i < rowSize; i++) out[i] = (unsigned char)((a[i]*(256-w)+b[i]*w+32768) >> 16);
+        }
+    });
+    image.set_origin(coarseImage_.get_origin());
+}
+
+ProgressiveRenderer::Stats ProgressiveRenderer::render(const std::vector<Model*> &models, const std::vector<IShader*> &shaders, double budgetMs,
+                                                       TGAImage &image, const TGAColor &clearColor)
+{
+    PROFILE_SCOPE("progressive frame");
+    const Clock::time_point start = Clock::now();
+    const bool deadline = budgetMs >= 0.;
+    Stats stats = {(int)tiles_.size(), 0, 0., 0.};
+    if (image.get_width() != get_width() || image.get_height() != get_height() || !image.buffer()) return stats;
+    {
+        PROFILE_SCOPE("coarse pass");
+        if (coarseImage_.get_bytespp() != image.get_bytespp())
+        {
+            coarseImage_ = TGAImage(coarse_.get_width(), coarse_.get_height(), image.get_bytespp());
+        }
+        coarse_.clear(clearColor);
+        for (size_t m = 0; m < models.size(); m++) coarse_.draw(*models[m], *shaders[m]);
+        coarse_.resolve(coarseImage_);
+        upscale(image);
+    }
+    stats.coarseMs = ms_since(start);
+    //No tile shows before the whole frame is set up and binned, so that is skipped when the
+    //last setup wouldn't fit in what is left. The estimate shrinks every time, so one slow
+    //frame doesn't keep the refinement off for good.
+    if (deadline && stats.coarseMs+setupMs_ >= budgetMs)
+    {
+        setupMs_ *= .9;
+        stats.totalMs = ms_since(start);
+        return stats;
+    }
+    const Clock::time_point setupStart = Clock::now();
+    full_.begin_frame(clearColor);
+    for (size_t m = 0; m < models.size(); m++) full_.draw(*models[m], *shaders[m], true);
+    setupMs_ = ms_since(setupStart);
+    prioritize();
+    
+    const int tiles = (int)tiles_.size(), threads = ThreadPool::instance().size();
+    double refineMs = 0., batchRate = 0.;
+    long long refinedCost = 0;
+    int next = 0;
+    while (next < tiles)
+    {
+        //The batch grows in priority order while its predicted end stays before the deadline.
+        //The rate is the slower of this frame's average and its last batch, else the last
+        //frame's average; with neither the first batch is one tile per thread.
+        const double remaining = budgetMs-ms_since(start);
+        const double rate = refinedCost > 0 ? std::max(refineMs/refinedCost, batchRate) : msPerCost_;
+        double predicted = 0.;
+        int end = next;
+        while (end < tiles && (!deadline || end-next < kBatchPerThread*threads))
+        {
+            const double tileMs = rate*cost_[tiles_[end]];
+            if (deadline && (rate > 0. ? predicted+tileMs > remaining : end-next >= threads)) break;
+            predicted += tileMs;
+            end++;
+        }
+        if (end == next) break;
+        const Clock::time_point batchStart = Clock::now();
+        full_.render_tiles(&tiles_[next], end-next);
+        full_.resolve_tiles(image, &tiles_[next], end-next);
+        const double batchMs = ms_since(batchStart);
+        long long batchCost = 0;
+        for (int i = next; i < end; i++) batchCost += cost_[tiles_[i]];
+        refineMs += batchMs;
+        refinedCost += batchCost;
+        batchRate = batchMs/batchCost;
+        next = end;
+    }
+    if (refinedCost > 0) msPerCost_ = refineMs/refinedCost;
+    stats.refined = next;
+    stats.totalMs = ms_since(start);
+    return stats;
+}
+
+const char *ProgressiveRenderer::order_name(Order order)
+{
+    return kOrderNames[order];
+}
+
+bool ProgressiveRenderer::parse_order(const char *name, Order &order)
+{
+    for (int o = 0; o < 2; o++)
+    {
+        if (strcmp(name, kOrderNames[o])) continue;
+        order = (Order)o;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,79 @@
+//
+//  progressive.h
+//  TinyRenderer
+//
+//  Frames under a time budget. A coarse pass renders the scene at a fraction of the
+//  resolution and scales it up bilinearly, so a complete image exists early. The full resolution frame
+//  is then set up and binned once, and its tiles are rasterized and resolved over the coarse
+//  image in priority order, a batch at a time, for as long as the deadline allows. A batch
+//  only starts when the time the previous ones took predicts it ends before the deadline,
+//  so a frame overruns its budget by the error of one prediction at most, or by the coarse
+//  pass when even that doesn't fit. Between batches every tile holds either its coarse or
+//  its final pixels: stopping at any point leaves a complete image.
+//
+
+#ifndef progressive_h
+#define progressive_h
+
+#include <cstdint>
+#include <vector>
+#include "renderer.h"
+
+class ProgressiveRenderer
+{
+public:
+    //Which tiles are refined first: nearest the center of the frame, or holding the most
+    //triangles (ties nearest the center)
+    enum Order { CENTER_FIRST, GEOMETRY_FIRST };
+    
+    struct Stats
+    {
+        int tiles;       // full resolution tiles of the frame
+        int refined;     // of them rendered at full resolution before the deadline
+        double coarseMs; // until the coarse image was complete
+        double totalMs;  // until render() returned
+    };
+    
+    //The coarse pass renders width/coarseScale by height/coarseScale with one sample per pixel
+    ProgressiveRenderer(int width, int height, int samples = 1, int coarseScale = 4, DepthBuffer::Format depthFormat = DepthBuffer::FLOAT32);
+    ProgressiveRenderer(const ProgressiveRenderer&) = delete;
+    ProgressiveRenderer& operator=(const ProgressiveRenderer&) = delete;
+    
+    void set_order(Order order);
+    Order get_order();
+    //The full resolution renderer and the coarse one, to set the depth range, HDR and so on.
+    //Both have to be set up the same way.
+    Renderer &renderer();
+    Renderer &coarse_renderer();
+    //Draws models[m] with shaders[m] into image, which must have the renderer's size, and
+    //returns within about budgetMs of the call. A budget of 0 gives the coarse pass alone, a
+    //negative one refines every tile and matches a plain render bit for bit. The shaders
+    //draw both passes, so they mustn't depend on the resolution (LightsShader's grid does).
+    Stats render(const std::vector<Model*> &models, const std::vector<IShader*> &shaders, double budgetMs, TGAImage &image,
+                 const TGAColor &clearColor = TGAColor(0, 0, 0, 255));
+    
+    int get_width();
+    int get_height();
+    
+    static const char *order_name(Order order);
+    static bool parse_order(const char *name, Order &order);
+private:
+    Renderer full_;
+    Renderer coarse_;
+    TGAImage coarseImage_;
+    std::vector<int> columns_;     // source column and 8 bit weight of the next one, for every column of the frame
+    std::vector<uint16_t> wide_;   // coarse rows scaled to the frame's width, 8.8 fixed point
+    Order order_;
+    std::vector<int> centerOrder_; // every tile, nearest the center first
+    std::vector<int> centerRank_;  // position of every tile in centerOrder_
+    std::vector<int> tiles_;       // this frame's priority order
+    std::vector<int> cost_;        // this frame's estimated cost of every tile
+    //Measured on earlier frames, 0 before the first
+    double msPerCost_;
+    double setupMs_;
+    
+    void prioritize();
+    void upscale(TGAImage &image);
+};
+
+#endif /* progressive_h */
@@ -0,0 +1,921 @@
+//
+//  renderer.cpp
+//  TinyRenderer
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "renderer.h"
+#include "threadpool.h"
+#include "profiler.h"
+
+namespace
+{
+//Standard D3D sample patterns, in 1/16th of a pixel from the pixel center
+const int kPattern4[4][2] = {{-2,-6}, {6,-2}, {-6,2}, {2,6}};
+const int kPattern8[8][2] = {{1,-3}, {-1,3}, {5,1}, {-3,-5}, {-5,5}, {-7,-1}, {3,7}, {7,-7}};
+const int kSetupBatch = 256;
+
+//Per channel (sum+S/2)/S of a pixel's 4 or 8 samples. With SSE2 the bytes of 4 samples at a
+//time are widened to 16 bits and summed together, then the halves of the sum are folded.
+inline uint32_t average_samples(const uint32_t *samples, int S)
+{
+    const int shift = S == 8 ? 3 : 2;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    for (int s = 0; s < S; s += 4)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(samples+s));
+        sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_unpacklo_epi8(v, zero), _mm_unpackhi_epi8(v, zero)));
+    }
+    sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+    sum = _mm_srl_epi16(_mm_add_epi16(sum, _mm_set1_epi16((short)(S >> 1))), _mm_cvtsi32_si128(shift));
+    return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(sum, zero));
+#else
+    const unsigned char *src = reinterpret_cast<const unsigned char *>(samples);
+    unsigned int sum[4] = {0, 0, 0, 0};
+    for (int s = 0; s < S; s++)
+    {
+        for (int c = 0; c < 4; c++) sum[c] += src[s*4+c];
+    }
+    uint32_t avg = 0;
+    for (int c = 0; c < 4; c++) avg |= ((sum[c]+(S >> 1)) >> shift) << (c*8);
+    return avg;
+#endif
+}
+}
+
+Renderer::Renderer(int width, int height, int samples, DepthBuffer::Format depthFormat)
+: width_(width), height_(height), samples_(samples), tilesX_((width+kTileSize-1)/kTileSize), tilesY_((height+kTileSize-1)/kTileSize),
+  viewport_(viewport(0, 0, width, height)), colorWrite_(true), depthTest_(DEPTH_GREATER), clearColor_(0), hdr_(false), tone_(), depth_(width, height, samples == 4 || samples == 8 ? samples : 1, kTileSize, depthFormat), color_(), slot_(), pools_(), arena_(), tris_(nullptr), live_(nullptr), chunks_(nullptr), nChunks_(0),
+  incremental_(false), history_(false), draws_(), historyTiles_(), historyDraws_(0), reusedTiles_(0), renderedTiles_(0),
+  oitMode_(WEIGHTED_BLENDED), oitK_(0), oitBudget_(0), oitTiles_(), accum_(), reveal_(), heads_(), counts_(), fragments_(), used_(), dropped_()
+{
+    if (samples_ != 4 && samples_ != 8) samples_ = 1;
+    for (int s = 0; s < samples_; s++)
+    {
+        if (samples_ == 1) offsets_[s] = Vec2f(.5f, .5f);
+        else if (samples_ == 4) offsets_[s] = Vec2f(.5f+kPattern4[s][0]/16.f, .5f+kPattern4[s][1]/16.f);
+        else offsets_[s] = Vec2f(.5f+kPattern8[s][0]/16.f, .5f+kPattern8[s][1]/16.f);
+    }
+    color_.resize((size_t)width_*height_);
+    slot_.resize((size_t)width_*height_);
+    pools_.resize(tilesX_*tilesY_);
+    oitTiles_.resize(tilesX_*tilesY_);
+    clear();
+}
+
+void Renderer::set_viewport(const Matrix4f &m)
+{
+    viewport_ = m;
+    history_ = false;
+}
+
+void Renderer::set_depth_range(float zFar, float zNear)
+{
+    depth_.set_range(zFar, zNear);
+    history_ = false;
+}
+
+void Renderer::set_color_write(bool enabled)
+{
+    colorWrite_ = enabled;
+    history_ = false;
+}
+
+void Renderer::set_depth_test(DepthTest test)
+{
+    depthTest_ = test;
+    history_ = false;
+}
+
+void Renderer::set_hdr(bool enabled)
+{
+    hdr_ = enabled;
+    history_ = false;
+}
+
+bool Renderer::is_hdr()
+{
+    return hdr_;
+}
+
+ToneMapper &Renderer::tone_mapper()
+{
+    return tone_;
+}
+
+int Renderer::get_width()
+{
+    return width_;
+}
+
+int Renderer::get_height()
+{
+    return height_;
+}
+
+int Renderer::get_samples()
+{
+    return samples_;
+}
+
+DepthBuffer &Renderer::depth_buffer()
+{
+    depth_.flush();
+    return depth_;
+}
+
+unsigned long Renderer::depth_bytes_touched()
+{
+    return depth_.touched_bytes();
+}
+
+int Renderer::expanded_pixels()
+{
+    return (int)std::count_if(slot_.begin(), slot_.end(), [](int s) { return s >= 0; });
+}
+
+int Renderer::get_tiles_x()
+{
+    return tilesX_;
+}
+
+int Renderer::get_tiles_y()
+{
+    return tilesY_;
+}
+
+int Renderer::reused_tiles()
+{
+    return reusedTiles_;
+}
+
+int Renderer::rendered_tiles()
+{
+    return renderedTiles_;
+}
+
+unsigned long Renderer::arena_bytes()
+{
+    return arena_.capacity();
+}
+
+unsigned long Renderer::sample_bytes()
+{
+    unsigned long bytes = color_.size()*sizeof(uint32_t);
+    for (std::vector<uint32_t> &pool : pools_) bytes += pool.size()*sizeof(uint32_t);
+    return bytes;
+}
+
+uint32_t Renderer::stored_color(const TGAColor &color)
+{
+    if (hdr_) return pack_rgb9e5(srgb_to_linear(color));
+    uint32_t c;
+    memcpy(&c, color.bgra, sizeof(c));
+    return c;
+}
+
+void Renderer::clear(const TGAColor &color)
+{
+    const uint32_t c = stored_color(color);
+    clearColor_ = c;
+    history_ = false;
+    depth_.clear();
+    std::fill(color_.begin(), color_.end(), c);
+    std::fill(slot_.begin(), slot_.end(), -1);
+    for (std::vector<uint32_t> &pool : pools_) pool.clear();
+    std::fill(oitTiles_.begin(), oitTiles_.end(), 0);
+    std::fill(dropped_.begin(), dropped_.end(), 0);
+    arena_.reset();
+    draws_.clear();
+}
+
+void Renderer::setup(int first, int last, const IShader &shader)
+{
+    {
+        PROFILE_SCOPE("vertex transform");
+        for (int f = first; f < last; f++)
+        {
+            Triangle &t = tris_[f];
+            t.face = f;
+            live_[f] = 1;
+            for (int i = 0; i < 3; i++)
+            {
+                Vec4f clip = viewport_*shader.vertex(f, i);
+                if (clip[3] <= 0.f) live_[f] = 0; // behind the camera
+                t.invW[i] = 1.f/clip[3];
+                t.pts[i] = Vec3f(clip[0]*t.invW[i], clip[1]*t.invW[i], clip[2]*t.invW[i]);
+            }
+        }
+    }
+    PROFILE_SCOPE("culling");
+    for (int f = first; f < last; f++)
+    {
+        if (!live_[f]) continue;
+        Triangle &t = tris_[f];
+        live_[f] = 0;
+        const Vec3f &a = t.pts[0], &b = t.pts[1], &c = t.pts[2];
+        const float area = (b.x-a.x)*(c.y-a.y)-(b.y-a.y)*(c.x-a.x);
+        if (std::abs(area) < 1e-8f) continue; // degenerate
+        t.bbox[0] = std::max(0,         (int)std::floor(std::min(a.x, std::min(b.x, c.x))));
+        t.bbox[1] = std::max(0,         (int)std::floor(std::min(a.y, std::min(b.y, c.y))));
+        t.bbox[2] = std::min(width_-1,  (int)std::floor(std::max(a.x, std::max(b.x, c.x))));
+        t.bbox[3] = std::min(height_-1, (int)std::floor(std::max(a.y, std::max(b.y, c.y))));
+        if (t.bbox[0] > t.bbox[2] || t.bbox[1] > t.bbox[3]) continue; // off screen
+        live_[f] = 1;
+    }
+}
+
+//Faces are split into a few chunks binned in parallel: one pass counts each chunk's
+//triangles per tile, the next fills them in. The chunks cover consecutive faces, so a tile
+//that walks them in order sees its triangles in submission order. Every array comes from the
+//shared arena in chunk order, between the passes, so the arena grows the same way whichever
+//threads take the chunks.
+void Renderer::bin(int nFaces)
+{
+    PROFILE_SCOPE("binning");
+    ThreadPool &pool = ThreadPool::instance();
+    const int tiles = tilesX_*tilesY_;
+    nChunks_ = std::max(1, std::min(nFaces/kSetupBatch, pool.size()*4));
+    chunks_ = arena_.allocate<BinChunk>(nChunks_);
+    int *allOffsets = arena_.allocate<int>((size_t)nChunks_*(tiles+1));
+    pool.parallel_for(nChunks_, [&](int c, int)
+    {
+        const int first = (int)((long long)c*nFaces/nChunks_), last = (int)((long long)(c+1)*nFaces/nChunks_);
+        int *offsets = allOffsets+(size_t)c*(tiles+1);
+        std::fill(offsets, offsets+tiles+1, 0);
+        for (int f = first; f < last; f++)
+        {
+            if (!live_[f]) continue;
+            PROFILE_COUNT(TRIANGLES_OUT, 1);
+            const Triangle &t = tris_[f];
+            for (int ty = t.bbox[1]/kTileSize; ty <= t.bbox[3]/kTileSize; ty++)
+            {
+                for (int tx = t.bbox[0]/kTileSize; tx <= t.bbox[2]/kTileSize; tx++) offsets[tx+ty*tilesX_+1]++;
+            }
+        }
+        for (int i = 0; i < tiles; i++) offsets[i+1] += offsets[i];
+        chunks_[c].offsets = offsets;
+    });
+    for (int c = 0; c < nChunks_; c++) chunks_[c].faces = arena_.allocate<int>(chunks_[c].offsets[tiles]);
+    pool.parallel_for(nChunks_, [&](int c, int)
+    {
+        const int first = (int)((long long)c*nFaces/nChunks_), last = (int)((long long)(c+1)*nFaces/nChunks_);
+        int *offsets = chunks_[c].offsets, *faces = chunks_[c].faces;
+        //filling moves every offset to the start of the next tile, shifting them back restores them
+        for (int f = first; f < last; f++)
+        {
+            if (!live_[f]) continue;
+            const Triangle &t = tris_[f];
+            for (int ty = t.bbox[1]/kTileSize; ty <= t.bbox[3]/kTileSize; ty++)
+            {
+                for (int tx = t.bbox[0]/kTileSize; tx <= t.bbox[2]/kTileSize; tx++) faces[offsets[tx+ty*tilesX_]++] = f;
+            }
+        }
+        for (int i = tiles; i > 0; i--) offsets[i] = offsets[i-1];
+        offsets[0] = 0;
+    });
+}
+
+bool Renderer::prepare(Model &model, const IShader &shader)
+{
+    const int nFaces = model.nFaces();
+    PROFILE_COUNT(TRIANGLES_IN, nFaces);
+    if (nFaces == 0) return false;
+    tris_ = arena_.allocate<Triangle>(nFaces);
+    live_ = arena_.allocate<char>(nFaces);
+    ThreadPool::instance().parallel_for((nFaces+kSetupBatch-1)/kSetupBatch, [&](int batch, int)
+    {
+        setup(batch*kSetupBatch, std::min(nFaces, (batch+1)*kSetupBatch), shader);
+    });
+    
+    bin(nFaces);
+    return true;
+}
+
+void Renderer::draw(Model &model, const IShader &shader)
+{
+    if (incremental_)
+    {
+        draw(model, shader, true);
+        return;
+    }
+    PROFILE_SCOPE("draw");
+    history_ = false;
+    if (!prepare(model, shader)) return;
+    ThreadPool::instance().parallel_for(tilesX_*tilesY_, [&](int tile, int)
+    {
+        raster_tile(tile, shader);
+    });
+}
+
+void Renderer::begin_frame(const TGAColor &color)
+{
+    const uint32_t c = stored_color(color);
+    if (c != clearColor_) history_ = false;
+    clearColor_ = c;
+    arena_.reset();
+    draws_.clear();
+    incremental_ = true;
+}
+
+void Renderer::draw(Model &model, const IShader &shader, bool changed)
+{
+    if (!incremental_)
+    {
+        draw(model, shader);
+        return;
+    }
+    PROFILE_SCOPE("draw");
+    const int tiles = tilesX_*tilesY_;
+    Draw d = {&shader, nullptr, nullptr, 0, changed, arena_.allocate<char>(tiles)};
+    std::fill(d.tiles, d.tiles+tiles, 0);
+    if (prepare(model, shader))
+    {
+        d.tris = tris_;
+        d.chunks = chunks_;
+        d.nChunks = nChunks_;
+        for (int c = 0; c < nChunks_; c++)
+        {
+            for (int t = 0; t < tiles; t++) d.tiles[t] |= chunks_[c].offsets[t] < chunks_[c].offsets[t+1];
+        }
+    }
+    draws_.push_back(d);
+}
+
+void Renderer::end_frame()
+{
+    if (!incremental_) return;
+    PROFILE_SCOPE("end frame");
+    incremental_ = false;
+    const int tiles = tilesX_*tilesY_, nDraws = (int)draws_.size();
+    const bool all = !history_ || historyDraws_ != nDraws;
+    int *dirty = arena_.allocate<int>(tiles);
+    int nDirty = 0;
+    for (int t = 0; t < tiles; t++)
+    {
+        bool redraw = all;
+        for (int i = 0; i < nDraws && !redraw; i++)
+        {
+            redraw = draws_[i].changed && (draws_[i].tiles[t] || historyTiles_[(size_t)i*tiles+t]);
+        }
+        if (redraw) dirty[nDirty++] = t;
+    }
+    render_draws(dirty, nDirty);
+    
+    historyTiles_.resize((size_t)nDraws*tiles);
+    for (int i = 0; i < nDraws; i++) std::copy(draws_[i].tiles, draws_[i].tiles+tiles, historyTiles_.begin()+(size_t)i*tiles);
+    historyDraws_ = nDraws;
+    history_ = true;
+    reusedTiles_ = tiles-nDirty;
+    renderedTiles_ = nDirty;
+}
+
+void Renderer::render_tiles(const int *tiles, int count)
+{
+    PROFILE_SCOPE("render tiles");
+    incremental_ = false;
+    history_ = false;
+    render_draws(tiles, count);
+}
+
+int Renderer::binned_triangles(int tile)
+{
+    int n = 0;
+    for (const Draw &d : draws_)
+    {
+        for (int c = 0; c < d.nChunks; c++) n += d.chunks[c].offsets[tile+1]-d.chunks[c].offsets[tile];
+    }
+    return n;
+}
+
+void Renderer::render_draws(const int *tiles, int count)
+{
+    ThreadPool &pool = ThreadPool::instance();
+    pool.parallel_for(count, [&](int i, int)
+    {
+        clear_tile(tiles[i]);
+    });
+    for (const Draw &d : draws_)
+    {
+        if (!d.tris) continue;
+        tris_ = d.tris;
+        chunks_ = d.chunks;
+        nChunks_ = d.nChunks;
+        pool.parallel_for(count, [&](int i, int)
+        {
+            raster_tile(tiles[i], *d.shader);
+        });
+    }
+}
+
+void Renderer::clear_tile(int tile)
+{
+    const int x0 = (tile%tilesX_)*kTileSize, y0 = (tile/tilesX_)*kTileSize;
+    const int x1 = std::min(x0+kTileSize, width_), y1 = std::min(y0+kTileSize, height_);
+    for (int y = y0; y < y1; y++)
+    {
+        std::fill(color_.begin()+x0+y*width_, color_.begin()+x1+y*width_, clearColor_);
+        std::fill(slot_.begin()+x0+y*width_, slot_.begin()+x1+y*width_, -1);
+    }
+    pools_[tile].clear();
+    oitTiles_[tile] = 0;
+    if (!dropped_.empty()) dropped_[tile] = 0;
+    depth_.clear_tile(tile);
+}
+
+void Renderer::set_transparency(Transparency mode, int k, int budget)
+{
+    const size_t pixels = (size_t)width_*height_;
+    const int tiles = tilesX_*tilesY_;
+    oitMode_ = mode;
+    oitK_ = std::min(std::max(1, k), (int)MAX_LAYERS);
+    oitBudget_ = std::max(1, budget);
+    if (mode == WEIGHTED_BLENDED)
+    {
+        accum_.resize(pixels*4);
+        reveal_.resize(pixels);
+        std::vector<int>().swap(heads_);
+        std::vector<uint16_t>().swap(counts_);
+        std::vector<Fragment>().swap(fragments_);
+        std::vector<int>().swap(used_);
+    }
+    else
+    {
+        heads_.resize(pixels);
+        counts_.resize(pixels);
+        fragments_.resize((size_t)tiles*oitBudget_);
+        used_.resize(tiles);
+        std::vector<float>().swap(accum_);
+        std::vector<float>().swap(reveal_);
+    }
+    dropped_.assign(tiles, 0);
+    std::fill(oitTiles_.begin(), oitTiles_.end(), 0);
+    history_ = false;
+}
+
+long long Renderer::dropped_fragments()
+{
+    long long dropped = 0;
+    for (long long d : dropped_) dropped += d;
+    return dropped;
+}
+
+unsigned long Renderer::transparency_bytes()
+{
+    return (accum_.size()+reveal_.size())*sizeof(float)+(heads_.size()+used_.size())*sizeof(int)+counts_.size()*sizeof(uint16_t)+
+           fragments_.size()*sizeof(Fragment);
+}
+
+void Renderer::draw_transparent(Model &model, const IShader &shader)
+{
+    PROFILE_SCOPE("draw transparent");
+    if (!oitBudget_) set_transparency(WEIGHTED_BLENDED);
+    history_ = false;
+    if (!prepare(model, shader)) return;
+    ThreadPool::instance().parallel_for(tilesX_*tilesY_, [&](int tile, int)
+    {
+        bool any = false;
+        for (int ci = 0; ci < nChunks_ && !any; ci++) any = chunks_[ci].offsets[tile] < chunks_[ci].offsets[tile+1];
+        if (!any) return;
+        depth_.prepare_tile(tile);
+        switch (depth_.get_format())
+        {
+            case DepthBuffer::FLOAT32: raster_transparent<Float32Depth>(tile, shader); break;
+            case DepthBuffer::D24S8: raster_transparent<Unorm24Depth>(tile, shader); break;
+            case DepthBuffer::D16: raster_transparent<Unorm16Depth>(tile, shader); break;
+            case DepthBuffer::FLOAT32_REVERSED: raster_transparent<ReversedDepth>(tile, shader); break;
+        }
+    });
+}
+
+void Renderer::reset_transparency(int tile)
+{
+    const int x0 = (tile%tilesX_)*kTileSize, y0 = (tile/tilesX_)*kTileSize;
+    const int x1 = std::min(x0+kTileSize, width_), y1 = std::min(y0+kTileSize, height_);
+    for (int y = y0; y < y1; y++)
+    {
+        const size_t row = (size_t)y*width_;
+        if (oitMode_ == WEIGHTED_BLENDED)
+        {
+            std::fill(accum_.begin()+(row+x0)*4, accum_.begin()+(row+x1)*4, 0.f);
+            std::fill(reveal_.begin()+row+x0, reveal_.begin()+row+x1, 1.f);
+            continue;
+        }
+        std::fill(heads_.begin()+row+x0, heads_.begin()+row+x1, -1);
+        std::fill(counts_.begin()+row+x0, counts_.begin()+row+x1, 0);
+    }
+    if (oitMode_ == K_BUFFER) used_[tile] = 0;
+}
+
+//Coverage and depth test like raster(), without depth writes. WEIGHTED_BLENDED weighs the
+//fragments with McGuire and Bavoil's alpha*max(1e-2, 3e3*d^3), d being 1 at the near end
+//of the depth range and 0 at the far end.
+template <class D>
+void Renderer::raster_transparent(int tile, const IShader &shader)
+{
+    if (!oitTiles_[tile])
+    {
+        reset_transparency(tile);
+        oitTiles_[tile] = 1;
+    }
+    const int x0 = (tile%tilesX_)*kTileSize;
+    const int y0 = (tile/tilesX_)*kTileSize;
+    const int x1 = std::min(x0+kTileSize, width_)-1;
+    const int y1 = std::min(y0+kTileSize, height_)-1;
+    const int S = samples_;
+    const float zScale = depth_.get_scale(), zOffset = depth_.get_offset();
+    const float zFar = depth_.get_far(), zRange = depth_.get_near()-depth_.get_far();
+    const typename D::Value *depthBuffer = depth_.data<typename D::Value>();
+    Fragment *pool = oitMode_ == K_BUFFER ? fragments_.data()+(size_t)tile*oitBudget_ : nullptr;
+    long long dropped = 0;
+    PROFILE_SCOPE("transparency");
+    
+    for (int ci = 0; ci < nChunks_; ci++)
+    {
+        const BinChunk &chunk = chunks_[ci];
+        for (int i = chunk.offsets[tile]; i < chunk.offsets[tile+1]; i++)
+        {
+            const Triangle &t = tris_[chunk.faces[i]];
+            const Vec3f &p0 = t.pts[0], &p1 = t.pts[1], &p2 = t.pts[2];
+            const float invArea = 1.f/((p1.x-p0.x)*(p2.y-p0.y)-(p1.y-p0.y)*(p2.x-p0.x));
+            const float A[3] = {(p1.y-p2.y)*invArea, (p2.y-p0.y)*invArea, (p0.y-p1.y)*invArea};
+            const float B[3] = {(p2.x-p1.x)*invArea, (p0.x-p2.x)*invArea, (p1.x-p0.x)*invArea};
+            const float C[3] = {(p2.y*p1.x-p2.x*p1.y)*invArea, (p0.y*p2.x-p0.x*p2.y)*invArea, (p1.y*p0.x-p1.x*p0.y)*invArea};
+            
+            const int xmin = std::max(x0, t.bbox[0]), xmax = std::min(x1, t.bbox[2]);
+            const int ymin = std::max(y0, t.bbox[1]), ymax = std::min(y1, t.bbox[3]);
+            for (int y = ymin; y <= ymax; y++)
+            {
+                for (int x = xmin; x <= xmax; x++)
+                {
+                    const int p = x+y*width_;
+                    const typename D::Value *depth = depthBuffer+(size_t)p*S;
+                    int covered = 0;
+                    for (int s = 0; s < S; s++)
+                    {
+                        const float sx = x+offsets_[s].x, sy = y+offsets_[s].y;
+                        const float b0 = A[0]*sx+B[0]*sy+C[0];
+                        const float b1 = A[1]*sx+B[1]*sy+C[1];
+                        const float b2 = A[2]*sx+B[2]*sy+C[2];
+                        const int inside = (b0 >= 0) & (b1 >= 0) & (b2 >= 0);
+                        covered += inside & (D::key(depth[s]) < D::encode(b0*p0.z+b1*p1.z+b2*p2.z, zScale, zOffset));
+                    }
+                    if (!covered) continue;
+                    
+                    const float cx = x+.5f, cy = y+.5f;
+                    Vec3f bar(A[0]*cx+B[0]*cy+C[0], A[1]*cx+B[1]*cy+C[1], A[2]*cx+B[2]*cy+C[2]);
+                    Vec3f clip(bar.x*t.invW[0], bar.y*t.invW[1], bar.z*t.invW[2]);
+                    clip = clip/(clip.x+clip.y+clip.z);
+                    TGAColor color;
+                    if (shader.fragment(t.face, clip, color)) continue;
+                    const float alpha = color.bgra[3]/255.f*covered/S;
+                    if (alpha <= 0.f) continue;
+                    const float z = bar.x*p0.z+bar.y*p1.z+bar.z*p2.z;
+                    
+                    if (oitMode_ == WEIGHTED_BLENDED)
+                    {
+                        const float d = std::min(std::max((z-zFar)/zRange, 0.f), 1.f);
+                        const float w = alpha*std::max(1e-2f, 3e3f*d*d*d);
+                        float *acc = &accum_[(size_t)p*4];
+                        for (int c = 0; c < 3; c++) acc[c] += color.bgra[c]*alpha*w;
+                        acc[3] += alpha*w;
+                        reveal_[p] *= 1.f-alpha;
+                        continue;
+                    }
+                    
+                    //Prepended unsorted, resolve() sorts. A full list gives its farthest
+                    //fragment's node to the new one, unless the new one is farther still.
+                    color.bgra[3] = (unsigned char)(alpha*255.f+.5f);
+                    uint32_t c;
+                    memcpy(&c, color.bgra, sizeof(c));
+                    if (counts_[p] == oitK_)
+                    {
+                        dropped++;
+                        int farthest = heads_[p];
+                        for (int n = pool[farthest].next; n >= 0; n = pool[n].next)
+                        {
+                            if (pool[n].z < pool[farthest].z) farthest = n;
+                        }
+                        if (z <= pool[farthest].z) continue;
+                        pool[farthest].z = z;
+                        pool[farthest].color = c;
+                        continue;
+                    }
+                    if (used_[tile] == oitBudget_)
+                    {
+                        dropped++;
+                        continue;
+                    }
+                    const int node = used_[tile]++;
+                    pool[node].z = z;
+                    pool[node].color = c;
+                    pool[node].next = heads_[p];
+                    heads_[p] = node;
+                    counts_[p]++;
+                }
+            }
+        }
+    }
+    dropped_[tile] += dropped;
+}
+
+void Renderer::composite(int p, int tile, unsigned char *dst, int bpp)
+{
+    const int channels = std::min(bpp, 3);
+    if (oitMode_ == WEIGHTED_BLENDED)
+    {
+        const float *acc = &accum_[(size_t)p*4];
+        if (acc[3] <= 0.f) return;
+        const float r = reveal_[p];
+        for (int c = 0; c < channels; c++) dst[c] = (unsigned char)(acc[c]/acc[3]*(1.f-r)+dst[c]*r+.5f);
+        return;
+    }
+    const int count = counts_[p];
+    if (!count) return;
+    //Nearest first, equal depths in submission order (the list is newest first)
+    const Fragment *pool = fragments_.data()+(size_t)tile*oitBudget_;
+    Fragment sorted[MAX_LAYERS];
+    int i = count;
+    for (int n = heads_[p]; n >= 0; n = pool[n].next) sorted[--i] = pool[n];
+    for (i = 1; i < count; i++)
+    {
+        const Fragment f = sorted[i];
+        int j = i;
+        for (; j > 0 && sorted[j-1].z < f.z; j--) sorted[j] = sorted[j-1];
+        sorted[j] = f;
+    }
+    //Front to back: every fragment is seen through the ones before it
+    float sum[3] = {0.f, 0.f, 0.f}, through = 1.f;
+    for (i = 0; i < count; i++)
+    {
+        const unsigned char *src = (const unsigned char *)&sorted[i].color;
+        const float a = src[3]/255.f;
+        for (int c = 0; c < 3; c++) sum[c] += through*a*src[c];
+        through *= 1.f-a;
+    }
+    for (int c = 0; c < channels; c++) dst[c] = (unsigned char)(sum[c]+through*dst[c]+.5f);
+}
+
+
+void Renderer::raster_tile(int tile, const IShader &shader)
+{
+    bool any = false;
+    for (int ci = 0; ci < nChunks_ && !any; ci++) any = chunks_[ci].offsets[tile] < chunks_[ci].offsets[tile+1];
+    if (!any) return;
+    depth_.prepare_tile(tile);
+    switch (depth_.get_format())
+    {
+        case DepthBuffer::FLOAT32: raster<Float32Depth>(tile, shader); break;
+        case DepthBuffer::D24S8: raster<Unorm24Depth>(tile, shader); break;
+        case DepthBuffer::D16: raster<Unorm16Depth>(tile, shader); break;
+        case DepthBuffer::FLOAT32_REVERSED: raster<ReversedDepth>(tile, shader); break;
+    }
+}
+
+//The sample loop has no branches: coverage and the depth test are folded into the mask,
+//and depth is written back through a select.
+template <class D>
+void Renderer::raster(int tile, const IShader &shader)
+{
+    const int x0 = (tile%tilesX_)*kTileSize;
+    const int y0 = (tile/tilesX_)*kTileSize;
+    const int x1 = std::min(x0+kTileSize, width_)-1;
+    const int y1 = std::min(y0+kTileSize, height_)-1;
+    const int S = samples_;
+    const int fullMask = (1<<S)-1;
+    const int equalPasses = depthTest_ == DEPTH_GREATER_EQUAL;
+    const float zScale = depth_.get_scale(), zOffset = depth_.get_offset();
+    typename D::Value *depthBuffer = depth_.data<typename D::Value>();
+    std::vector<uint32_t> &pool = pools_[tile];
+    typename D::Key sampleZ[MAX_SAMPLES];
+    PROFILE_SCOPE("rasterization");
+    PROFILE_ONLY(long long tested = 0, written = 0, shading = 0;)
+    
+    for (int ci = 0; ci < nChunks_; ci++)
+    {
+        const BinChunk &chunk = chunks_[ci];
+        for (int i = chunk.offsets[tile]; i < chunk.offsets[tile+1]; i++)
+        {
+            const Triangle &t = tris_[chunk.faces[i]];
+            const Vec3f &p0 = t.pts[0], &p1 = t.pts[1], &p2 = t.pts[2];
+            const float invArea = 1.f/((p1.x-p0.x)*(p2.y-p0.y)-(p1.y-p0.y)*(p2.x-p0.x));
+            //Edge functions normalized by the area, so they evaluate straight to barycentrics
+            const float A[3] = {(p1.y-p2.y)*invArea, (p2.y-p0.y)*invArea, (p0.y-p1.y)*invArea};
+            const float B[3] = {(p2.x-p1.x)*invArea, (p0.x-p2.x)*invArea, (p1.x-p0.x)*invArea};
+            const float C[3] = {(p2.y*p1.x-p2.x*p1.y)*invArea, (p0.y*p2.x-p0.x*p2.y)*invArea, (p1.y*p0.x-p1.x*p0.y)*invArea};
+        
+            const int xmin = std::max(x0, t.bbox[0]), xmax = std::min(x1, t.bbox[2]);
+            const int ymin = std::max(y0, t.bbox[1]), ymax = std::min(y1, t.bbox[3]);
+            for (int y = ymin; y <= ymax; y++)
+            {
+                for (int x = xmin; x <= xmax; x++)
+                {
+                    const int p = x+y*width_;
+                    typename D::Value *depth = depthBuffer+(size_t)p*S;
+                    int mask = 0;
+                    for (int s = 0; s < S; s++)
+                    {
+                        const float sx = x+offsets_[s].x, sy = y+offsets_[s].y;
+                        const float b0 = A[0]*sx+B[0]*sy+C[0];
+                        const float b1 = A[1]*sx+B[1]*sy+C[1];
+                        const float b2 = A[2]*sx+B[2]*sy+C[2];
+                        const int inside = (b0 >= 0) & (b1 >= 0) & (b2 >= 0);
+                        sampleZ[s] = D::encode(b0*p0.z+b1*p1.z+b2*p2.z, zScale, zOffset);
+                        const typename D::Key stored = D::key(depth[s]);
+                        mask |= (inside & ((stored < sampleZ[s]) | (equalPasses & (stored == sampleZ[s])))) << s;
+                        PROFILE_ONLY(tested += inside;)
+                    }
+                    if (!mask) continue;
+                    if (!colorWrite_)
+                    {
+                        for (int s = 0; s < S; s++) depth[s] = (mask >> s)&1 ? D::store(depth[s], sampleZ[s]) : depth[s];
+                        continue;
+                    }
+                
+                    //One shading evaluation per pixel, at the pixel center
+                    const float cx = x+.5f, cy = y+.5f;
+                    Vec3f bar(A[0]*cx+B[0]*cy+C[0], A[1]*cx+B[1]*cy+C[1], A[2]*cx+B[2]*cy+C[2]);
+                    Vec3f clip(bar.x*t.invW[0], bar.y*t.invW[1], bar.z*t.invW[2]);
+                    clip = clip/(clip.x+clip.y+clip.z);
+                    uint32_t c;
+                    PROFILE_ONLY(long long shadeStart = profiler::now();)
+                    bool discard;
+                    if (hdr_)
+                    {
+                        Vec3f color;
+                        discard = shader.fragment_hdr(t.face, clip, color);
+                        c = pack_rgb9e5(color);
+                    }
+                    else
+                    {
+                        TGAColor color;
+                        discard = shader.fragment(t.face, clip, color);
+                        memcpy(&c, color.bgra, sizeof(c));
+                    }
+                    PROFILE_ONLY(shading += profiler::now()-shadeStart;)
+                    if (discard) continue;
+                    PROFILE_ONLY(written++;)
+                
+                    for (int s = 0; s < S; s++) depth[s] = (mask >> s)&1 ? D::store(depth[s], sampleZ[s]) : depth[s];
+                    if (mask == fullMask)
+                    {
+                        color_[p] = c;
+                        slot_[p] = -1;
+                        continue;
+                    }
+                    if (slot_[p] < 0)
+                    {
+                        slot_[p] = (int)pool.size();
+                        pool.insert(pool.end(), S, color_[p]);
+                    }
+                    uint32_t *samples = &pool[slot_[p]];
+                    for (int s = 0; s < S; s++)
+                    {
+                        if (mask&(1<<s)) samples[s] = c;
+                    }
+                }
+            }
+        }
+    }
+    PROFILE_COUNT(PIXELS_TESTED, tested);
+    PROFILE_COUNT(PIXELS_WRITTEN, written);
+    PROFILE_ONLY(profiler::add_time("shading", shading);)
+}
+
+void Renderer::resolve_row(int y, int x0, int x1, unsigned char *row, int bpp)
+{
+    const int S = samples_;
+    const int tileRow = (y/kTileSize)*tilesX_;
+    PROFILE_ONLY(long long covered = 0;
+                 for (int x = x0; x < x1; x++) covered += depth_.get(((size_t)x+(size_t)y*width_)*S) != -std::numeric_limits<float>::max();
+                 PROFILE_COUNT(PIXELS_COVERED, covered);)
+    if (hdr_)
+    {
+        resolve_row_hdr(y, x0, x1, row, bpp);
+        return;
+    }
+    //The whole row is copied from its one color per pixel, then each tile's pixels with samples
+    //of their own are averaged over it
+    const uint32_t *colors = &color_[(size_t)y*width_];
+    if (bpp == 4) memcpy(row+x0*4, colors+x0, (size_t)(x1-x0)*4);
+    else if (bpp == 3)
+    {
+        //4 byte stores, each overwriting the spare byte of the one before; the last pixel
+        //mustn't write past the row
+        int x = x0;
+        for (; x+1 < x1; x++) memcpy(row+x*3, colors+x, 4);
+        if (x < x1) memcpy(row+x*3, colors+x, 3);
+    }
+    else for (int x = x0; x < x1; x++) memcpy(row+x*bpp, colors+x, bpp);
+    for (int tx = x0/kTileSize; tx*kTileSize < x1; tx++)
+    {
+        const int tile = tileRow+tx;
+        const int begin = std::max(x0, tx*kTileSize), end = std::min(x1, (tx+1)*kTileSize);
+        if (S > 1 && !pools_[tile].empty())
+        {
+            const uint32_t *pool = pools_[tile].data();
+            const int *slots = &slot_[(size_t)y*width_];
+            for (int x = begin; x < end; x++)
+            {
+                if (slots[x] < 0) continue;
+                const uint32_t avg = average_samples(pool+slots[x], S);
+                memcpy(row+x*bpp, &avg, bpp);
+            }
+        }
+        if (oitTiles_[tile])
+        {
+            for (int x = begin; x < end; x++) composite(x+y*width_, tile, row+x*bpp, bpp);
+        }
+    }
+}
+
+//The whole row is tone mapped from its one color per pixel, then the pixels with samples of
+//their own are averaged in linear light and mapped again
+void Renderer::resolve_row_hdr(int y, int x0, int x1, unsigned char *row, int bpp)
+{
+    const int S = samples_;
+    const int tileRow = (y/kTileSize)*tilesX_;
+    tone_.map_row(&color_[(size_t)y*width_+x0], x1-x0, row+x0*bpp, bpp);
+    for (int x = x0; x < x1; x++)
+    {
+        const int p = x+y*width_;
+        const int tile = tileRow+x/kTileSize;
+        if (slot_[p] >= 0)
+        {
+            const uint32_t *src = &pools_[tile][slot_[p]];
+            Vec3f c;
+            for (int s = 0; s < S; s++) c = c+unpack_rgb9e5(src[s]);
+            tone_.map_pixel(c*(1.f/S), row+x*bpp, bpp);
+        }
+        if (oitTiles_[tile]) composite(p, tile, row+x*bpp, bpp);
+    }
+}
+
+bool Renderer::resolve(TGAImage &image)
+{
+    if (image.get_width() != width_ || image.get_height() != height_ || !image.buffer()) return false;
+    PROFILE_SCOPE("resolve");
+    PROFILE_ONLY(depth_.flush();) // for the coverage counter
+    const int bpp = image.get_bytespp();
+    unsigned char *out = image.buffer();
+    image.set_origin(TGAImage::BOTTOM_LEFT); //row 0 is y = 0, the bottom of the viewport
+    ThreadPool::instance().parallel_for(height_, [&](int y, int)
+    {
+        resolve_row(y, 0, width_, out+(size_t)y*width_*bpp, bpp);
+    });
+    return true;
+}
+
+bool Renderer::resolve_tiles(TGAImage &image, const int *tiles, int count)
+{
+    if (image.get_width() != width_ || image.get_height() != height_ || !image.buffer()) return false;
+    PROFILE_SCOPE("resolve");
+    PROFILE_ONLY(depth_.flush();)
+    const int bpp = image.get_bytespp();
+    unsigned char *out = image.buffer();
+    image.set_origin(TGAImage::BOTTOM_LEFT);
+    ThreadPool::instance().parallel_for(count, [&](int i, int)
+    {
+        const int x0 = (tiles[i]%tilesX_)*kTileSize, y0 = (tiles[i]/tilesX_)*kTileSize;
+        const int x1 = std::min(x0+kTileSize, width_), y1 = std::min(y0+kTileSize, height_);
+        for (int y = y0; y < y1; y++) resolve_row(y, x0, x1, out+(size_t)y*width_*bpp, bpp);
+    });
+    return true;
+}
+
+bool Renderer::resolve(FrameWriter &writer)
+{
+    if (writer.get_width() != width_ || writer.get_height() != height_) return false;
+    PROFILE_SCOPE("resolve");
+    PROFILE_ONLY(depth_.flush();)
+    //Bands of a tile row are resolved in parallel a group at a time, and the group is
+    //written from the top as soon as it is done. Only the group is ever buffered, in the
+    //frame arena, so resolve after the draws and before the next clear().
+    const int groupRows = kTileSize*ThreadPool::instance().size();
+    unsigned char *group = arena_.allocate<unsigned char>((size_t)groupRows*width_*3);
+    if (!writer.begin()) return false;
+    for (int top = height_; top > 0; top -= groupRows)
+    {
+        const int rows = std::min(groupRows, top);
+        ThreadPool::instance().parallel_for((rows+kTileSize-1)/kTileSize, [&](int band, int)
+        {
+            for (int i = band*kTileSize; i < std::min(rows, (band+1)*kTileSize); i++)
+            {
+                resolve_row(top-1-i, 0, width_, group+(size_t)i*width_*3, 3);
+            }
+        });
+        for (int i = 0; i < rows; i++)
+        {
+            if (!writer.write_row(group+(size_t)i*width_*3, 3)) return false;
+        }
+    }
+    return writer.end();
+}
@@ -0,0 +1,230 @@
+//
+//  renderer.h
+//  TinyRenderer
+//
+//  Binned rasterizer: triangles are set up once, binned into screen tiles and every tile
+//  is rasterized independently on the thread pool. With more than one sample per pixel
+//  coverage and depth are tracked per sample but the shader runs once per pixel per
+//  triangle; the samples only get their own storage when a pixel is partially covered.
+//  Frames drawn between begin_frame() and end_frame() are incremental: only the tiles that
+//  changed objects cover are cleared and rasterized again, the others keep the last frame.
+//  A frame's draws can also be rasterized a few chosen tiles at a time (see render_tiles),
+//  which is how progressive.h refines a frame under a deadline.
+//  Transparent draws come after the opaque ones and are composited over them by resolve(),
+//  in either of two order independent ways (see set_transparency).
+//  HDR frames store linear light and tone map it to 8 bits in resolve (see set_hdr).
+//
+
+#ifndef renderer_h
+#define renderer_h
+
+#include <cstdint>
+#include <vector>
+#include "geometry.h"
+#include "tgaimage.h"
+#include "our_gl.h"
+#include "model.h"
+#include "output.h"
+#include "arena.h"
+#include "depthbuffer.h"
+#include "tonemap.h"
+
+const int kTileSize = 32;
+
+class Renderer
+{
+public:
+    enum { MAX_SAMPLES = 8 };
+    enum { MAX_LAYERS = 256 }; // largest k of K_BUFFER
+    enum Transparency { WEIGHTED_BLENDED, K_BUFFER };
+    enum DepthTest { DEPTH_GREATER, DEPTH_GREATER_EQUAL };
+    
+    Renderer(int width, int height, int samples = 1, DepthBuffer::Format depthFormat = DepthBuffer::FLOAT32);
+    Renderer(const Renderer&) = delete;
+    Renderer& operator=(const Renderer&) = delete;
+    
+    void set_viewport(const Matrix4f &m);
+    //z range kept by the compact depth formats, see depthbuffer.h
+    void set_depth_range(float zFar, float zNear);
+    //With color writes off only depth is rasterized and the fragment shader is never called
+    void set_color_write(bool enabled);
+    //Which opaque samples pass against the stored depth (larger is nearer). DEPTH_GREATER_EQUAL
+    //redraws a depth prepass with color, shading only the visible surface. Ties between
+    //triangles at exactly the same depth then go to the last one drawn instead of the first.
+    void set_depth_test(DepthTest test);
+    //Opaque fragments come from IShader::fragment_hdr and keep linear light in RGB9E5 (see
+    //tonemap.h) instead of 8 bits. resolve() averages the samples in linear light, then tone
+    //maps them. Clear colors are still given in 8 bit sRGB. Transparent fragments stay
+    //8 bit and are composited over the tone mapped pixels. clear() before drawing again.
+    void set_hdr(bool enabled);
+    bool is_hdr();
+    //Exposure and curve of the HDR resolve
+    ToneMapper &tone_mapper();
+    void clear(const TGAColor &color = TGAColor(0, 0, 0, 255));
+    void draw(Model &model, const IShader &shader);
+    //Starts an incremental frame in place of clear(). The frame's draws are only set up and
+    //binned; end_frame() rasterizes them. The n-th draw is taken to be the same object as
+    //the n-th draw of the previous incremental frame, and changed tells whether anything
+    //it outputs (geometry or shading) differs since then. A tile is rendered again when a
+    //changed draw covers it in this frame or the last: it is cleared and every draw that
+    //reaches it is rasterized in order, so the result is identical to a full frame. Other
+    //tiles keep their color and depth. Anything else that alters the output (a different
+    //number of draws, clear color, viewport, depth range, or a clear() or plain draw() in
+    //between) renders every tile.
+    void begin_frame(const TGAColor &color = TGAColor(0, 0, 0, 255));
+    //shader must stay alive until end_frame()
+    void draw(Model &model, const IShader &shader, bool changed);
+    void end_frame();
+    //Progressive frames: begin_frame() and the frame's draws, then render_tiles() in place of
+    //end_frame(), as many times as needed. Each call clears the given tiles and rasterizes
+    //every draw of the frame into them; the other tiles keep what they held. The draws stay
+    //valid until the next clear() or begin_frame(), and the next incremental frame renders
+    //every tile.
+    void render_tiles(const int *tiles, int count);
+    //Triangles the draws of the current frame binned into tile
+    int binned_triangles(int tile);
+    //WEIGHTED_BLENDED sums every fragment into 20 bytes per pixel with a weight that favors
+    //near fragments: order independent and fixed in size, but approximate. K_BUFFER keeps
+    //the k nearest fragments of each pixel, sorts them by depth in resolve() and blends them, which
+    //is exact as long as no pixel gets more than k and no tile more than budget fragments.
+    //Past either the fragment is dropped, for k the farthest one. Its memory is capped at
+    //budget fragments of 12 bytes per tile, taken from that tile's own pool.
+    void set_transparency(Transparency mode, int k = 8, int budget = kTileSize*kTileSize*2);
+    //Draws over the opaque geometry drawn so far: fragments are depth tested against it without
+    //writing depth, and the alpha of the shader's color is their opacity. Shaded once per pixel
+    //like opaque triangles; with MSAA the opacity is scaled by the samples covered. resolve()
+    //composites them. In incremental frames draw them after end_frame(), the next frame then
+    //renders every tile.
+    void draw_transparent(Model &model, const IShader &shader);
+    //K_BUFFER fragments dropped since the last clear(), and the bytes the transparency mode holds
+    long long dropped_fragments();
+    unsigned long transparency_bytes();
+    //Tiles the last end_frame() kept from the frame before, and tiles it rendered
+    int reused_tiles();
+    int rendered_tiles();
+    //Averages the samples of every pixel into image, which must have the renderer's size.
+    //Rows are stored bottom up and the image's origin is set to BOTTOM_LEFT accordingly.
+    bool resolve(TGAImage &image);
+    //Same, encoded straight into a frame from the top row down, without a full size image
+    bool resolve(FrameWriter &writer);
+    //Same as resolve(image) for the given tiles only, the rest of image is left as it is
+    bool resolve_tiles(TGAImage &image, const int *tiles, int count);
+    
+    int get_width();
+    int get_height();
+    int get_samples();
+    //Tiles are numbered row by row from the bottom left, tile t covers x from
+    //(t%tiles_x)*kTileSize and y from (t/tiles_x)*kTileSize
+    int get_tiles_x();
+    int get_tiles_y();
+    //Per sample depth, with every tile filled in. Valid until the next clear().
+    DepthBuffer &depth_buffer();
+    //Depth memory the frame has touched so far; tiles no triangle reached are never cleared
+    unsigned long depth_bytes_touched();
+    //Pixels currently holding per sample colors, and the bytes they use
+    int expanded_pixels();
+    unsigned long sample_bytes();
+    //Memory held by the frame arena (transformed triangles, bins, scratch rows)
+    unsigned long arena_bytes();
+private:
+    struct Triangle
+    {
+        Vec3f pts[3];
+        float invW[3];
+        int face;
+        int bbox[4]; // xmin, ymin, xmax, ymax in pixels, inclusive
+    };
+    
+    //Triangles of a contiguous range of faces sorted by tile: the ones overlapping tile t
+    //are faces[offsets[t]] to faces[offsets[t+1]-1], in submission order
+    struct BinChunk
+    {
+        int *offsets;
+        int *faces;
+    };
+    
+    //Node of a K_BUFFER pixel list, newest first
+    struct Fragment
+    {
+        float z;
+        uint32_t color;
+        int next;
+    };
+    
+    //A draw of an incremental frame, waiting for end_frame()
+    struct Draw
+    {
+        const IShader *shader;
+        Triangle *tris;
+        BinChunk *chunks;
+        int nChunks;
+        bool changed;
+        char *tiles; // 1 for every tile the draw's triangles were binned into
+    };
+    
+    int width_;
+    int height_;
+    int samples_;
+    int tilesX_;
+    int tilesY_;
+    Matrix4f viewport_;
+    bool colorWrite_;
+    DepthTest depthTest_;
+    Vec2f offsets_[MAX_SAMPLES];
+    uint32_t clearColor_;
+    bool hdr_;
+    ToneMapper tone_;
+    
+    DepthBuffer depth_;
+    std::vector<uint32_t> color_;              // one color per pixel (8 bit bgra or RGB9E5), valid when slot_ is -1
+    std::vector<int> slot_;                    // offset of the pixel's samples in its tile pool
+    std::vector<std::vector<uint32_t>> pools_; // per tile sample colors, tiles never share one
+    //Everything below lives in arena_ for the current frame, clear() resets it
+    Arena arena_;
+    Triangle *tris_;
+    char *live_;
+    BinChunk *chunks_;
+    int nChunks_;
+    //Incremental frames
+    bool incremental_;               // between begin_frame() and end_frame()
+    bool history_;                   // the pixels hold the last incremental frame and nothing since
+    std::vector<Draw> draws_;
+    std::vector<char> historyTiles_; // Draw::tiles of the last incremental frame, one row of tiles per draw
+    int historyDraws_;
+    int reusedTiles_;
+    int renderedTiles_;
+    //Transparency, set up on first use. A tile's storage is reset when the first transparent
+    //triangle of the frame reaches it; oitTiles_ marks those tiles.
+    Transparency oitMode_;
+    int oitK_;
+    int oitBudget_;
+    std::vector<char> oitTiles_;
+    std::vector<float> accum_;         // WEIGHTED_BLENDED: sum of color*alpha*weight and alpha*weight, 4 per pixel
+    std::vector<float> reveal_;        // product of 1-alpha
+    std::vector<int> heads_;           // K_BUFFER: first fragment of every pixel, -1 for none
+    std::vector<uint16_t> counts_;     // fragments in every pixel's list
+    std::vector<Fragment> fragments_;  // tile t owns fragments_[t*oitBudget_] to fragments_[(t+1)*oitBudget_-1]
+    std::vector<int> used_;            // fragments taken from each tile's pool
+    std::vector<long long> dropped_;   // per tile
+    
+    void setup(int first, int last, const IShader &shader);
+    void bin(int nFaces);
+    //Sets up and bins a draw into tris_ and chunks_, false when the model has no faces
+    bool prepare(Model &model, const IShader &shader);
+    void clear_tile(int tile);
+    //Clears the tiles and rasterizes every draw of draws_ into them
+    void render_draws(const int *tiles, int count);
+    void raster_tile(int tile, const IShader &shader);
+    template <class D>
+    void raster(int tile, const IShader &shader);
+    template <class D>
+    void raster_transparent(int tile, const IShader &shader);
+    void reset_transparency(int tile);
+    void composite(int p, int tile, unsigned char *dst, int bpp);
+    uint32_t stored_color(const TGAColor &color);
+    //Pixels x0 to x1-1 of row y into row, which starts at x = 0
+    void resolve_row(int y, int x0, int x1, unsigned char *row, int bpp);
+    void resolve_row_hdr(int y, int x0, int x1, unsigned char *row, int bpp);
+};
+
+#endif /* renderer_h */
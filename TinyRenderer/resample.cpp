@@ -0,0 +1,190 @@
+//
+//  resample.cpp
+//  TinyRenderer
+//
+
+#include <algorithm>
+#include <cmath>
+#include "resample.h"
+#include "threadpool.h"
+#include "profiler.h"
+
+namespace
+{
+const int kBandRows = 16;
+
+float filter_support(Resampler::Filter filter)
+{
+    return filter == Resampler::BOX ? .5f : (filter == Resampler::BILINEAR ? 1.f : 3.f);
+}
+
+float sinc(float x)
+{
+    if (std::fabs(x) < 1e-6f) return 1.f;
+    x *= (float)M_PI;
+    return std::sin(x)/x;
+}
+
+float filter_weight(Resampler::Filter filter, float x)
+{
+    x = std::fabs(x);
+    switch (filter)
+    {
+        case Resampler::BOX: return x <= .5f ? 1.f : 0.f;
+        case Resampler::BILINEAR: return std::max(0.f, 1.f-x);
+        default: return x < 3.f ? sinc(x)*sinc(x/3.f) : 0.f;
+    }
+}
+
+//The channel count is a template argument so the inner loops are fixed size
+template <int N>
+void filter_rows(const unsigned char *src, int srcWidth, float *dst, int dstWidth, int taps, const int *first, const float *coeffs, int y0, int y1)
+{
+    for (int y = y0; y < y1; y++)
+    {
+        const unsigned char *row = src+(size_t)y*srcWidth*N;
+        float *out = dst+(size_t)y*dstWidth*N;
+        for (int x = 0; x < dstWidth; x++)
+        {
+            const unsigned char *p = row+first[x]*N;
+            const float *k = coeffs+(size_t)x*taps;
+            float acc[N] = {};
+            for (int t = 0; t < taps; t++)
+            {
+                for (int c = 0; c < N; c++) acc[c] += k[t]*p[t*N+c];
+            }
+            for (int c = 0; c < N; c++) out[x*N+c] = acc[c];
+        }
+    }
+}
+
+//Whole rows at a time: the loop over a row has no dependencies and vectorizes across pixels and channels
+void filter_columns(const float *src, int rowSize, unsigned char *dst, float *acc, int taps, const int *first, const float *coeffs, int y0, int y1)
+{
+    for (int y = y0; y < y1; y++)
+    {
+        std::fill(acc, acc+rowSize, 0.f);
+        const float *k = coeffs+(size_t)y*taps;
+        for (int t = 0; t < taps; t++)
+        {
+            const float *row = src+(size_t)(first[y]+t)*rowSize;
+            const float w = k[t];
+            for (int i = 0; i < rowSize; i++) acc[i] += w*row[i];
+        }
+        unsigned char *out = dst+(size_t)y*rowSize;
+        for (int i = 0; i < rowSize; i++) out[i] = (unsigned char)std::min(255.f, std::max(0.f, acc[i]+.5f));
+    }
+}
+}
+
+Resampler::Resampler(Filter filter)
+: filter_(filter), horizontal_(), vertical_(), rows_(), acc_()
+{
+    horizontal_.srcSize = horizontal_.dstSize = vertical_.srcSize = vertical_.dstSize = 0;
+}
+
+void Resampler::set_filter(Filter filter)
+{
+    if (filter == filter_) return;
+    filter_ = filter;
+    horizontal_.srcSize = vertical_.srcSize = 0; //weights are stale
+}
+
+Resampler::Filter Resampler::get_filter()
+{
+    return filter_;
+}
+
+void Resampler::prepare(Weights &w, int srcSize, int dstSize)
+{
+    if (w.srcSize == srcSize && w.dstSize == dstSize) return;
+    w.srcSize = srcSize;
+    w.dstSize = dstSize;
+    //when shrinking the filter is stretched to cover all the source pixels of a destination pixel
+    const float scale = (float)srcSize/dstSize;
+    const float stretch = std::max(1.f, scale);
+    const float support = filter_support(filter_)*stretch;
+    //every filter is the identity at scale 1, one tap turns that pass into a plain conversion
+    w.taps = srcSize == dstSize ? 1 : std::min(srcSize, (int)std::ceil(support*2.f)+1);
+    w.first.resize(dstSize);
+    w.coeffs.assign((size_t)dstSize*w.taps, 0.f);
+    for (int i = 0; i < dstSize; i++)
+    {
+        const float center = (i+.5f)*scale-.5f;
+        const int left = (int)std::ceil(center-support), right = (int)std::floor(center+support);
+        //the window is moved inside the image and the taps falling off an edge go to the edge pixel
+        const int first = std::max(0, std::min(srcSize-w.taps, left));
+        float *k = &w.coeffs[(size_t)i*w.taps];
+        float sum = 0.f;
+        for (int j = left; j <= right; j++)
+        {
+            const float weight = filter_weight(filter_, (j-center)/stretch);
+            const int t = std::max(0, std::min(srcSize-1, j))-first;
+            if (weight == 0.f || t < 0 || t >= w.taps) continue;
+            k[t] += weight;
+            sum += weight;
+        }
+        if (sum == 0.f)
+        {
+            k[std::max(0, std::min(w.taps-1, (int)(center+.5f)-first))] = 1.f;
+            sum = 1.f;
+        }
+        for (int t = 0; t < w.taps; t++) k[t] /= sum;
+        w.first[i] = first;
+    }
+}
+
+void Resampler::resample(const unsigned char *src, int srcWidth, int srcHeight, unsigned char *dst, int dstWidth, int dstHeight, int bytespp)
+{
+    PROFILE_SCOPE("resample");
+    prepare(horizontal_, srcWidth, dstWidth);
+    prepare(vertical_, srcHeight, dstHeight);
+    const int rowSize = dstWidth*bytespp;
+    rows_.resize((size_t)rowSize*srcHeight);
+    ThreadPool &pool = ThreadPool::instance();
+    const Weights &h = horizontal_;
+    pool.parallel_for((srcHeight+kBandRows-1)/kBandRows, [&](int band, int)
+    {
+        const int y0 = band*kBandRows, y1 = std::min(srcHeight, y0+kBandRows);
+        if (bytespp == 1) filter_rows<1>(src, srcWidth, rows_.data(), dstWidth, h.taps, h.first.data(), h.coeffs.data(), y0, y1);
+        else if (bytespp == 3) filter_rows<3>(src, srcWidth, rows_.data(), dstWidth, h.taps, h.first.data(), h.coeffs.data(), y0, y1);
+        else filter_rows<4>(src, srcWidth, rows_.data(), dstWidth, h.taps, h.first.data(), h.coeffs.data(), y0, y1);
+    });
+    const int bands = (dstHeight+kBandRows-1)/kBandRows;
+    acc_.resize((size_t)bands*rowSize);
+    const Weights &v = vertical_;
+    pool.parallel_for(bands, [&](int band, int)
+    {
+        const int y0 = band*kBandRows, y1 = std::min(dstHeight, y0+kBandRows);
+        filter_columns(rows_.data(), rowSize, dst, &acc_[(size_t)band*rowSize], v.taps, v.first.data(), v.coeffs.data(), y0, y1);
+    });
+}
+
+bool Resampler::resample(TGAImage &src, TGAImage &dst)
+{
+    if (!src.buffer() || !dst.buffer() || src.get_bytespp() != dst.get_bytespp()) return false;
+    resample(src.buffer(), src.get_width(), src.get_height(), dst.buffer(), dst.get_width(), dst.get_height(), src.get_bytespp());
+    dst.set_origin(src.get_origin());
+    return true;
+}
+
+void Resampler::mip_chain(TGAImage &base, std::vector<TGAImage> &levels)
+{
+    int count = 0;
+    for (int w = base.get_width(), h = base.get_height(); w > 1 || h > 1; w = std::max(1, w/2), h = std::max(1, h/2)) count++;
+    levels.resize(count);
+    int width = base.get_width(), height = base.get_height();
+    TGAImage *previous = &base;
+    for (int i = 0; i < count; i++)
+    {
+        width = std::max(1, width/2);
+        height = std::max(1, height/2);
+        TGAImage &level = levels[i];
+        if (level.get_width() != width || level.get_height() != height || level.get_bytespp() != base.get_bytespp())
+        {
+            level = TGAImage(width, height, base.get_bytespp());
+        }
+        resample(*previous, level);
+        previous = &level;
+    }
+}
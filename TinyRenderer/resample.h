@@ -0,0 +1,59 @@
+//
+//  resample.h
+//  TinyRenderer
+//
+//  Separable image resampling. A horizontal pass filters every source row into a float
+//  buffer at the destination width, then a vertical pass filters that into the destination.
+//  Both passes run on the thread pool in row bands. The filter weights and the intermediate
+//  buffers are kept between calls, so resampling to the same sizes again doesn't allocate.
+//
+
+#ifndef resample_h
+#define resample_h
+
+#include <vector>
+#include "tgaimage.h"
+
+class Resampler
+{
+public:
+    enum Filter {
+        BOX, BILINEAR, LANCZOS3
+    };
+    
+    Resampler(Filter filter = LANCZOS3);
+    Resampler(const Resampler&) = delete;
+    Resampler& operator=(const Resampler&) = delete;
+    
+    //Resamples src to the size of dst. Both must already be allocated with the same bytespp;
+    //dst takes src's origin.
+    bool resample(TGAImage &src, TGAImage &dst);
+    //Same on bare pixel buffers with bytespp interleaved channels
+    void resample(const unsigned char *src, int srcWidth, int srcHeight, unsigned char *dst, int dstWidth, int dstHeight, int bytespp);
+    //Halves base until 1x1 with the current filter. Levels that already have the right size
+    //are reused, so rebuilding a chain doesn't allocate.
+    void mip_chain(TGAImage &base, std::vector<TGAImage> &levels);
+    
+    void set_filter(Filter filter);
+    Filter get_filter();
+private:
+    //taps coefficients per destination pixel, starting at source pixel first[i]
+    struct Weights
+    {
+        int srcSize;
+        int dstSize;
+        int taps;
+        std::vector<int> first;
+        std::vector<float> coeffs;
+    };
+    
+    Filter filter_;
+    Weights horizontal_;
+    Weights vertical_;
+    std::vector<float> rows_; // horizontal pass output, dstWidth x srcHeight
+    std::vector<float> acc_;  // one accumulation row per vertical band
+    
+    void prepare(Weights &w, int srcSize, int dstSize);
+};
+
+#endif /* resample_h */
@@ -0,0 +1,716 @@
+//
+//  server.cpp
+//  TinyRenderer
+//
+//  The accept loop hands connections to a fixed set of workers through a bounded queue.
+//  When the queue is full a new connection is answered "ERR busy" and closed right away,
+//  so a burst can't pile up unbounded work. Meshes and textures stay resident for the
+//  life of the server, and every worker keeps its renderer, shadow map and image between
+//  requests as long as the resolution doesn't change. The workers share the thread pool
+//  for tiles and bands, one frame stage at a time.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "server.h"
+#include "model.h"
+#include "our_gl.h"
+#include "postprocess.h"
+#include "progressive.h"
+#include "renderer.h"
+#include "shaders.h"
+#include "shadow.h"
+#include "tgaimage.h"
+#include "output.h"
+
+namespace
+{
+typedef std::chrono::steady_clock Clock;
+
+const size_t kMaxLine = 4096;
+const size_t kLatencyWindow = 65536; //latencies kept for the percentiles
+const int kMaxSize = 8192;
+
+std::atomic<bool> stopping(false);
+
+void on_signal(int)
+{
+    stopping = true;
+}
+
+double elapsed_us(Clock::time_point since)
+{
+    return std::chrono::duration<double, std::micro>(Clock::now()-since).count();
+}
+
+//Blocking socket with a read buffer for the line based protocol
+class Connection
+{
+private:
+    int fd_;
+    std::string buffer_;
+public:
+    Connection(int fd) : fd_(fd), buffer_() {}
+    ~Connection() { if (fd_ >= 0) close(fd_); }
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    bool read_line(std::string &line)
+    {
+        for (;;)
+        {
+            size_t end = buffer_.find('\n');
+            if (end != std::string::npos)
+            {
+                line = buffer_.substr(0, end);
+                buffer_.erase(0, end+1);
+                return true;
+            }
+            if (buffer_.size() > kMaxLine) return false;
+            char chunk[4096];
+            ssize_t n = recv(fd_, chunk, sizeof(chunk), 0);
+            if (n <= 0) return false;
+            buffer_.append(chunk, n);
+        }
+    }
+
+    bool read_exact(size_t count, std::string &bytes)
+    {
+        bytes.swap(buffer_);
+        buffer_.clear();
+        if (bytes.size() > count)
+        {
+            buffer_ = bytes.substr(count);
+            bytes.resize(count);
+        }
+        size_t have = bytes.size();
+        bytes.resize(count);
+        while (have < count)
+        {
+            ssize_t n = recv(fd_, &bytes[have], count-have, 0);
+            if (n <= 0) return false;
+            have += n;
+        }
+        return true;
+    }
+
+    bool write_all(const char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t n = send(fd_, data, size, 0);
+            if (n <= 0) return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    bool write_all(const std::string &s)
+    {
+        return write_all(s.data(), s.size());
+    }
+};
+
+sockaddr_un socket_address(const char *path, bool &ok)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    ok = strlen(path) < sizeof(addr.sun_path);
+    if (ok) strcpy(addr.sun_path, path);
+    else std::cerr << "socket path too long: " << path << "\n";
+    return addr;
+}
+
+float percentile(std::vector<float> &sorted, float p)
+{
+    if (sorted.empty()) return 0.f;
+    return sorted[std::min(sorted.size()-1, (size_t)(p*(sorted.size()-1)+.5f))];
+}
+
+class Metrics
+{
+private:
+    std::mutex mutex_;
+    std::vector<float> total_;
+    std::vector<float> render_;
+    size_t next_;
+    long requests_;
+    long errors_;
+    long rejected_;
+    //Requests with a budget
+    long progressive_;
+    long overBudget_;
+    long long refinedTiles_;
+    long long budgetTiles_;
+    Clock::time_point start_;
+public:
+    Metrics() : mutex_(), total_(), render_(), next_(0), requests_(0), errors_(0), rejected_(0), progressive_(0), overBudget_(0),
+                refinedTiles_(0), budgetTiles_(0), start_(Clock::now()) {}
+
+    void record(float totalMs, float renderMs)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        requests_++;
+        if (total_.size() < kLatencyWindow)
+        {
+            total_.push_back(totalMs);
+            render_.push_back(renderMs);
+            return;
+        }
+        total_[next_] = totalMs;
+        render_[next_] = renderMs;
+        next_ = (next_+1)%kLatencyWindow;
+    }
+
+    void progressive(const ProgressiveRenderer::Stats &stats, bool overBudget)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        progressive_++;
+        overBudget_ += overBudget;
+        refinedTiles_ += stats.refined;
+        budgetTiles_ += stats.tiles;
+    }
+
+    void error()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        errors_++;
+    }
+
+    void reject()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rejected_++;
+    }
+
+    std::string json()
+    {
+        std::vector<float> total, render;
+        std::ostringstream out;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            total = total_;
+            render = render_;
+            double seconds = std::chrono::duration<double>(Clock::now()-start_).count();
+            out << "{\"requests\": " << requests_ << ", \"errors\": " << errors_ << ", \"rejected\": " << rejected_
+                << ", \"uptime_s\": " << seconds;
+            out << ", \"budgeted\": {\"requests\": " << progressive_ << ", \"over_budget\": " << overBudget_
+                << ", \"refined\": " << (budgetTiles_ ? (double)refinedTiles_/budgetTiles_ : 0.) << "}";
+        }
+        std::sort(total.begin(), total.end());
+        std::sort(render.begin(), render.end());
+        out << ", \"total_ms\": {\"p50\": " << percentile(total, .5f) << ", \"p95\": " << percentile(total, .95f)
+            << ", \"p99\": " << percentile(total, .99f) << ", \"max\": " << (total.empty() ? 0.f : total.back()) << "}";
+        out << ", \"render_ms\": {\"p50\": " << percentile(render, .5f) << ", \"p95\": " << percentile(render, .95f)
+            << ", \"p99\": " << percentile(render, .99f) << ", \"max\": " << (render.empty() ? 0.f : render.back()) << "}}";
+        return out.str();
+    }
+};
+
+struct RenderRequest
+{
+    std::vector<std::string> models;
+    Vec3f eye;
+    Vec3f center;
+    int width;
+    int height;
+    int samples;
+    bool lit;
+    int shadowSize;
+    int ssaoScale;
+    double budget; // ms for a progressive frame, -1 to render it whole
+    FrameWriter::Format format;
+
+    RenderRequest() : models(), eye(1, 1, 3), center(0, 0, 0), width(800), height(800), samples(1), lit(true),
+                      shadowSize(0), ssaoScale(0), budget(-1.), format(FrameWriter::TGA_RLE) {}
+};
+
+bool parse_vec(const std::string &s, Vec3f &v)
+{
+    return sscanf(s.c_str(), "%f,%f,%f", &v.x, &v.y, &v.z) == 3;
+}
+
+bool parse_request(const std::string &line, RenderRequest &req, std::string &error)
+{
+    std::istringstream in(line);
+    std::string token;
+    in >> token; //"render"
+    while (in >> token)
+    {
+        size_t eq = token.find('=');
+        std::string key = token.substr(0, eq), value = eq == std::string::npos ? "" : token.substr(eq+1);
+        bool ok = true;
+        if (key == "models")
+        {
+            std::istringstream list(value);
+            std::string file;
+            while (std::getline(list, file, ',')) if (!file.empty()) req.models.push_back(file);
+        }
+        else if (key == "eye") ok = parse_vec(value, req.eye);
+        else if (key == "center") ok = parse_vec(value, req.center);
+        else if (key == "size") ok = sscanf(value.c_str(), "%dx%d", &req.width, &req.height) == 2;
+        else if (key == "msaa")
+        {
+            req.samples = atoi(value.c_str());
+            ok = req.samples == 1 || req.samples == 4 || req.samples == 8;
+        }
+        else if (key == "lit") req.lit = value != "0";
+        else if (key == "shadow")
+        {
+            req.shadowSize = atoi(value.c_str());
+            ok = req.shadowSize >= 1 && req.shadowSize <= kMaxSize;
+        }
+        else if (key == "ssao")
+        {
+            req.ssaoScale = atoi(value.c_str());
+            ok = req.ssaoScale >= 0 && req.ssaoScale <= 2;
+        }
+        else if (key == "budget") req.budget = std::max(0., atof(value.c_str()));
+        else if (key == "format") ok = FrameWriter::parse_format(value, req.format);
+        else ok = false;
+        if (!ok)
+        {
+            error = "bad field "+token;
+            return false;
+        }
+    }
+    if (req.models.empty()) error = "no models";
+    else if (req.width <= 0 || req.height <= 0 || req.width > kMaxSize || req.height > kMaxSize) error = "bad size";
+    else if (req.models.size() > 16) error = "too many models";
+    else if (req.budget >= 0. && req.ssaoScale > 0) error = "budget doesn't combine with ssao";
+    for (const std::string &file : req.models)
+    {
+        if (file.find("..") != std::string::npos || file[0] == '/') error = "model paths must stay in the models directory";
+    }
+    return error.empty();
+}
+
+//Loaded once, shared read only by every worker
+class ModelCache
+{
+private:
+    std::string dir_;
+    bool optimize_;
+    std::mutex mutex_;
+    std::map<std::string, Model*> models_;
+public:
+    ModelCache(const std::string &dir, bool optimize) : dir_(dir), optimize_(optimize), mutex_(), models_() {}
+    ~ModelCache() { for (auto &entry : models_) delete entry.second; }
+
+    Model *get(const std::string &file)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Model *&model = models_[file];
+        if (!model)
+        {
+            model = new Model((dir_+"/"+file).c_str(), optimize_);
+            if (model->nFaces() == 0) std::cerr << "warning: " << file << " has no faces\n";
+        }
+        return model;
+    }
+};
+
+//What a worker keeps from one request to the next
+struct WorkerFrame
+{
+    Renderer *renderer;
+    ProgressiveRenderer *progressive;
+    ShadowMap *shadow;
+    AmbientOcclusion *ssao;
+    int ssaoScale;
+    TGAImage image;
+
+    WorkerFrame() : renderer(nullptr), progressive(nullptr), shadow(nullptr), ssao(nullptr), ssaoScale(0), image() {}
+    ~WorkerFrame() { release(); }
+
+    //Also what a failed allocation leaves behind: the next request starts over
+    void release()
+    {
+        delete renderer;
+        delete progressive;
+        delete shadow;
+        delete ssao;
+        renderer = nullptr;
+        progressive = nullptr;
+        shadow = nullptr;
+        ssao = nullptr;
+        image = TGAImage();
+    }
+
+    void prepare(const RenderRequest &req)
+    {
+        if (!renderer || renderer->get_width() != req.width || renderer->get_height() != req.height
+            || renderer->get_samples() != req.samples)
+        {
+            release();
+            renderer = new Renderer(req.width, req.height, req.samples);
+            image = TGAImage(req.width, req.height, TGAImage::RGB);
+        }
+        if (req.budget >= 0. && !progressive) progressive = new ProgressiveRenderer(req.width, req.height, req.samples);
+        if (req.shadowSize > 0 && (!shadow || shadow->get_size() != req.shadowSize))
+        {
+            delete shadow;
+            shadow = nullptr;
+            shadow = new ShadowMap(req.shadowSize);
+        }
+        if (req.ssaoScale > 0 && (!ssao || ssaoScale != req.ssaoScale))
+        {
+            delete ssao;
+            ssao = nullptr;
+            ssao = new AmbientOcclusion(req.width, req.height, req.ssaoScale == 2);
+            ssaoScale = req.ssaoScale;
+        }
+    }
+};
+
+class RenderServer
+{
+private:
+    struct Pending
+    {
+        int fd;
+        Clock::time_point accepted;
+    };
+
+    ModelCache models_;
+    size_t capacity_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<Pending> queue_;
+    std::vector<int> active_;
+    bool closing_;
+    Metrics metrics_;
+
+    bool render(WorkerFrame &frame, const RenderRequest &req, std::string &bytes, std::string &error)
+    {
+        std::vector<Model*> models;
+        for (const std::string &file : req.models)
+        {
+            Model *model = models_.get(file);
+            if (model->nFaces() == 0)
+            {
+                error = "can't load "+file;
+                return false;
+            }
+            models.push_back(model);
+        }
+        frame.prepare(req);
+        //A budget covers the shadow map and the frame, not loading models or resizing the frame
+        const Clock::time_point start = Clock::now();
+        const Vec3f up(0, 1, 0), light(1, 1, 1);
+        ShadowMap *shadow = req.shadowSize > 0 ? frame.shadow : nullptr;
+        if (shadow) shadow->render(models, light, req.center, std::sqrt(3.f));
+        Matrix4f transform = projection(-1.f/(req.eye-req.center).norm())*lookat(req.eye, req.center, up);
+        std::vector<IShader*> shaders;
+        for (Model *model : models)
+        {
+            if (req.lit) shaders.push_back(new LitShader(model, transform, light, shadow));
+            else shaders.push_back(new FlatShader(model));
+        }
+        bytes.clear();
+        BufferOutput out(bytes);
+        FrameWriter writer(out, req.format, req.width, req.height);
+        if (req.budget >= 0.)
+        {
+            const double left = std::max(0., req.budget-elapsed_us(start)/1000.);
+            const ProgressiveRenderer::Stats stats = frame.progressive->render(models, shaders, left, frame.image);
+            for (IShader *shader : shaders) delete shader;
+            metrics_.progressive(stats, elapsed_us(start)/1000. > req.budget);
+            return writer.write_image(frame.image);
+        }
+        frame.renderer->clear();
+        for (size_t m = 0; m < models.size(); m++) frame.renderer->draw(*models[m], *shaders[m]);
+        for (IShader *shader : shaders) delete shader;
+        if (req.ssaoScale <= 0 || !frame.ssao) return frame.renderer->resolve(writer);
+        frame.renderer->resolve(frame.image);
+        frame.ssao->apply(frame.renderer->depth_buffer(), frame.renderer->get_samples(), req.width/2.f, frame.image);
+        return writer.write_image(frame.image);
+    }
+
+    void serve(Connection &conn, WorkerFrame &frame, Clock::time_point accepted)
+    {
+        std::string line, bytes, error;
+        bool first = true;
+        while (conn.read_line(line))
+        {
+            //the first request also pays for its time in the queue
+            Clock::time_point start = first ? accepted : Clock::now();
+            first = false;
+            if (line == "stats")
+            {
+                std::string json = metrics_.json();
+                if (!conn.write_all("OK "+std::to_string(json.size())+"\n"+json)) return;
+                continue;
+            }
+            RenderRequest req;
+            error.clear();
+            if (line.compare(0, 6, "render") != 0) error = "unknown command";
+            Clock::time_point renderStart = Clock::now();
+            try
+            {
+                if (error.empty() && parse_request(line, req, error) && !render(frame, req, bytes, error) && error.empty())
+                {
+                    error = "can't encode the frame";
+                }
+            }
+            catch (const std::bad_alloc &)
+            {
+                frame.release();
+                error = "out of memory";
+            }
+            const double renderUs = elapsed_us(renderStart);
+            if (!error.empty())
+            {
+                metrics_.error();
+                if (!conn.write_all("ERR "+error+"\n")) return;
+                continue;
+            }
+            //total covers queueing, parsing, rendering and encoding, up to the response being ready to send
+            const double totalUs = elapsed_us(start);
+            metrics_.record(totalUs/1000., renderUs/1000.);
+            std::string header = "OK "+std::to_string(bytes.size())+" "+std::to_string((long)renderUs)+" "+std::to_string((long)totalUs)+"\n";
+            if (!conn.write_all(header) || !conn.write_all(bytes)) return;
+        }
+    }
+
+    void worker()
+    {
+        WorkerFrame frame;
+        for (;;)
+        {
+            Pending pending;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ready_.wait(lock, [&]() { return closing_ || !queue_.empty(); });
+                if (queue_.empty()) return;
+                pending = queue_.front();
+                queue_.pop_front();
+                active_.push_back(pending.fd);
+            }
+            Connection conn(pending.fd);
+            serve(conn, frame, pending.accepted);
+            std::lock_guard<std::mutex> lock(mutex_);
+            active_.erase(std::find(active_.begin(), active_.end(), pending.fd));
+        }
+    }
+
+public:
+    RenderServer(const std::string &modelsDir, bool optimize, int capacity)
+    : models_(modelsDir, optimize), capacity_(std::max(1, capacity)), mutex_(), ready_(), queue_(), active_(), closing_(false), metrics_() {}
+
+    int run(const char *path, int workers)
+    {
+        bool ok;
+        sockaddr_un addr = socket_address(path, ok);
+        if (!ok) return 1;
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(path);
+        if (listener < 0 || bind(listener, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 64) != 0)
+        {
+            std::cerr << "can't listen on " << path << ": " << strerror(errno) << "\n";
+            if (listener >= 0) close(listener);
+            return 1;
+        }
+        std::signal(SIGPIPE, SIG_IGN);
+        std::signal(SIGINT, on_signal);
+        std::signal(SIGTERM, on_signal);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < workers; i++) threads.emplace_back(&RenderServer::worker, this);
+        std::cerr << "listening on " << path << " with " << workers << " workers, queue " << capacity_ << std::endl;
+
+        while (!stopping)
+        {
+            pollfd pfd = {listener, POLLIN, 0};
+            if (poll(&pfd, 1, 200) <= 0) continue;
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd < 0) continue;
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (queue_.size() >= capacity_)
+            {
+                lock.unlock();
+                metrics_.reject();
+                Connection rejected(fd);
+                rejected.write_all("ERR busy\n");
+                continue;
+            }
+            queue_.push_back({fd, Clock::now()});
+            lock.unlock();
+            ready_.notify_one();
+        }
+
+        close(listener);
+        unlink(path);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closing_ = true;
+            for (const Pending &pending : queue_) close(pending.fd);
+            queue_.clear();
+            //wakes workers blocked on idle connections, a request being rendered still gets its answer
+            for (int fd : active_) shutdown(fd, SHUT_RD);
+        }
+        ready_.notify_all();
+        for (std::thread &t : threads) t.join();
+        std::cerr << metrics_.json() << std::endl;
+        return 0;
+    }
+};
+
+int connect_to(const char *path)
+{
+    bool ok;
+    sockaddr_un addr = socket_address(path, ok);
+    if (!ok) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+}
+
+int run_server(int argc, const char *argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: TinyRenderer --serve socket [--workers n] [--queue n] [--models dir] [-O]\n";
+        return 2;
+    }
+    const char *path = argv[1];
+    std::string models = "Models";
+    int workers = 2;
+    int queue = 8;
+    bool optimize = false;
+    for (int i = 2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--workers") && i+1 < argc) workers = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--queue") && i+1 < argc) queue = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--models") && i+1 < argc) models = argv[++i];
+        else if (!strcmp(argv[i], "-O")) optimize = true;
+    }
+    RenderServer server(models, optimize, queue);
+    return server.run(path, workers);
+}
+
+//Every client holds one connection and keeps one request in flight, so --clients is the concurrency.
+//A connection refused with "ERR busy" is counted and retried after a short pause.
+int run_loadgen(int argc, const char *argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: TinyRenderer --loadgen socket [--clients n] [--requests n] [request fields...]\n";
+        return 2;
+    }
+    const char *path = argv[1];
+    int clients = 4;
+    int requests = 50;
+    std::string fields;
+    for (int i = 2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--clients") && i+1 < argc) clients = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--requests") && i+1 < argc) requests = std::max(1, atoi(argv[++i]));
+        else fields += std::string(" ")+argv[i];
+    }
+    if (fields.find("models=") == std::string::npos) fields += " models=african_head/african_head.obj";
+    const std::string request = "render"+fields+"\n";
+
+    std::mutex mutex;
+    std::vector<float> latencies;
+    long errors = 0, rejected = 0, bytes = 0;
+    std::string firstError;
+    std::vector<std::thread> threads;
+    Clock::time_point start = Clock::now();
+    for (int c = 0; c < clients; c++)
+    {
+        threads.emplace_back([&]()
+        {
+            std::vector<float> mine;
+            long myErrors = 0, myRejected = 0, myBytes = 0;
+            std::string line, payload, error;
+            int done = 0;
+            while (done < requests)
+            {
+                int fd = connect_to(path);
+                if (fd < 0)
+                {
+                    error = std::string("can't connect: ")+strerror(errno);
+                    myErrors += requests-done;
+                    break;
+                }
+                Connection conn(fd);
+                for (; done < requests; done++)
+                {
+                    Clock::time_point sent = Clock::now();
+                    if (!conn.write_all(request) || !conn.read_line(line)) break;
+                    if (line == "ERR busy")
+                    {
+                        myRejected++;
+                        break;
+                    }
+                    size_t size = 0;
+                    if (sscanf(line.c_str(), "OK %zu", &size) != 1)
+                    {
+                        if (error.empty()) error = line;
+                        myErrors++;
+                        continue;
+                    }
+                    if (!conn.read_exact(size, payload)) break;
+                    mine.push_back(elapsed_us(sent)/1000.);
+                    myBytes += size;
+                }
+                if (done < requests) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            latencies.insert(latencies.end(), mine.begin(), mine.end());
+            errors += myErrors;
+            rejected += myRejected;
+            bytes += myBytes;
+            if (firstError.empty()) firstError = error;
+        });
+    }
+    for (std::thread &t : threads) t.join();
+    const double seconds = std::chrono::duration<double>(Clock::now()-start).count();
+    std::sort(latencies.begin(), latencies.end());
+    printf("%zu requests in %.2f s from %d clients: %.1f req/s, %.1f MB/s\n", latencies.size(), seconds, clients,
+           latencies.size()/seconds, bytes/seconds/1e6);
+    printf("latency ms: p50 %.2f, p95 %.2f, p99 %.2f, max %.2f\n", percentile(latencies, .5f), percentile(latencies, .95f),
+           percentile(latencies, .99f), latencies.empty() ? 0.f : latencies.back());
+    printf("errors %ld, rejected connections %ld\n", errors, rejected);
+    if (!firstError.empty()) printf("first error: %s\n", firstError.c_str());
+
+    int fd = connect_to(path);
+    if (fd >= 0)
+    {
+        Connection conn(fd);
+        std::string line, json;
+        size_t size = 0;
+        if (conn.write_all("stats\n") && conn.read_line(line) && sscanf(line.c_str(), "OK %zu", &size) == 1 && conn.read_exact(size, json))
+        {
+            printf("server: %s\n", json.c_str());
+        }
+    }
+    return errors ? 1 : 0;
+}
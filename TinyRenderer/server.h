@@ -0,0 +1,28 @@
+//
+//  server.h
+//  TinyRenderer
+//
+//  Long running render server on a Unix domain socket, and a load generator to measure it.
+//
+//  Protocol, one request per line, any number of requests per connection:
+//    render models=a.obj[,b.obj...] [eye=x,y,z] [center=x,y,z] [size=WxH] [msaa=1|4|8]
+//           [lit=0|1] [shadow=size] [ssao=0|1|2] [budget=ms] [format=tga|tga-raw|rgb|rgba|ppm]
+//      -> "OK <bytes> <render us> <total us>\n" followed by the image bytes
+//      budget renders a progressive frame (see progressive.h) ready within about ms, shadow
+//      map included but not first loads of models; not with ssao
+//    stats
+//      -> "OK <bytes>\n" followed by a JSON object with the latency metrics, and for the
+//         requests with a budget how many overran it and the share of tiles refined
+//  Errors come back as "ERR <message>\n". Model paths are relative to the server's models
+//  directory. Raw rgb/rgba rows are written top to bottom.
+//
+
+#ifndef server_h
+#define server_h
+
+//TinyRenderer --serve socket [--workers n] [--queue n] [--models dir] [-O]
+int run_server(int argc, const char *argv[]);
+//TinyRenderer --loadgen socket [--clients n] [--requests n] [request fields...]
+int run_loadgen(int argc, const char *argv[]);
+
+#endif /* server_h */
@@ -0,0 +1,196 @@
+//
+//  shaders.h
+//  TinyRenderer
+//
+//  The shaders used by the renderer's entry points (main and the benchmarks).
+//
+
+#ifndef shaders_h
+#define shaders_h
+
+#include <algorithm>
+#include <vector>
+#include "our_gl.h"
+#include "model.h"
+#include "shadow.h"
+#include "lights.h"
+#include "tonemap.h"
+
+//Deterministic color of a face so that flat shaded frames are reproducible across runs and platforms
+inline TGAColor face_color(int iface)
+{
+    unsigned int h = (unsigned int)iface*0x9e3779b1u;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return TGAColor(h&255, (h >> 8)&255, (h >> 16)&255, 255);
+}
+
+struct FlatShader : public IShader
+{
+    Model *model;
+    std::vector<TGAColor> colors;
+    
+    FlatShader(Model *m) : model(m), colors()
+    {
+        colors.reserve(m->nFaces());
+        for (int i = 0; i < m->nFaces(); i++) colors.push_back(face_color(i));
+    }
+    
+    virtual Vec4f vertex(int iface, int nthvert) const
+    {
+        return embed<4>(model->vert(iface, nthvert));
+    }
+    
+    virtual bool fragment(int iface, Vec3f, TGAColor &color) const
+    {
+        color = colors[iface];
+        return false;
+    }
+};
+
+//Diffuse texture with lambert lighting from a directional light, attenuated by the shadow map when there is one.
+//Models that ship a _nm_tangent map get their normals perturbed in tangent space.
+struct LitShader : public IShader
+{
+    Model *model;
+    Matrix4f transform;
+    Vec3f light;
+    const ShadowMap *shadow;
+    
+    LitShader(Model *m, const Matrix4f &t, Vec3f l, const ShadowMap *s) : model(m), transform(t), light(l), shadow(s)
+    {
+        light.normalize();
+    }
+    
+    virtual Vec4f vertex(int iface, int nthvert) const
+    {
+        return transform*embed<4>(model->vert(iface, nthvert));
+    }
+    
+    //Interpolated uv, world position and normal, perturbed by the normal map when there is one
+    void surface(int iface, Vec3f bar, Vec2f &uv, Vec3f &n, Vec3f &p) const
+    {
+        uv = Vec2f();
+        n = Vec3f();
+        p = Vec3f();
+        for (int i = 0; i < 3; i++)
+        {
+            uv = uv+model->uv(iface, i)*bar[i];
+            n = n+model->normal(iface, i)*bar[i];
+            p = p+model->vert(iface, i)*bar[i];
+        }
+        n.normalize();
+        if (model->has_normalmap())
+        {
+            //The tangent frame is precomputed per vertex, only interpolation is left here
+            Vec3f t, b;
+            for (int i = 0; i < 3; i++)
+            {
+                t = t+model->tangent(iface, i)*bar[i];
+                b = b+model->bitangent(iface, i)*bar[i];
+            }
+            Vec3f nm = model->normal(uv);
+            n = (t.normalize()*nm.x+b.normalize()*nm.y+n*nm.z).normalize();
+        }
+    }
+    
+    //Linear diffuse color, white without a texture
+    Vec3f albedo(Vec2f uv) const
+    {
+        return model->has_diffuse() ? srgb_to_linear(model->diffuse(uv)) : Vec3f(1.f, 1.f, 1.f);
+    }
+    
+    float lambert(const Vec3f &n, const Vec3f &p) const
+    {
+        float diff = std::max(0.f, n*light);
+        if (shadow && diff > 0.f) diff *= shadow->visibility(p);
+        return .2f+.8f*diff;
+    }
+    
+    virtual bool fragment(int iface, Vec3f bar, TGAColor &color) const
+    {
+        Vec2f uv;
+        Vec3f n, p;
+        surface(iface, bar, uv, n, p);
+        color = (model->has_diffuse() ? model->diffuse(uv) : TGAColor(255, 255, 255))*lambert(n, p);
+        return false;
+    }
+    
+    virtual bool fragment_hdr(int iface, Vec3f bar, Vec3f &color) const
+    {
+        Vec2f uv;
+        Vec3f n, p;
+        surface(iface, bar, uv, n, p);
+        color = albedo(uv)*lambert(n, p);
+        return false;
+    }
+};
+
+//LitShader with a constant opacity, for Renderer::draw_transparent
+struct GlassShader : public LitShader
+{
+    float opacity;
+    
+    GlassShader(Model *m, const Matrix4f &t, Vec3f l, const ShadowMap *s, float o) : LitShader(m, t, l, s), opacity(o) {}
+    
+    virtual bool fragment(int iface, Vec3f bar, TGAColor &color) const
+    {
+        LitShader::fragment(iface, bar, color);
+        color.bgra[3] = (unsigned char)(std::min(std::max(opacity, 0.f), 1.f)*255.f+.5f);
+        return false;
+    }
+};
+
+//Diffuse texture lit by point and spot lights over a dim ambient term. With a grid only the
+//lights of the fragment's tile are evaluated, which needs the frame's depth prepass and
+//LightGrid::cull before the color pass. Without one every light is.
+struct LightsShader : public LitShader
+{
+    const std::vector<Light> *lights;
+    const LightGrid *grid;
+    
+    LightsShader(Model *m, const Matrix4f &t, const std::vector<Light> *l, const LightGrid *g) : LitShader(m, t, Vec3f(0, 0, 1), nullptr), lights(l), grid(g) {}
+    
+    //Ambient plus every light reaching p, in rgb
+    Vec3f irradiance(const Vec3f &n, const Vec3f &p) const
+    {
+        Vec3f sum(.1f, .1f, .1f);
+        if (grid)
+        {
+            int count;
+            const int *indices = grid->lights_at(p, count);
+            for (int k = 0; k < count; k++) sum = sum+light_contribution((*lights)[indices[k]], p, n);
+        }
+        else
+        {
+            for (const Light &light : *lights) sum = sum+light_contribution(light, p, n);
+        }
+        return sum;
+    }
+    
+    virtual bool fragment(int iface, Vec3f bar, TGAColor &color) const
+    {
+        Vec2f uv;
+        Vec3f n, p;
+        surface(iface, bar, uv, n, p);
+        const Vec3f sum = irradiance(n, p);
+        color = model->has_diffuse() ? model->diffuse(uv) : TGAColor(255, 255, 255);
+        for (int c = 0; c < 3; c++) color.bgra[2-c] = (unsigned char)std::min(255.f, color.bgra[2-c]*sum[c]);
+        return false;
+    }
+    
+    virtual bool fragment_hdr(int iface, Vec3f bar, Vec3f &color) const
+    {
+        Vec2f uv;
+        Vec3f n, p;
+        surface(iface, bar, uv, n, p);
+        const Vec3f sum = irradiance(n, p), a = albedo(uv);
+        color = Vec3f(a.x*sum.x, a.y*sum.y, a.z*sum.z);
+        return false;
+    }
+};
+
+#endif /* shaders_h */
@@ -0,0 +1,98 @@
+//
+//  shadow.cpp
+//  TinyRenderer
+//
+
+#include <algorithm>
+#include <cmath>
+#include "shadow.h"
+#include "profiler.h"
+
+namespace
+{
+struct DepthShader : public IShader
+{
+    Model *model;
+    Matrix4f view;
+    
+    DepthShader(Model *m, const Matrix4f &v) : model(m), view(v) {}
+    
+    virtual Vec4f vertex(int iface, int nthvert) const
+    {
+        return view*embed<4>(model->vert(iface, nthvert));
+    }
+    
+    virtual bool fragment(int, Vec3f, TGAColor &) const
+    {
+        return true;
+    }
+};
+}
+
+ShadowMap::ShadowMap(int size, DepthBuffer::Format format)
+: renderer_(size, size, 1, format), size_(size), view_(Matrix4f::identity()), transform_(Matrix4f::identity()), depth_(nullptr), bias_(0.f)
+{
+    renderer_.set_color_write(false);
+}
+
+int ShadowMap::get_size()
+{
+    return size_;
+}
+
+void ShadowMap::render(std::vector<Model*> &models, Vec3f lightDir, Vec3f center, float radius)
+{
+    PROFILE_SCOPE("shadow pass");
+    Vec3f up = std::abs(lightDir.normalize().y) > .99f ? Vec3f(0, 0, 1) : Vec3f(0, 1, 0);
+    Matrix4f scale = Matrix4f::identity();
+    for (int i = 0; i < 3; i++) scale[i][i] = 1.f/radius;
+    view_ = scale*lookat(center+lightDir, center, up);
+    transform_ = viewport(0, 0, size_, size_)*view_;
+    //Four texels worth of depth (the scene spans size_ texels over 2 depth units) keeps the
+    //acne off the grazing parts of the bundled models
+    bias_ = 8.f/size_;
+    
+    renderer_.clear();
+    for (Model *model : models)
+    {
+        renderer_.draw(*model, DepthShader(model, view_));
+    }
+    depth_ = &renderer_.depth_buffer();
+}
+
+float ShadowMap::visibility(Vec3f world) const
+{
+    Vec4f p = transform_*embed<4>(world);
+    const int x = (int)std::floor(p[0]);
+    const int y = (int)std::floor(p[1]);
+    if (!depth_ || x < 0 || y < 0 || x >= size_ || y >= size_) return 1.f;
+    const float z = p[2]+bias_;
+    switch (depth_->get_format())
+    {
+        case DepthBuffer::FLOAT32: return lit_fraction<Float32Depth>(x, y, z);
+        case DepthBuffer::D24S8: return lit_fraction<Unorm24Depth>(x, y, z);
+        case DepthBuffer::D16: return lit_fraction<Unorm16Depth>(x, y, z);
+        case DepthBuffer::FLOAT32_REVERSED: return lit_fraction<ReversedDepth>(x, y, z);
+    }
+    return 1.f;
+}
+
+template <class D>
+float ShadowMap::lit_fraction(int x, int y, float z) const
+{
+    //The point is compared in the map's own encoding, it is converted once instead of every texel
+    const typename D::Key key = D::encode(z, depth_->get_scale(), depth_->get_offset());
+    const typename D::Value *depth = depth_->data<typename D::Value>();
+    const int x0 = std::max(0, x-1), x1 = std::min(size_-1, x+1);
+    const int y0 = std::max(0, y-1), y1 = std::min(size_-1, y+1);
+    //Branch free compares so the rows vectorize
+    float lit = 0.f;
+    int taps = 0;
+    for (int j = y0; j <= y1; j++)
+    {
+        const typename D::Value *row = depth+j*size_;
+        for (int i = x0; i <= x1; i++) lit += (float)(D::key(row[i]) <= key);
+        taps += x1-x0+1;
+    }
+    return lit/taps;
+}
@@ -0,0 +1,40 @@
+//
+//  shadow.h
+//  TinyRenderer
+//
+//  Shadow map for a directional light. The depth pass goes through the same binned
+//  Renderer as the main pass, with color writes off. The light's projection is orthographic,
+//  so depth is linear and 16 bits resolve far finer than the bias; D16 is the default.
+//
+
+#ifndef shadow_h
+#define shadow_h
+
+#include <vector>
+#include "geometry.h"
+#include "model.h"
+#include "renderer.h"
+
+class ShadowMap
+{
+private:
+    Renderer renderer_;
+    int size_;
+    Matrix4f view_;      // world -> light space, scaled so that the scene fits in [-1,1]
+    Matrix4f transform_; // world -> shadow map texels
+    const DepthBuffer *depth_;
+    float bias_;
+    
+    template <class D>
+    float lit_fraction(int x, int y, float z) const;
+public:
+    ShadowMap(int size, DepthBuffer::Format format = DepthBuffer::D16);
+    
+    //center/radius bound the part of the scene that has to fit in the map
+    void render(std::vector<Model*> &models, Vec3f lightDir, Vec3f center, float radius);
+    //Fraction of the 3x3 texels around the point that see the light (1 is fully lit)
+    float visibility(Vec3f world) const;
+    int get_size();
+};
+
+#endif /* shadow_h */
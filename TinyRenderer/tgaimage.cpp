@@ -5,19 +5,22 @@
 //  Created by Sherwin Rad on 12/27/21.
 //
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <string.h>
 #include <time.h>
 #include <math.h>
 #include "tgaimage.h"
+#include "profiler.h"
+#include "resample.h"
 
 TGAImage::TGAImage()
-: data(nullptr), width(0), height(0), bytespp(0)
+: data(nullptr), width(0), height(0), bytespp(0), origin(TOP_LEFT)
 {}
 
 TGAImage::TGAImage(int w, int h, int bpp)
-: data(nullptr), width(w), height(h), bytespp(bpp)
+: data(nullptr), width(w), height(h), bytespp(bpp), origin(TOP_LEFT)
 {
     unsigned long nbytes = width*height*bytespp;
     data = new unsigned char[nbytes];
@@ -25,7 +28,7 @@ TGAImage::TGAImage(int w, int h, int bpp)
 }
 
 TGAImage::TGAImage(const TGAImage &img)
-: data(nullptr), width(img.width), height(img.height), bytespp(img.bytespp)
+: data(nullptr), width(img.width), height(img.height), bytespp(img.bytespp), origin(img.origin)
 {
     unsigned long nbytes = width*height*bytespp;
     data = new unsigned char[nbytes];
@@ -45,6 +48,7 @@ TGAImage & TGAImage::operator =(const TGAImage &img)
         width  = img.width;
         height = img.height;
         bytespp = img.bytespp;
+        origin = img.origin;
         unsigned long nbytes = width*height*bytespp;
         data = new unsigned char[nbytes];
         memcpy(data, img.data, nbytes);
@@ -52,23 +56,30 @@ TGAImage & TGAImage::operator =(const TGAImage &img)
     return *this;
 }
 
-bool TGAImage::read_tga_file(const char *filename)
+bool TGAImage::read_tga_file(const char *filename, int want)
 {
-    if (data) delete [] data;
-    data = nullptr;
     std::ifstream in;
     in.open (filename, std::ios::binary);
     if (!in.is_open())
     {
+        if (data) delete [] data;
+        data = nullptr;
         std::cerr << "can't open file " << filename << "\n";
         in.close();
         return false;
     }
+    return read_tga(in, want);
+}
+
+bool TGAImage::read_tga(std::istream &in, int want)
+{
+    PROFILE_SCOPE("tga load");
+    if (data) delete [] data;
+    data = nullptr;
     TGA_Header header;
     in.read((char *)&header, sizeof(header));
     if (!in.good())
     {
-        in.close();
         std::cerr << "an error occured while reading the header\n";
         return false;
     }
@@ -77,7 +88,6 @@ bool TGAImage::read_tga_file(const char *filename)
     bytespp = header.bitsperpixel>>3;
     if (width<=0 || height<=0 || (bytespp!=GRAYSCALE && bytespp!=RGB && bytespp!=RGBA))
     {
-        in.close();
         std::cerr << "bad bpp (or width/height) value\n";
         return false;
     }
@@ -88,7 +98,6 @@ bool TGAImage::read_tga_file(const char *filename)
         in.read((char *)data, nbytes);
         if (!in.good())
         {
-            in.close();
             std::cerr << "an error occured while reading the data\n";
             return false;
         }
@@ -96,31 +105,30 @@ bool TGAImage::read_tga_file(const char *filename)
     {
         if (!load_rle_data(in))
         {
-            in.close();
             std::cerr << "an error occured while reading the data\n";
             return false;
         }
     }
     else
     {
-        in.close();
         std::cerr << "unknown file format " << (int)header.datatypecode << "\n";
         return false;
     }
-    if (!(header.imagedescriptor & 0x20))
+    origin = (header.imagedescriptor & 0x20) ? TOP_LEFT : BOTTOM_LEFT;
+    if (origin != want)
     {
         flip_vertically();
+        origin = want;
     }
     if (header.imagedescriptor & 0x10)
     {
         flip_horizontally();
     }
     std::cerr << width << "x" << height << "/" << bytespp*8 << "\n";
-    in.close();
     return true;
 }
 
-bool TGAImage::load_rle_data(std::ifstream &in)
+bool TGAImage::load_rle_data(std::istream &in)
 {
     unsigned long pixelcount = width*height;
     unsigned long currentpixel = 0;
@@ -183,9 +191,7 @@ bool TGAImage::load_rle_data(std::ifstream &in)
 
 bool TGAImage::write_tga_file(const char *filename, bool rle)
 {
-    unsigned char developer_area_ref[4] = {0, 0, 0, 0};
-    unsigned char extension_area_ref[4] = {0, 0, 0, 0};
-    unsigned char footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
+    PROFILE_SCOPE("tga write");
     std::ofstream out;
     out.open (filename, std::ios::binary);
     if (!out.is_open())
@@ -194,17 +200,26 @@ bool TGAImage::write_tga_file(const char *filename, bool rle)
         out.close();
         return false;
     }
+    bool ok = write_tga(out, rle);
+    out.close();
+    return ok;
+}
+
+bool TGAImage::write_tga(std::ostream &out, bool rle)
+{
+    unsigned char developer_area_ref[4] = {0, 0, 0, 0};
+    unsigned char extension_area_ref[4] = {0, 0, 0, 0};
+    unsigned char footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
     TGA_Header header;
     memset((void *)&header, 0, sizeof(header));
     header.bitsperpixel = bytespp<<3;
     header.width  = width;
     header.height = height;
     header.datatypecode = (bytespp==GRAYSCALE?(rle?11:3):(rle?10:2));
-    header.imagedescriptor = 0x20; // top-left origin
+    header.imagedescriptor = origin == TOP_LEFT ? 0x20 : 0x00;
     out.write((char *)&header, sizeof(header));
     if (!out.good())
     {
-        out.close();
         std::cerr << "can't dump the tga file\n";
         return false;
     }
@@ -214,44 +229,28 @@ bool TGAImage::write_tga_file(const char *filename, bool rle)
         if (!out.good())
         {
             std::cerr << "can't unload raw data\n";
-            out.close();
             return false;
         }
     } else {
         if (!unload_rle_data(out))
         {
-            out.close();
             std::cerr << "can't unload rle data\n";
             return false;
         }
     }
     out.write((char *)developer_area_ref, sizeof(developer_area_ref));
-    if (!out.good())
-    {
-        std::cerr << "can't dump the tga file\n";
-        out.close();
-        return false;
-    }
     out.write((char *)extension_area_ref, sizeof(extension_area_ref));
-    if (!out.good())
-    {
-        std::cerr << "can't dump the tga file\n";
-        out.close();
-        return false;
-    }
     out.write((char *)footer, sizeof(footer));
     if (!out.good())
     {
         std::cerr << "can't dump the tga file\n";
-        out.close();
         return false;
     }
-    out.close();
     return true;
 }
 
 // TODO: it is not necessary to break a raw chunk for two equal pixels (for the matter of the resulting size)
-bool TGAImage::unload_rle_data(std::ofstream &out)
+bool TGAImage::unload_rle_data(std::ostream &out)
 {
     const unsigned char max_chunk_length = 128;
     unsigned long npixels = width*height;
@@ -336,6 +335,16 @@ int TGAImage::get_bytespp()
     return bytespp;
 }
 
+int TGAImage::get_origin()
+{
+    return origin;
+}
+
+void TGAImage::set_origin(int o)
+{
+    origin = o;
+}
+
 int TGAImage::get_width()
 {
     return width;
@@ -346,37 +355,55 @@ int TGAImage::get_height()
     return height;
 }
 
-bool TGAImage::flip_horizontally()
+// swaps pixels from both ends of a row, the fixed pixel size lets the compiler unroll and vectorize the loop
+template <int N>
+static void reverse_row(unsigned char *row, int width)
 {
-    if (!data) return false;
-    int half = width>>1;
-    for (int i=0; i<half; i++)
+    unsigned char *a = row;
+    unsigned char *b = row+(width-1)*N;
+    for (; a < b; a += N, b -= N)
     {
-        for (int j=0; j<height; j++)
+        for (int c=0; c<N; c++)
         {
-            TGAColor c1 = get(i, j);
-            TGAColor c2 = get(width-1-i, j);
-            set(i, j, c2);
-            set(width-1-i, j, c1);
+            unsigned char t = a[c];
+            a[c] = b[c];
+            b[c] = t;
         }
     }
+}
+
+bool TGAImage::flip_horizontally()
+{
+    if (!data) return false;
+    for (int j=0; j<height; j++)
+    {
+        unsigned char *row = data+(unsigned long)j*width*bytespp;
+        if (bytespp==GRAYSCALE) reverse_row<1>(row, width);
+        else if (bytespp==RGB) reverse_row<3>(row, width);
+        else reverse_row<4>(row, width);
+    }
     return true;
 }
 
 bool TGAImage::flip_vertically()
 {
     if (!data) return false;
-    unsigned long bytes_per_line = width*bytespp;
-    unsigned char *line = new unsigned char[bytes_per_line];
+    const unsigned long bytes_per_line = width*bytespp;
+    // lines are swapped through a small stack buffer in cache sized chunks, no allocation
+    unsigned char chunk[4096];
     int half = height>>1;
-    for (int j=0; j<half; j++) {
-        unsigned long l1 = j*bytes_per_line;
-        unsigned long l2 = (height-1-j)*bytes_per_line;
-        memmove((void *)line,      (void *)(data+l1), bytes_per_line);
-        memmove((void *)(data+l1), (void *)(data+l2), bytes_per_line);
-        memmove((void *)(data+l2), (void *)line,      bytes_per_line);
+    for (int j=0; j<half; j++)
+    {
+        unsigned char *l1 = data+j*bytes_per_line;
+        unsigned char *l2 = data+(height-1-j)*bytes_per_line;
+        for (unsigned long off=0; off<bytes_per_line; off+=sizeof(chunk))
+        {
+            unsigned long n = std::min((unsigned long)sizeof(chunk), bytes_per_line-off);
+            memcpy(chunk, l1+off, n);
+            memcpy(l1+off, l2+off, n);
+            memcpy(l2+off, chunk, n);
+        }
     }
-    delete [] line;
     return true;
 }
 
@@ -393,38 +420,11 @@ void TGAImage::clear()
 bool TGAImage::scale(int w, int h)
 {
     if (w<=0 || h<=0 || !data) return false;
-    unsigned char *tdata = new unsigned char[w*h*bytespp];
-    int nscanline = 0;
-    int oscanline = 0;
-    int erry = 0;
-    unsigned long nlinebytes = w*bytespp;
-    unsigned long olinebytes = width*bytespp;
-    for (int j=0; j<height; j++) {
-        int errx = width-w;
-        int nx   = -bytespp;
-        int ox   = -bytespp;
-        for (int i=0; i<width; i++) {
-            ox += bytespp;
-            errx += w;
-            while (errx>=(int)width) {
-                errx -= width;
-                nx += bytespp;
-                memcpy(tdata+nscanline+nx, data+oscanline+ox, bytespp);
-            }
-        }
-        erry += h;
-        oscanline += olinebytes;
-        while (erry>=(int)height) {
-            if (erry>=(int)height<<1) // it means we jump over a scanline
-                memcpy(tdata+nscanline+nlinebytes, tdata+nscanline, nlinebytes);
-            erry -= height;
-            nscanline += nlinebytes;
-        }
-    }
-    delete [] data;
-    data = tdata;
+    TGAImage scaled(w, h, bytespp);
+    Resampler resampler(Resampler::LANCZOS3);
+    resampler.resample(*this, scaled);
+    std::swap(data, scaled.data);
     width = w;
     height = h;
     return true;
 }
-
@@ -95,21 +95,33 @@ protected:
     int width;
     int height;
     int bytespp;
+    int origin;
     
-    bool   load_rle_data(std::ifstream &in);
-    bool unload_rle_data(std::ofstream &out);
+    bool   load_rle_data(std::istream &in);
+    bool unload_rle_data(std::ostream &out);
 public:
     enum Format {
         GRAYSCALE=1, RGB=3, RGBA=4
     };
+    //Which corner of the picture the first row of data starts at. It only changes how
+    //the rows are written out (the TGA descriptor bit), get/set always address data rows.
+    enum Origin {
+        TOP_LEFT=0, BOTTOM_LEFT=1
+    };
     
     TGAImage();
     TGAImage(int w, int h, int bpp);
     TGAImage(const TGAImage &img);
-    bool read_tga_file(const char *filename);
+    //Rows are flipped while loading only when the file's origin isn't the requested one
+    bool read_tga_file(const char *filename, int want=TOP_LEFT);
+    //Same decoding from any stream (a file already read into memory...)
+    bool read_tga(std::istream &in, int want=TOP_LEFT);
     bool write_tga_file(const char *filename, bool rle=true);
+    //Same encoding as write_tga_file into any stream (a memory buffer, a socket wrapper...)
+    bool write_tga(std::ostream &out, bool rle=true);
     bool flip_horizontally();
     bool flip_vertically();
+    //Lanczos resampling in place, use a Resampler directly to pick the filter or avoid the allocation
     bool scale(int w, int h);
     TGAColor get(int x, int y);
     bool set(int x, int y, TGAColor &c);
@@ -119,6 +131,8 @@ public:
     int get_width();
     int get_height();
     int get_bytespp();
+    int get_origin();
+    void set_origin(int o);
     unsigned char *buffer();
     void clear();
 };
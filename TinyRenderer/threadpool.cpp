@@ -0,0 +1,116 @@
+//
+//  threadpool.cpp
+//  TinyRenderer
+//
+
+#include <string>
+#include "threadpool.h"
+#include "profiler.h"
+
+namespace
+{
+int instanceSize = 0;
+std::atomic<bool> instanceCreated(false);
+
+//Called once, while instance() constructs the pool
+int take_instance_size()
+{
+    instanceCreated = true;
+    return instanceSize;
+}
+}
+
+ThreadPool::ThreadPool(int nThreads)
+: threads_(), submit_(), mutex_(), call_(nullptr), fn_(nullptr), count_(0), next_(0), pending_(0), generation_(0), stop_(false)
+{
+    if (nThreads <= 0) nThreads = (int)std::thread::hardware_concurrency();
+    for (int i = 1; i < nThreads; i++)
+    {
+        threads_.emplace_back(&ThreadPool::worker, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread &t : threads_) t.join();
+}
+
+int ThreadPool::size()
+{
+    return (int)threads_.size()+1;
+}
+
+void ThreadPool::run(int id)
+{
+    for (int i = next_++; i < count_; i = next_++)
+    {
+        call_(fn_, i, id);
+    }
+}
+
+void ThreadPool::worker(int id)
+{
+    PROFILE_ONLY(profiler::set_thread_name(("worker "+std::to_string(id)).c_str());)
+    unsigned int seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&]() { return stop_ || generation_ != seen; });
+            if (stop_) return;
+            seen = generation_;
+        }
+        {
+            PROFILE_SCOPE("pool job");
+            run(id);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--pending_ == 0) done_.notify_one();
+        }
+    }
+}
+
+void ThreadPool::dispatch(int count, void (*call)(const void*, int, int), const void *fn)
+{
+    if (count <= 0) return;
+    if (threads_.empty() || count == 1)
+    {
+        for (int i = 0; i < count; i++) call(fn, i, 0);
+        return;
+    }
+    std::lock_guard<std::mutex> turn(submit_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        call_ = call;
+        fn_ = fn;
+        count_ = count;
+        next_ = 0;
+        pending_ = (int)threads_.size();
+        generation_++;
+    }
+    wake_.notify_all();
+    run(0);
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [&]() { return pending_ == 0; });
+    call_ = nullptr;
+    fn_ = nullptr;
+}
+
+ThreadPool &ThreadPool::instance()
+{
+    static ThreadPool pool(take_instance_size());
+    return pool;
+}
+
+bool ThreadPool::set_instance_size(int nThreads)
+{
+    if (instanceCreated) return false;
+    instanceSize = nThreads;
+    return true;
+}
@@ -0,0 +1,67 @@
+//
+//  threadpool.h
+//  TinyRenderer
+//
+
+#ifndef threadpool_h
+#define threadpool_h
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Fixed set of worker threads used by the renderer for tiles and row bands.
+//parallel_for is not reentrant: don't call it from inside a job. Calls from different threads
+//are safe, they take turns on the pool.
+class ThreadPool
+{
+private:
+    std::vector<std::thread> threads_;
+    std::mutex submit_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    void (*call_)(const void *fn, int idx, int threadId);
+    const void *fn_;
+    int count_;
+    std::atomic<int> next_;
+    int pending_;
+    unsigned int generation_;
+    bool stop_;
+    
+    void worker(int id);
+    void run(int id);
+    void dispatch(int count, void (*call)(const void*, int, int), const void *fn);
+    
+    template <class Fn>
+    static void invoke(const void *fn, int idx, int threadId)
+    {
+        (*(const Fn *)fn)(idx, threadId);
+    }
+public:
+    ThreadPool(int nThreads = 0); // 0 means one per hardware thread
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+    
+    //Number of threads taking part in a parallel_for, the calling thread included
+    int size();
+    //Calls fn(index, threadId) for every index in [0, count) and returns once all are done.
+    //fn is called through a reference, it is never copied into a std::function (which
+    //would allocate for any lambda capturing more than a couple of references).
+    template <class Fn>
+    void parallel_for(int count, const Fn &fn)
+    {
+        dispatch(count, &invoke<Fn>, &fn);
+    }
+    
+    //The pool shared by the renderer, created on first use
+    static ThreadPool &instance();
+    //Size of the shared pool, 0 for one thread per hardware thread. Only takes effect before
+    //the first instance(): returns false once the pool exists.
+    static bool set_instance_size(int nThreads);
+};
+
+#endif /* threadpool_h */
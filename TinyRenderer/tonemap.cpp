@@ -0,0 +1,162 @@
+//
+//  tonemap.cpp
+//  TinyRenderer
+//
+
+#include <cmath>
+#include <cstring>
+#include "tonemap.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+//Linear [0, 1] in steps of 1/(kLutSize-1). 4096 entries keep the darkest step under one 8 bit sRGB code.
+const int kLutSize = 4096;
+const char *kCurveNames[3] = {"clamp", "reinhard", "aces"};
+//Narkowicz's fit of the ACES filmic curve
+const float kAcesA = 2.51f, kAcesB = .03f, kAcesC = 2.43f, kAcesD = .59f, kAcesE = .14f;
+
+struct Tables
+{
+    unsigned char encode[kLutSize];
+    float decode[256];
+    
+    Tables()
+    {
+        for (int i = 0; i < kLutSize; i++)
+        {
+            const float v = i/(float)(kLutSize-1);
+            const float s = v <= .0031308f ? 12.92f*v : 1.055f*std::pow(v, 1.f/2.4f)-.055f;
+            encode[i] = (unsigned char)(s*255.f+.5f);
+        }
+        for (int i = 0; i < 256; i++)
+        {
+            const float s = i/255.f;
+            decode[i] = s <= .04045f ? s/12.92f : std::pow((s+.055f)/1.055f, 2.4f);
+        }
+    }
+};
+
+const Tables &tables()
+{
+    static const Tables t;
+    return t;
+}
+}
+
+Vec3f srgb_to_linear(const TGAColor &c)
+{
+    const float *decode = tables().decode;
+    return Vec3f(decode[c.bgra[2]], decode[c.bgra[1]], decode[c.bgra[0]]);
+}
+
+ToneMapper::ToneMapper(ToneCurve curve, float exposure) : curve_(curve), exposure_(exposure)
+{
+    tables();
+}
+
+void ToneMapper::set_curve(ToneCurve curve)
+{
+    curve_ = curve;
+}
+
+void ToneMapper::set_exposure(float exposure)
+{
+    exposure_ = exposure;
+}
+
+ToneCurve ToneMapper::get_curve() const
+{
+    return curve_;
+}
+
+float ToneMapper::get_exposure() const
+{
+    return exposure_;
+}
+
+float ToneMapper::map(float x) const
+{
+    x *= exposure_;
+    if (curve_ == TONE_REINHARD) x = x/(1.f+x);
+    else if (curve_ == TONE_ACES) x = x*(kAcesA*x+kAcesB)/(x*(kAcesC*x+kAcesD)+kAcesE);
+    return std::min(std::max(x, 0.f), 1.f);
+}
+
+void ToneMapper::map_pixel(const Vec3f &rgb, unsigned char *dst, int bpp) const
+{
+    const unsigned char *encode = tables().encode;
+    const unsigned char px[4] = {encode[(int)(map(rgb.z)*(kLutSize-1)+.5f)], encode[(int)(map(rgb.y)*(kLutSize-1)+.5f)],
+                                 encode[(int)(map(rgb.x)*(kLutSize-1)+.5f)], 255};
+    for (int ch = 0; ch < bpp; ch++) dst[ch] = px[ch];
+}
+
+//Unpacking and the curve run on 4 pixels at a time, only the table lookups and the
+//interleaved byte stores are left scalar
+void ToneMapper::map_row(const uint32_t *rgb9e5, int n, unsigned char *dst, int bpp) const
+{
+    int x = 0;
+#if defined(__SSE2__)
+    const unsigned char *encode = tables().encode;
+    const __m128i mantissa = _mm_set1_epi32(511), bias = _mm_set1_epi32(127-24);
+    const __m128 exposure = _mm_set1_ps(exposure_), one = _mm_set1_ps(1.f), zero = _mm_setzero_ps();
+    const __m128 lutScale = _mm_set1_ps((float)(kLutSize-1)), half = _mm_set1_ps(.5f);
+    const __m128 a = _mm_set1_ps(kAcesA), b = _mm_set1_ps(kAcesB), c = _mm_set1_ps(kAcesC), d = _mm_set1_ps(kAcesD), e = _mm_set1_ps(kAcesE);
+    alignas(16) int32_t index[3][4];
+    for (; x+4 <= n; x += 4)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rgb9e5+x));
+        //2^(exponent-24) built straight from its float bits, times the exposure
+        const __m128 scale = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_srli_epi32(v, 27), bias), 23)), exposure);
+        for (int ch = 0; ch < 3; ch++)
+        {
+            //blue, green, red: the order of the output bytes
+            const int shift = 18-ch*9;
+            __m128 f = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, shift), mantissa)), scale);
+            if (curve_ == TONE_REINHARD) f = _mm_div_ps(f, _mm_add_ps(one, f));
+            else if (curve_ == TONE_ACES)
+            {
+                f = _mm_div_ps(_mm_mul_ps(f, _mm_add_ps(_mm_mul_ps(a, f), b)), _mm_add_ps(_mm_mul_ps(f, _mm_add_ps(_mm_mul_ps(c, f), d)), e));
+            }
+            f = _mm_min_ps(_mm_max_ps(f, zero), one);
+            _mm_store_si128(reinterpret_cast<__m128i *>(index[ch]), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(f, lutScale), half)));
+        }
+        if (bpp == 3)
+        {
+            unsigned char *out = dst+x*3;
+            for (int k = 0; k < 4; k++)
+            {
+                out[k*3] = encode[index[0][k]];
+                out[k*3+1] = encode[index[1][k]];
+                out[k*3+2] = encode[index[2][k]];
+            }
+        }
+        else for (int k = 0; k < 4; k++)
+        {
+            unsigned char *out = dst+(x+k)*bpp;
+            const unsigned char px[4] = {encode[index[0][k]], encode[index[1][k]], encode[index[2][k]], 255};
+            for (int ch = 0; ch < bpp; ch++) out[ch] = px[ch];
+        }
+    }
+#endif
+    for (; x < n; x++) map_pixel(unpack_rgb9e5(rgb9e5[x]), dst+x*bpp, bpp);
+}
+
+const char *ToneMapper::curve_name(ToneCurve curve)
+{
+    return kCurveNames[curve];
+}
+
+bool ToneMapper::parse_curve(const char *name, ToneCurve &curve)
+{
+    for (int c = 0; c < 3; c++)
+    {
+        if (strcmp(name, kCurveNames[c])) continue;
+        curve = (ToneCurve)c;
+        return true;
+    }
+    return false;
+}
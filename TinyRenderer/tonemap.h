@@ -0,0 +1,84 @@
+//
+//  tonemap.h
+//  TinyRenderer
+//
+//  High dynamic range color. An HDR frame keeps linear light in RGB9E5, the shared exponent
+//  format of GL_RGB9_E5: a 9 bit mantissa for each of red, green and blue over one 5 bit
+//  exponent. It takes the same 32 bits as an 8 bit color, so every color store of the
+//  renderer holds it as is, and covers 0 to 65408 to about 3 significant digits of the
+//  brightest channel. ToneMapper turns linear rows into 8 bit sRGB: exposure, a tone curve
+//  that rolls highlights off instead of clipping them, then the sRGB transfer function
+//  through a lookup table. With SSE2 it unpacks and maps 4 pixels at a time.
+//
+
+#ifndef tonemap_h
+#define tonemap_h
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "geometry.h"
+#include "tgaimage.h"
+
+enum ToneCurve { TONE_CLAMP, TONE_REINHARD, TONE_ACES };
+
+//Negative and NaN channels become 0, channels past 65408 saturate
+inline uint32_t pack_rgb9e5(const Vec3f &c)
+{
+    const float kMax = 65408.f; // 511/512*2^16
+    const float r = std::min(std::max(0.f, c.x), kMax), g = std::min(std::max(0.f, c.y), kMax), b = std::min(std::max(0.f, c.z), kMax);
+    const float m = std::max(r, std::max(g, b));
+    //Exponent of m as a float, biased by 15 and kept within the format's 0 to 31
+    uint32_t bits;
+    memcpy(&bits, &m, sizeof(bits));
+    int e = std::max(-16, (int)((bits >> 23)&255)-127)+16;
+    //The exponent's step is 2^(e-24): the mantissas are in [0, 512) of it
+    float scale;
+    uint32_t scaleBits = (uint32_t)(127+24-e) << 23;
+    memcpy(&scale, &scaleBits, sizeof(scale));
+    if ((int)(m*scale+.5f) == 512)
+    {
+        e++;
+        scale *= .5f;
+    }
+    const uint32_t rm = (uint32_t)(r*scale+.5f), gm = (uint32_t)(g*scale+.5f), bm = (uint32_t)(b*scale+.5f);
+    return rm | (gm << 9) | (bm << 18) | ((uint32_t)e << 27);
+}
+
+inline Vec3f unpack_rgb9e5(uint32_t v)
+{
+    float scale;
+    const uint32_t scaleBits = ((v >> 27)+127-24) << 23;
+    memcpy(&scale, &scaleBits, sizeof(scale));
+    return Vec3f((v&511)*scale, ((v >> 9)&511)*scale, ((v >> 18)&511)*scale);
+}
+
+//Linear rgb of an 8 bit sRGB color, through a table
+Vec3f srgb_to_linear(const TGAColor &c);
+
+class ToneMapper
+{
+public:
+    ToneMapper(ToneCurve curve = TONE_ACES, float exposure = 1.f);
+    
+    void set_curve(ToneCurve curve);
+    //Linear values are multiplied by it before the curve
+    void set_exposure(float exposure);
+    ToneCurve get_curve() const;
+    float get_exposure() const;
+    //n RGB9E5 pixels into dst as the first bpp of blue, green, red and an opaque alpha, like
+    //resolve writes 8 bit pixels
+    void map_row(const uint32_t *rgb9e5, int n, unsigned char *dst, int bpp) const;
+    //One linear rgb pixel, the same way
+    void map_pixel(const Vec3f &rgb, unsigned char *dst, int bpp) const;
+    //The curve alone, for one value
+    float map(float x) const;
+    
+    static const char *curve_name(ToneCurve curve);
+    static bool parse_curve(const char *name, ToneCurve &curve);
+private:
+    ToneCurve curve_;
+    float exposure_;
+};
+
+#endif /* tonemap_h */
@@ -0,0 +1,238 @@
+//
+//  wireframe.cpp
+//  TinyRenderer
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "wireframe.h"
+#include "threadpool.h"
+#include "profiler.h"
+
+namespace
+{
+const int kBandRows = 32;
+const int kSetupBatch = 1024;
+const float kNearW = 1e-5f;
+
+Vec4f lerp(const Vec4f &a, const Vec4f &b, float t)
+{
+    Vec4f v;
+    for (int i = 0; i < 4; i++) v[i] = a[i]+(b[i]-a[i])*t;
+    return v;
+}
+}
+
+Wireframe::Wireframe(int width, int height)
+: width_(width), height_(height), bands_((height+kBandRows-1)/kBandRows), viewport_(viewport(0, 0, width, height)),
+  color_(255, 255, 255, 255), flags_(0), bias_(1e-3f), drawn_(0), segments_(), live_(), offsets_(), binned_()
+{}
+
+void Wireframe::set_viewport(const Matrix4f &m)
+{
+    viewport_ = m;
+}
+
+void Wireframe::set_color(const TGAColor &color)
+{
+    color_ = color;
+}
+
+void Wireframe::set_flags(int flags)
+{
+    flags_ = flags;
+}
+
+void Wireframe::set_depth_bias(float bias)
+{
+    bias_ = bias;
+}
+
+int Wireframe::drawn_segments()
+{
+    return drawn_;
+}
+
+//Clips every edge against w > 0 in homogeneous coordinates, then against the viewport
+//after the divide (Liang-Barsky: the segment's parameter range is narrowed by each of
+//the four borders in turn)
+void Wireframe::setup(int first, int last, Model &model, const IShader &shader)
+{
+    const std::vector<Vec2i> &edges = model.edges();
+    for (int e = first; e < last; e++)
+    {
+        live_[e] = 0;
+        const int face = edges[e].x, corner = edges[e].y;
+        Vec4f a = viewport_*shader.vertex(face, corner);
+        Vec4f b = viewport_*shader.vertex(face, (corner+1)%3);
+        if (a[3] < kNearW && b[3] < kNearW) continue;
+        if (a[3] < kNearW) a = lerp(a, b, (kNearW-a[3])/(b[3]-a[3]));
+        else if (b[3] < kNearW) b = lerp(b, a, (kNearW-b[3])/(a[3]-b[3]));
+        const float x0 = a[0]/a[3], y0 = a[1]/a[3], z0 = a[2]/a[3];
+        const float x1 = b[0]/b[3], y1 = b[1]/b[3], z1 = b[2]/b[3];
+
+        const float dx = x1-x0, dy = y1-y0;
+        const float p[4] = {-dx, dx, -dy, dy};
+        const float q[4] = {x0, width_-x0, y0, height_-y0};
+        float t0 = 0.f, t1 = 1.f;
+        bool outside = false;
+        for (int i = 0; i < 4 && !outside; i++)
+        {
+            if (p[i] == 0.f)
+            {
+                outside = q[i] < 0.f; // parallel to this border and beyond it
+                continue;
+            }
+            const float r = q[i]/p[i];
+            if (p[i] < 0.f) t0 = std::max(t0, r);
+            else t1 = std::min(t1, r);
+            outside = t0 > t1;
+        }
+        if (outside) continue;
+        Segment &s = segments_[e];
+        s.x0 = x0+dx*t0;
+        s.y0 = y0+dy*t0;
+        s.z0 = z0+(z1-z0)*t0;
+        s.x1 = x0+dx*t1;
+        s.y1 = y0+dy*t1;
+        s.z1 = z0+(z1-z0)*t1;
+        live_[e] = 1;
+    }
+}
+
+//Bands of the rows the segment can write, one row of margin for the anti-aliased pixel pairs
+void Wireframe::band_rows(const Segment &s, int &first, int &last)
+{
+    const int r0 = std::max(0, (int)std::floor(std::min(s.y0, s.y1))-1);
+    const int r1 = std::min(height_-1, (int)std::floor(std::max(s.y0, s.y1))+1);
+    first = r0/kBandRows;
+    last = r1/kBandRows;
+}
+
+template <bool AA>
+void Wireframe::raster_band(int band, TGAImage &image, const DepthBuffer *depth)
+{
+    const int r0 = band*kBandRows, r1 = std::min(height_, r0+kBandRows)-1;
+    unsigned char *data = image.buffer();
+    const int bpp = image.get_bytespp();
+    const bool flip = image.get_origin() == TGAImage::TOP_LEFT;
+    const bool test = (flags_ & DEPTH_TEST) && depth;
+    const int samples = depth ? depth->get_samples() : 1;
+    auto plot = [&](int x, int y, float z, float coverage)
+    {
+        if (y < r0 || y > r1 || x < 0 || x >= width_) return;
+        if (test && z+bias_ < depth->get(((size_t)x+(size_t)y*width_)*samples)) return;
+        unsigned char *p = data+((size_t)x+(size_t)(flip ? height_-1-y : y)*width_)*bpp;
+        if (!AA)
+        {
+            memcpy(p, color_.bgra, bpp);
+            return;
+        }
+        for (int c = 0; c < bpp; c++) p[c] = (unsigned char)(p[c]+(color_.bgra[c]-p[c])*coverage+.5f);
+    };
+
+    for (int i = offsets_[band]; i < offsets_[band+1]; i++)
+    {
+        const Segment &s = segments_[binned_[i]];
+        //Walked along the major axis from its smaller end, one pixel (or a pair with AA) per
+        //column or row, sampled at the pixel center clamped to the segment
+        if (std::abs(s.x1-s.x0) >= std::abs(s.y1-s.y0))
+        {
+            const bool forward = s.x0 <= s.x1;
+            const float xa = forward ? s.x0 : s.x1, ya = forward ? s.y0 : s.y1, za = forward ? s.z0 : s.z1;
+            const float xb = forward ? s.x1 : s.x0, yb = forward ? s.y1 : s.y0, zb = forward ? s.z1 : s.z0;
+            if (xb == xa)
+            {
+                plot((int)std::floor(xa), (int)std::floor(ya), za, 1.f);
+                continue;
+            }
+            const float slope = (yb-ya)/(xb-xa), dz = (zb-za)/(xb-xa);
+            int c0 = std::max(0, (int)std::floor(xa)), c1 = std::min(width_-1, (int)std::floor(xb));
+            if (slope != 0.f)
+            {
+                //Columns whose y falls in the band, with a column of margin on each side
+                const float xr0 = xa+(r0-1-ya)/slope, xr1 = xa+(r1+2-ya)/slope;
+                c0 = std::max(c0, (int)std::floor(std::min(xr0, xr1))-1);
+                c1 = std::min(c1, (int)std::floor(std::max(xr0, xr1))+1);
+            }
+            for (int x = c0; x <= c1; x++)
+            {
+                const float t = std::min(std::max(x+.5f, xa), xb)-xa;
+                const float y = ya+t*slope, z = za+t*dz;
+                if (!AA)
+                {
+                    plot(x, (int)std::floor(y), z, 1.f);
+                    continue;
+                }
+                const float yc = y-.5f, r = std::floor(yc), f = yc-r;
+                plot(x, (int)r, z, 1.f-f);
+                plot(x, (int)r+1, z, f);
+            }
+            continue;
+        }
+        const bool forward = s.y0 <= s.y1;
+        const float xa = forward ? s.x0 : s.x1, ya = forward ? s.y0 : s.y1, za = forward ? s.z0 : s.z1;
+        const float xb = forward ? s.x1 : s.x0, yb = forward ? s.y1 : s.y0, zb = forward ? s.z1 : s.z0;
+        const float slope = (xb-xa)/(yb-ya), dz = (zb-za)/(yb-ya);
+        const int y0 = std::max(r0, (int)std::floor(ya)), y1 = std::min(r1, (int)std::floor(yb));
+        for (int y = y0; y <= y1; y++)
+        {
+            const float t = std::min(std::max(y+.5f, ya), yb)-ya;
+            const float x = xa+t*slope, z = za+t*dz;
+            if (!AA)
+            {
+                plot((int)std::floor(x), y, z, 1.f);
+                continue;
+            }
+            const float xc = x-.5f, c = std::floor(xc), f = xc-c;
+            plot((int)c, y, z, 1.f-f);
+            plot((int)c+1, y, z, f);
+        }
+    }
+}
+
+bool Wireframe::draw(Model &model, const IShader &shader, TGAImage &image, const DepthBuffer *depth)
+{
+    if (image.get_width() != width_ || image.get_height() != height_ || !image.buffer()) return false;
+    if ((flags_ & DEPTH_TEST) && !depth) return false;
+    PROFILE_SCOPE("wireframe");
+    const int n = (int)model.edges().size();
+    segments_.resize(n);
+    live_.resize(n);
+    ThreadPool &pool = ThreadPool::instance();
+    pool.parallel_for((n+kSetupBatch-1)/kSetupBatch, [&](int batch, int)
+    {
+        setup(batch*kSetupBatch, std::min(n, (batch+1)*kSetupBatch), model, shader);
+    });
+
+    //Counted then filled, same layout as the renderer's bins
+    offsets_.assign(bands_+1, 0);
+    drawn_ = 0;
+    for (int e = 0; e < n; e++)
+    {
+        if (!live_[e]) continue;
+        drawn_++;
+        int first, last;
+        band_rows(segments_[e], first, last);
+        for (int b = first; b <= last; b++) offsets_[b+1]++;
+    }
+    for (int b = 0; b < bands_; b++) offsets_[b+1] += offsets_[b];
+    binned_.resize(offsets_[bands_]);
+    for (int e = 0; e < n; e++)
+    {
+        if (!live_[e]) continue;
+        int first, last;
+        band_rows(segments_[e], first, last);
+        for (int b = first; b <= last; b++) binned_[offsets_[b]++] = e;
+    }
+    for (int b = bands_; b > 0; b--) offsets_[b] = offsets_[b-1];
+    offsets_[0] = 0;
+
+    pool.parallel_for(bands_, [&](int band, int)
+    {
+        if (flags_ & ANTIALIAS) raster_band<true>(band, image, depth);
+        else raster_band<false>(band, image, depth);
+    });
+    return true;
+}
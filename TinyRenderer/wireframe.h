@@ -0,0 +1,68 @@
+//
+//  wireframe.h
+//  TinyRenderer
+//
+//  Edge overlay drawn over a resolved frame, for looking at a mesh. Each edge is drawn once
+//  even when faces share it (see Model::edges). Segments are clipped to the near plane and
+//  to the viewport before they are rasterized. The rows are split into bands rasterized
+//  in parallel, and a band only writes its own rows. Lines can be depth tested against the
+//  renderer's depth buffer and anti-aliased the way Wu's algorithm does it, with the line's
+//  coverage split between the two pixels it passes between.
+//
+
+#ifndef wireframe_h
+#define wireframe_h
+
+#include <vector>
+#include "geometry.h"
+#include "tgaimage.h"
+#include "our_gl.h"
+#include "model.h"
+#include "depthbuffer.h"
+
+class Wireframe
+{
+public:
+    enum Flags { DEPTH_TEST = 1, ANTIALIAS = 2 };
+    
+    Wireframe(int width, int height);
+    
+    void set_viewport(const Matrix4f &m);
+    void set_color(const TGAColor &color);
+    void set_flags(int flags);
+    //Depth tested lines still pass this far (in depth units) behind the surface, so that the
+    //edges of visible faces aren't lost where the line and the triangles round differently
+    void set_depth_bias(float bias);
+    //Draws model's edges, placed by shader.vertex(), over image, which must be width x height.
+    //depth is the renderer's buffer, required with DEPTH_TEST.
+    bool draw(Model &model, const IShader &shader, TGAImage &image, const DepthBuffer *depth = nullptr);
+    //Segments of the last draw() that survived clipping
+    int drawn_segments();
+private:
+    struct Segment
+    {
+        float x0, y0, z0;
+        float x1, y1, z1;
+    };
+    
+    int width_;
+    int height_;
+    int bands_;
+    Matrix4f viewport_;
+    TGAColor color_;
+    int flags_;
+    float bias_;
+    int drawn_;
+    //Kept between draws so that steady state overlays don't allocate
+    std::vector<Segment> segments_;
+    std::vector<char> live_;
+    std::vector<int> offsets_; // segments of band b are binned_[offsets_[b]] to binned_[offsets_[b+1]-1]
+    std::vector<int> binned_;
+    
+    void setup(int first, int last, Model &model, const IShader &shader);
+    void band_rows(const Segment &s, int &first, int &last);
+    template <bool AA>
+    void raster_band(int band, TGAImage &image, const DepthBuffer *depth);
+};
+    
+#endif /* wireframe_h */